@@ -272,6 +272,11 @@ void App::initialize(const AppOptions& options)
         else if (opt == &options.trim()) {
           trim = true;
         }
+        // --merge-duplicates
+        else if (opt == &options.mergeDuplicates()) {
+          if (m_exporter)
+            m_exporter->setMergeDuplicates(true);
+        }
         // --filename-format
         else if (opt == &options.filenameFormat()) {
           filenameFormat = value.value();
@@ -50,6 +50,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_importLayer(m_po.add("import-layer").requiresValue("<name>").description("Import just one layer of the next given sprite"))
   , m_ignoreEmpty(m_po.add("ignore-empty").description("Do not export empty frames/cels"))
   , m_trim(m_po.add("trim").description("Trim all images before exporting"))
+  , m_mergeDuplicates(m_po.add("merge-duplicates").description("Use the same area of the texture for\nidentical images"))
   , m_filenameFormat(m_po.add("filename-format").requiresValue("<fmt>").description("Special format to generate filenames"))
   , m_verbose(m_po.add("verbose").description("Explain what is being done"))
   , m_help(m_po.add("help").mnemonic('?').description("Display this help and exits"))
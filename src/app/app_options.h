@@ -58,6 +58,7 @@ public:
   const Option& importLayer() const { return m_importLayer; }
   const Option& ignoreEmpty() const { return m_ignoreEmpty; }
   const Option& trim() const { return m_trim; }
+  const Option& mergeDuplicates() const { return m_mergeDuplicates; }
   const Option& filenameFormat() const { return m_filenameFormat; }
 
   bool hasExporterParams() const;
@@ -87,6 +88,7 @@ private:
   Option& m_importLayer;
   Option& m_ignoreEmpty;
   Option& m_trim;
+  Option& m_mergeDuplicates;
   Option& m_filenameFormat;
 
   Option& m_verbose;
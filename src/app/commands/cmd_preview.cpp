@@ -194,7 +194,7 @@ protected:
       m_render.reset(
         renderEngine.renderSprite(
           0, 0, m_sprite->width(), m_sprite->height(),
-          m_editor->frame(), 0, false, false, buf));
+          m_editor->frame(), Zoom(1, 1), false, false, buf));
     }
 
     int x, y, w, h, u, v;
@@ -23,6 +23,7 @@
 #include "app/data_recovery.h"
 
 #include "app/backup.h"
+#include "app/undoers/spill_file.h"
 #include "base/fs.h"
 #include "base/path.h"
 #include "base/temp_dir.h"
@@ -56,6 +57,10 @@ DataRecovery::DataRecovery(doc::Context* context)
     flush_config_file();
   }
 
+  // Old undo data is moved to a file in the same directory.
+  undoers::SpillFile::setCurrent(undoers::SpillFilePtr(
+      new undoers::SpillFile(base::join_path(m_tempDir->path(), "undo.spill"))));
+
   m_context->addObserver(this);
   m_context->documents().addObserver(this);
 }
@@ -67,6 +72,13 @@ DataRecovery::~DataRecovery()
 
   delete m_backup;
 
+  // Undoers can keep a reference to the spill file, but the file
+  // must be deleted before the directory.
+  if (undoers::SpillFile::current()) {
+    undoers::SpillFile::current()->close();
+    undoers::SpillFile::setCurrent(undoers::SpillFilePtr());
+  }
+
   if (m_tempDir) {
     delete m_tempDir;
     set_config_string("DataRecovery", "Path", "");
@@ -24,6 +24,7 @@
 
 #include "app/document_api.h"
 #include "app/document_undo.h"
+#include "app/file/compressed_image_cache.h"
 #include "app/file/format_options.h"
 #include "app/flatten.h"
 #include "app/objects_container_impl.h"
@@ -57,6 +58,7 @@ Document::Document(Sprite* sprite)
   , m_read_locks(0)
     // Information about the file format used to load/save this document
   , m_format_options(NULL)
+  , m_compressedImageCache(new CompressedImageCache)
     // Extra cel
   , m_extraCel(NULL)
   , m_extraImage(NULL)
@@ -101,10 +103,12 @@ void Document::notifyGeneralUpdate()
   notifyObservers<doc::DocumentEvent&>(&doc::DocumentObserver::onGeneralUpdate, ev);
 }
 
-void Document::notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region)
+void Document::notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region,
+                                          Layer* layer)
 {
   doc::DocumentEvent ev(this);
   ev.sprite(sprite);
+  ev.layer(layer);
   ev.region(region);
   notifyObservers<doc::DocumentEvent&>(&doc::DocumentObserver::onSpritePixelsModified, ev);
 }
@@ -53,6 +53,7 @@ namespace undo {
 }
 
 namespace app {
+  class CompressedImageCache;
   class DocumentApi;
   class DocumentUndo;
   struct BoundSeg;
@@ -89,7 +90,13 @@ namespace app {
     // Notifications
 
     void notifyGeneralUpdate();
-    void notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region);
+
+    // The layer is optional, it can be specified when we know that
+    // only the pixels of that layer were modified (e.g. drawing with a
+    // tool in the active layer).
+    void notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region,
+                                    Layer* layer = NULL);
+
     void notifyLayerMergedDown(Layer* srcLayer, Layer* targetLayer);
     void notifyCelMoved(Layer* fromLayer, FrameNumber fromFrame, Layer* toLayer, FrameNumber toFrame);
     void notifyCelCopied(Layer* fromLayer, FrameNumber fromFrame, Layer* toLayer, FrameNumber toFrame);
@@ -114,6 +121,10 @@ namespace app {
     void setFormatOptions(const SharedPtr<FormatOptions>& format_options);
     SharedPtr<FormatOptions> getFormatOptions() { return m_format_options; }
 
+    // Compressed pixels of images as they are in the file, used to
+    // save again unmodified images without compressing them.
+    CompressedImageCache* compressedImageCache() { return m_compressedImageCache; }
+
     //////////////////////////////////////////////////////////////////////
     // Boundaries
 
@@ -213,6 +224,9 @@ namespace app {
     // Data to save the file in the same format that it was loaded
     SharedPtr<FormatOptions> m_format_options;
 
+    // Compressed images from the last load/save of the file.
+    base::UniquePtr<CompressedImageCache> m_compressedImageCache;
+
     // Extra cel used to draw extra stuff (e.g. editor's pen preview, pixels in movement, etc.)
     Cel* m_extraCel;
 
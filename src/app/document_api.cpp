@@ -158,7 +158,6 @@ void DocumentApi::trimSprite(Sprite* sprite)
 void DocumentApi::setPixelFormat(Sprite* sprite, PixelFormat newFormat, DitheringMethod dithering_method)
 {
   Image* old_image;
-  Image* new_image;
   int c;
 
   if (sprite->pixelFormat() == newFormat)
@@ -177,6 +176,12 @@ void DocumentApi::setPixelFormat(Sprite* sprite, PixelFormat newFormat, Ditherin
   if (sprite->backgroundLayer() != NULL)
     sprite->backgroundLayer()->getCels(bgCels);
 
+  // Convert all images of the stock at the same time (in parallel).
+  std::vector<int> indexes;
+  std::vector<const Image*> old_images;
+  std::vector<Image*> new_images;
+  std::vector<bool> is_background;
+
   for (c=0; c<sprite->stock()->size(); c++) {
     old_image = sprite->stock()->getImage(c);
     if (!old_image)
@@ -190,14 +195,19 @@ void DocumentApi::setPixelFormat(Sprite* sprite, PixelFormat newFormat, Ditherin
       }
     }
 
-    new_image = quantization::convert_pixel_format
-      (old_image, NULL, newFormat, dithering_method, rgbmap,
-       sprite->getPalette(frame),
-       is_image_from_background);
-
-    replaceStockImage(sprite, c, new_image);
+    indexes.push_back(c);
+    old_images.push_back(old_image);
+    is_background.push_back(is_image_from_background);
   }
 
+  quantization::convert_images_pixel_format
+    (old_images, new_images, is_background,
+     newFormat, dithering_method, rgbmap,
+     sprite->getPalette(frame));
+
+  for (c=0; c<(int)indexes.size(); ++c)
+    replaceStockImage(sprite, indexes[c], new_images[c]);
+
   // Set all cels opacity to 100% if we are converting to indexed.
   if (newFormat == IMAGE_INDEXED) {
     CelList cels;
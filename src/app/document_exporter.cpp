@@ -30,6 +30,8 @@
 #include "app/ui_context.h"
 #include "base/convert_to.h"
 #include "base/path.h"
+#include "base/shared_ptr.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "gfx/packing_rects.h"
 #include "gfx/size.h"
@@ -46,11 +48,33 @@
 #include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <map>
 
 using namespace raster;
 
 namespace app {
 
+// Maximum memory used to keep the trimmed renders of samples from
+// captureSamples() to renderTexture(). The rest of samples are
+// rendered again.
+static const int max_kept_renders_bytes = 256*1024*1024;
+
+// FNV-1a hash of the pixels of an image, used to find duplicated
+// samples.
+static uint32_t hash_image(const Image* image)
+{
+  uint32_t hash = 2166136261u;
+  int rowBytes = image->getRowStrideSize();
+
+  for (int y=0; y<image->height(); ++y) {
+    const uint8_t* p = image->getPixelAddress(0, y);
+    for (int x=0; x<rowBytes; ++x, ++p)
+      hash = (hash ^ *p) * 16777619u;
+  }
+
+  return hash;
+}
+
 class DocumentExporter::Sample {
 public:
   Sample(Document* document, Sprite* sprite, Layer* layer,
@@ -62,7 +86,8 @@ public:
     m_filename(filename),
     m_originalSize(sprite->width(), sprite->height()),
     m_trimmedBounds(0, 0, sprite->width(), sprite->height()),
-    m_inTextureBounds(0, 0, sprite->width(), sprite->height()) {
+    m_inTextureBounds(0, 0, sprite->width(), sprite->height()),
+    m_duplicateOf(NULL) {
   }
 
   Document* document() const { return m_document; }
@@ -74,6 +99,32 @@ public:
   const gfx::Rect& trimmedBounds() const { return m_trimmedBounds; }
   const gfx::Rect& inTextureBounds() const { return m_inTextureBounds; }
 
+  // Render of the trimmed bounds of the sample (it can be NULL if
+  // the sample wasn't rendered in captureSamples()).
+  const Image* image() const { return m_image.get(); }
+
+  // Sample with the same pixels that this one, both share the same
+  // bounds in the texture (NULL if this sample is unique).
+  const Sample* duplicateOf() const { return m_duplicateOf; }
+  bool isDuplicate() const { return m_duplicateOf != NULL; }
+
+  // Returns true if both samples were rendered with exactly the same
+  // pixels.
+  bool hasSameRender(const Sample& other) const {
+    const Image* a = image();
+    const Image* b = other.image();
+    if (!a || !b || a->maskColor() != b->maskColor())
+      return false;
+
+    // Indexed renders are equal only if they use the same palette.
+    if (a->pixelFormat() == IMAGE_INDEXED &&
+        (m_sprite != other.m_sprite ||
+         m_sprite->getPalette(m_frame) != m_sprite->getPalette(other.m_frame)))
+      return false;
+
+    return (count_diff_between_images(a, b) == 0);
+  }
+
   bool trimmed() const {
     return m_trimmedBounds.x > 0
       || m_trimmedBounds.y > 0
@@ -84,6 +135,8 @@ public:
   void setOriginalSize(const gfx::Size& size) { m_originalSize = size; }
   void setTrimmedBounds(const gfx::Rect& bounds) { m_trimmedBounds = bounds; }
   void setInTextureBounds(const gfx::Rect& bounds) { m_inTextureBounds = bounds; }
+  void setImage(Image* image) { m_image.reset(image); }
+  void setDuplicateOf(const Sample* sample) { m_duplicateOf = sample; }
 
 private:
   Document* m_document;
@@ -94,6 +147,8 @@ private:
   gfx::Size m_originalSize;
   gfx::Rect m_trimmedBounds;
   gfx::Rect m_inTextureBounds;
+  SharedPtr<Image> m_image;
+  const Sample* m_duplicateOf;
 };
 
 class DocumentExporter::Samples {
@@ -104,8 +159,9 @@ public:
 
   bool empty() const { return m_samples.empty(); }
 
-  void addSample(const Sample& sample) {
+  Sample& addSample(const Sample& sample) {
     m_samples.push_back(sample);
+    return m_samples.back();
   }
 
   iterator begin() { return m_samples.begin(); }
@@ -134,6 +190,10 @@ public:
     gfx::Size rowSize(0, 0);
 
     for (auto& sample : samples) {
+      // Duplicated samples use the place of the original one.
+      if (sample.isDuplicate())
+        continue;
+
       const Sprite* sprite = sample.sprite();
       const Layer* layer = sample.layer();
       gfx::Size size = sample.trimmedBounds().getSize();
@@ -177,8 +237,10 @@ public:
   void layoutSamples(Samples& samples, int& width, int& height) override {
     gfx::PackingRects pr;
 
-    for (auto& sample : samples)
-      pr.add(sample.trimmedBounds().getSize());
+    for (auto& sample : samples) {
+      if (!sample.isDuplicate())
+        pr.add(sample.trimmedBounds().getSize());
+    }
 
     if (width == 0 || height == 0) {
       gfx::Size sz = pr.bestFit();
@@ -190,6 +252,9 @@ public:
 
     auto it = samples.begin();
     for (auto& rc : pr) {
+      while (it != samples.end() && it->isDuplicate())
+        ++it;
+
       ASSERT(it != samples.end());
       it->setInTextureBounds(rc);
       ++it;
@@ -197,6 +262,111 @@ public:
   }
 };
 
+// Renders the full frame of each sample to calculate its trimmed
+// bounds and the hash of its pixels. Each sample is rendered in its
+// own image, so several samples can be processed at the same time.
+class DocumentExporter::TrimSamples {
+public:
+  TrimSamples(const DocumentExporter* exporter, Sample* samples,
+              char* empty, uint32_t* hashes)
+    : m_exporter(exporter)
+    , m_samples(samples)
+    , m_empty(empty)
+    , m_hashes(hashes) {
+  }
+
+  void operator()(int i) const {
+    Sample& sample = m_samples[i];
+    const Sprite* sprite = sample.sprite();
+
+    base::UniquePtr<Image> sampleRender(
+      Image::create(sprite->pixelFormat(),
+        sprite->width(),
+        sprite->height()));
+
+    sampleRender->setMaskColor(sprite->transparentColor());
+    clear_image(sampleRender, sprite->transparentColor());
+    renderSample(sample, sampleRender, 0, 0);
+
+    if (m_exporter->m_ignoreEmptyCels || m_exporter->m_trimCels) {
+      gfx::Rect frameBounds;
+      raster::color_t refColor;
+
+      if (m_exporter->m_trimCels)
+        refColor = get_pixel(sampleRender, 0, 0);
+      else
+        refColor = sprite->transparentColor();
+
+      if (!algorithm::shrink_bounds(sampleRender, frameBounds, refColor)) {
+        // If shrink_bounds returns false, it's because the whole
+        // image is transparent (equal to the mask color).
+        m_empty[i] = true;
+        return;
+      }
+
+      if (m_exporter->m_trimCels) {
+        sample.setTrimmedBounds(frameBounds);
+        sample.setImage(
+          crop_image(sampleRender,
+            frameBounds.x, frameBounds.y,
+            frameBounds.w, frameBounds.h,
+            sprite->transparentColor()));
+      }
+    }
+
+    // Keep the render so renderTexture() doesn't need to render the
+    // sample again.
+    if (!sample.image())
+      sample.setImage(sampleRender.release());
+
+    if (m_hashes)
+      m_hashes[i] = hash_image(sample.image());
+  }
+
+private:
+  const DocumentExporter* m_exporter;
+  Sample* m_samples;
+  char* m_empty;
+  uint32_t* m_hashes;
+};
+
+// Draws each sample in its place of the texture. Samples don't
+// overlap, so they can be drawn from several threads.
+class DocumentExporter::RenderSamples {
+public:
+  RenderSamples(const std::vector<const Sample*>& samples, Image* textureImage)
+    : m_samples(samples)
+    , m_textureImage(textureImage) {
+  }
+
+  void operator()(int i) const {
+    const Sample& sample = *m_samples[i];
+    const gfx::Rect& inTexture = sample.inTextureBounds();
+
+    // Use the render from captureSamples() if it's compatible with
+    // the texture.
+    if (sample.image() &&
+        sample.image()->pixelFormat() == m_textureImage->pixelFormat()) {
+      copy_image(m_textureImage, sample.image(), inTexture.x, inTexture.y);
+      return;
+    }
+
+    gfx::Rect trimmed = sample.trimmedBounds();
+    base::UniquePtr<Image> tmp(
+      Image::create(sample.sprite()->pixelFormat(),
+        trimmed.w, trimmed.h));
+
+    clear_image(tmp, sample.sprite()->transparentColor());
+    renderSample(sample, tmp, -trimmed.x, -trimmed.y);
+
+    copy_image(m_textureImage, tmp, inTexture.x, inTexture.y);
+  }
+
+private:
+  const std::vector<const Sample*>& m_samples;
+  Image* m_textureImage;
+};
+
 DocumentExporter::DocumentExporter()
  : m_dataFormat(DefaultDataFormat)
  , m_textureFormat(DefaultTextureFormat)
@@ -207,6 +377,7 @@ DocumentExporter::DocumentExporter()
  , m_scaleMode(DefaultScaleMode)
  , m_ignoreEmptyCels(false)
  , m_trimCels(false)
+ , m_mergeDuplicates(false)
 {
 }
 
@@ -243,6 +414,11 @@ void DocumentExporter::exportSheet()
     layout.layoutSamples(samples, m_textureWidth, m_textureHeight);
   }
 
+  for (auto& sample : samples) {
+    if (sample.isDuplicate())
+      sample.setInTextureBounds(sample.duplicateOf()->inTextureBounds());
+  }
+
   // 3) Create and render the texture.
   base::UniquePtr<Document> textureDocument(
     createEmptyTexture(samples));
@@ -266,7 +442,7 @@ void DocumentExporter::exportSheet()
 
 void DocumentExporter::captureSamples(Samples& samples)
 {
-  std::vector<char> buf(32);
+  std::vector<Sample> allSamples;
 
   for (auto& item : m_documents) {
     Document* doc = item.doc;
@@ -303,36 +479,65 @@ void DocumentExporter::captureSamples(Samples& samples)
           // Empty cel this sample completely
           continue;
         }
+      }
 
-        base::UniquePtr<Image> sampleRender(
-          Image::create(sprite->pixelFormat(),
-            sprite->width(),
-            sprite->height(),
-            m_sampleRenderBuf));
-
-        sampleRender->setMaskColor(sprite->transparentColor());
-        clear_image(sampleRender, sprite->transparentColor());
-        renderSample(sample, sampleRender);
-
-        gfx::Rect frameBounds;
-        raster::color_t refColor;
+      allSamples.push_back(sample);
+    }
+  }
 
-        if (m_trimCels)
-          refColor = get_pixel(sampleRender, 0, 0);
-        else if (m_ignoreEmptyCels)
-          refColor = sprite->transparentColor();
+  if (!m_ignoreEmptyCels && !m_trimCels && !m_mergeDuplicates) {
+    for (auto& sample : allSamples)
+      samples.addSample(sample);
+    return;
+  }
 
-        if (!algorithm::shrink_bounds(sampleRender, frameBounds, refColor)) {
-          // If shrink_bounds returns false, it's because the whole
-          // image is transparent (equal to the mask color).
-          continue;
+  // Samples are rendered in batches so only a few full frames are
+  // in memory at the same time.
+  int batchSize = 4*base::thread_pool::shared().size();
+  int keptBytes = 0;
+
+  // Kept renders indexed by the hash of their pixels.
+  std::multimap<uint32_t, const Sample*> renders;
+
+  for (int first=0; first<int(allSamples.size()); first+=batchSize) {
+    int n = MIN(batchSize, int(allSamples.size())-first);
+    std::vector<char> empty(n, false);
+    std::vector<uint32_t> hashes(n, 0);
+
+    base::thread_pool::shared().for_each_index(n,
+      TrimSamples(this, &allSamples[first], &empty[0],
+        m_mergeDuplicates ? &hashes[0]: NULL));
+
+    for (int i=0; i<n; ++i) {
+      if (empty[i])
+        continue;
+
+      Sample& sample = samples.addSample(allSamples[first+i]);
+      allSamples[first+i].setImage(NULL);
+
+      if (m_mergeDuplicates && sample.image()) {
+        auto range = renders.equal_range(hashes[i]);
+        for (auto it=range.first; it!=range.second; ++it) {
+          if (sample.hasSameRender(*it->second)) {
+            sample.setDuplicateOf(it->second);
+            sample.setImage(NULL);
+            break;
+          }
         }
-
-        if (m_trimCels)
-          sample.setTrimmedBounds(frameBounds);
+        if (sample.isDuplicate())
+          continue;
       }
 
-      samples.addSample(sample);
+      if (sample.image()) {
+        int bytes = sample.image()->getMemSize();
+        if (keptBytes+bytes <= max_kept_renders_bytes) {
+          keptBytes += bytes;
+          if (m_mergeDuplicates)
+            renders.insert(std::make_pair(hashes[i], &sample));
+        }
+        else
+          sample.setImage(NULL);
+      }
     }
   }
 }
@@ -384,7 +589,12 @@ void DocumentExporter::renderTexture(const Samples& samples, Image* textureImage
 {
   textureImage->clear(0);
 
+  std::vector<const Sample*> list;
   for (const auto& sample : samples) {
+    // Duplicated samples are drawn by the original one.
+    if (sample.isDuplicate())
+      continue;
+
     // Make the sprite compatible with the texture so the render()
     // works correctly.
     if (sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
@@ -395,8 +605,15 @@ void DocumentExporter::renderTexture(const Samples& samples, Image* textureImage
         DITHERING_NONE);
     }
 
-    renderSample(sample, textureImage);
+    list.push_back(&sample);
   }
+
+  // Texture pixels are unshared here, so each sample can be drawn
+  // from a different thread without modifying the image structure.
+  textureImage->unshare(textureImage->bounds());
+
+  base::thread_pool::shared().for_each_index(int(list.size()),
+    RenderSamples(list, textureImage));
 }
 
 void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os, Image* textureImage)
@@ -450,24 +667,13 @@ void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os,
      << "}\n";
 }
 
-void DocumentExporter::renderSample(const Sample& sample, raster::Image* dst)
+// static
+void DocumentExporter::renderSample(const Sample& sample, raster::Image* dst, int x, int y)
 {
-  gfx::Rect trimmed = sample.trimmedBounds();
-  base::UniquePtr<Image> tmp(
-    Image::create(sample.sprite()->pixelFormat(),
-      trimmed.w, trimmed.h,
-      m_sampleRenderBuf));
-
-  if (sample.layer()) {
-    layer_render(sample.layer(), tmp, -trimmed.x, -trimmed.y, sample.frame());
-  }
-  else {
-    sample.sprite()->render(tmp, -trimmed.x, -trimmed.y, sample.frame());
-  }
-
-  copy_image(dst, tmp,
-    sample.inTextureBounds().x,
-    sample.inTextureBounds().y);
+  if (sample.layer())
+    layer_render(sample.layer(), dst, x, y, sample.frame());
+  else
+    sample.sprite()->render(dst, x, y, sample.frame());
 }
 
 } // namespace app
@@ -22,7 +22,6 @@
 
 #include "base/disable_copying.h"
 #include "gfx/fwd.h"
-#include "raster/image_buffer.h"
 
 #include <iosfwd>
 #include <string>
@@ -98,6 +97,12 @@ namespace app {
       m_trimCels = trim;
     }
 
+    // Samples with exactly the same pixels use the same bounds in
+    // the texture.
+    void setMergeDuplicates(bool merge) {
+      m_mergeDuplicates = merge;
+    }
+
     void setFilenameFormat(const std::string& format) {
       m_filenameFormat = format;
     }
@@ -114,12 +119,14 @@ namespace app {
     class LayoutSamples;
     class SimpleLayoutSamples;
     class BestFitLayoutSamples;
+    class TrimSamples;
+    class RenderSamples;
 
     void captureSamples(Samples& samples);
     Document* createEmptyTexture(const Samples& samples);
     void renderTexture(const Samples& samples, raster::Image* textureImage);
     void createDataFile(const Samples& samples, std::ostream& os, raster::Image* textureImage);
-    void renderSample(const Sample& sample, raster::Image* dst);
+    static void renderSample(const Sample& sample, raster::Image* dst, int x, int y);
 
     class Item {
     public:
@@ -142,9 +149,9 @@ namespace app {
     ScaleMode m_scaleMode;
     bool m_ignoreEmptyCels;
     bool m_trimCels;
+    bool m_mergeDuplicates;
     Items m_documents;
     std::string m_filenameFormat;
-    raster::ImageBufferPtr m_sampleRenderBuf;
 
     DISABLE_COPYING(DocumentExporter);
   };
@@ -20,17 +20,28 @@
 #include "config.h"
 #endif
 
+#include "app/context.h"
 #include "app/document.h"
+#include "app/file/ase_options.h"
+#include "app/file/compressed_image_cache.h"
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
+#include "app/ini_file.h"
 #include "base/cfile.h"
 #include "base/exception.h"
 #include "base/file_handle.h"
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
+#include "base/thread_pool.h"
 #include "raster/raster.h"
 #include "zlib.h"
 
+#include <map>
+#include <set>
 #include <stdio.h>
+#include <string>
+#include <vector>
 
 #define ASE_FILE_MAGIC                  0xA5E0
 #define ASE_FILE_FRAME_MAGIC            0xF1FA
@@ -90,7 +101,9 @@ static void ase_file_prepare_frame_header(FILE* f, ASE_FrameHeader* frame_header
 static void ase_file_write_frame_header(FILE* f, ASE_FrameHeader* frame_header);
 
 static void ase_file_write_layers(FILE* f, ASE_FrameHeader* frame_header, Layer* layer);
-static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, FrameNumber frame);
+class CelEncoder;
+
+static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, FrameNumber frame, CelEncoder* encoder);
 
 static void ase_file_read_padding(FILE* f, int bytes);
 static void ase_file_write_padding(FILE* f, int bytes);
@@ -105,8 +118,10 @@ static Palette* ase_file_read_color2_chunk(FILE* f, Sprite* sprite, FrameNumber
 static void ase_file_write_color2_chunk(FILE* f, ASE_FrameHeader* frame_header, Palette* pal);
 static Layer* ase_file_read_layer_chunk(FILE* f, Sprite* sprite, Layer** previous_layer, int* current_level);
 static void ase_file_write_layer_chunk(FILE* f, ASE_FrameHeader* frame_header, Layer* layer);
-static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, FrameNumber frame, PixelFormat pixelFormat, FileOp* fop, ASE_Header* header, size_t chunk_end);
-static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite);
+class CelDecoder;
+
+static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, FrameNumber frame, PixelFormat pixelFormat, FileOp* fop, ASE_Header* header, size_t chunk_end, CelDecoder* decoder);
+static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite, CelEncoder* encoder);
 static Mask* ase_file_read_mask_chunk(FILE* f);
 #if 0
 static void ase_file_write_mask_chunk(FILE* f, ASE_FrameHeader* frame_header, Mask* mask);
@@ -127,6 +142,116 @@ private:
   ASE_Chunk m_chunk;
 };
 
+// Decodes compressed cels in parallel. The loader reads chunks in
+// order (layers, palettes, etc. are applied immediately), but the
+// compressed pixels of each cel are only read in memory. They are
+// inflated in batches by a pool of threads (the images of a batch
+// cannot be used until the batch is decoded). Linked cels are
+// resolved after each batch because they copy the image of other
+// cel. The zlib data of each decoded image is kept in a
+// CompressedImageCache to save the file again without compressing
+// unmodified images.
+class CelDecoder {
+public:
+  CelDecoder(FileOp* fop, ASE_Header* header);
+  ~CelDecoder();
+
+  // Adds a new image (with the given stock index) to be decoded from
+  // the given zlib data (the vector is swapped, so it's empty after
+  // the call).
+  void addImage(int imageIndex, Image* image, std::vector<uint8_t>& compressed);
+
+  // Sets the image of "cel" as a copy of the "link" cel image after
+  // decoding the pending images.
+  void addLink(Sprite* sprite, Cel* cel, Cel* link);
+
+  // Returns true if there is too much compressed data in memory.
+  bool isFull() const;
+
+  // Decodes all pending images and resolves links. Errors in
+  // specific cels are reported with fop_error() (in file order).
+  void decode();
+
+  // Reports the load progress, "pos" is the position of the file
+  // that was read.
+  void progress(long pos);
+
+  // Zlib data of the decoded images.
+  CompressedImageCache& cache() { return m_cache; }
+
+private:
+  struct Job {
+    int imageIndex;
+    Image* image;
+    std::vector<uint8_t> compressed;
+    bool complete;              // False if the zlib stream is truncated
+    std::string error;
+  };
+
+  struct Link {
+    Sprite* sprite;
+    Cel* cel;
+    Cel* link;
+  };
+
+  class DecodeJob;
+
+  FileOp* m_fop;
+  ASE_Header* m_header;
+  std::vector<Job*> m_jobs;
+  std::vector<Link> m_links;
+  size_t m_pendingBytes;
+  long m_readPos;
+  size_t m_decodedBytes;
+  base::mutex m_mutex;          // To modify m_decodedBytes from workers
+  CompressedImageCache m_cache;
+};
+
+// Compresses the images of the cels in parallel before saving
+// them. Chunks are written in order as always, but the zlib data of
+// each cel is already in memory when the chunk is written. Images are
+// compressed in batches of consecutive frames. Images that weren't
+// modified since the file was loaded/saved are taken from the given
+// cache (which is updated with the new compressed images).
+class CelEncoder {
+public:
+  CelEncoder(Sprite* sprite, int compressionLevel, CompressedImageCache* cache);
+  ~CelEncoder();
+
+  // Compresses the cel images of a batch of frames starting from
+  // the given one (if it isn't compressed yet).
+  void encodeFrames(FrameNumber frame);
+
+  // Returns the zlib data of an image of the current batch.
+  const std::vector<uint8_t>& compressedImage(const Image* image) const;
+
+  // Removes images that weren't saved (e.g. removed images) from the
+  // cache.
+  void removeUnusedFromCache();
+
+private:
+  struct Job {
+    int imageIndex;
+    const Image* image;
+    const std::vector<uint8_t>* cached; // Data from the cache (or NULL)
+    std::vector<uint8_t> compressed;
+  };
+
+  class EncodeJob;
+
+  void clear();
+  void addImages(Layer* layer, FrameNumber frame);
+
+  Sprite* m_sprite;
+  int m_compressionLevel;
+  CompressedImageCache* m_cache;
+  std::set<int> m_usedImages;   // Stock indexes of all saved images
+  FrameNumber m_nextFrame;      // First frame that isn't compressed yet
+  size_t m_batchBytes;
+  std::vector<Job*> m_jobs;
+  std::map<const Image*, Job*> m_images;
+};
+
 class AseFormat : public FileFormat {
   const char* onGetName() const { return "ase"; }
   const char* onGetExtensions() const { return "ase,aseprite"; }
@@ -181,11 +306,14 @@ bool AseFormat::onLoad(FileOp* fop)
   Layer* last_layer = sprite->folder();
   int current_level = -1;
 
+  // Compressed cels are decoded in parallel
+  CelDecoder decoder(fop, &header);
+
   /* read frame by frame to end-of-file */
   for (FrameNumber frame(0); frame<sprite->totalFrames(); ++frame) {
     /* start frame position */
     int frame_pos = ftell(f);
-    fop_progress(fop, (float)frame_pos / (float)header.size);
+    decoder.progress(frame_pos);
 
     /* read frame header */
     ASE_FrameHeader frame_header;
@@ -201,7 +329,7 @@ bool AseFormat::onLoad(FileOp* fop)
       for (int c=0; c<frame_header.chunks; c++) {
         /* start chunk position */
         int chunk_pos = ftell(f);
-        fop_progress(fop, (float)chunk_pos / (float)header.size);
+        decoder.progress(chunk_pos);
 
         // Read chunk information
         int chunk_size = fgetl(f);
@@ -239,7 +367,10 @@ bool AseFormat::onLoad(FileOp* fop)
 
             ase_file_read_cel_chunk(f, sprite, frame,
                                     sprite->pixelFormat(), fop, &header,
-                                    chunk_pos+chunk_size);
+                                    chunk_pos+chunk_size, &decoder);
+
+            if (decoder.isFull())
+              decoder.decode();
             break;
           }
 
@@ -282,9 +413,14 @@ bool AseFormat::onLoad(FileOp* fop)
       break;
   }
 
+  // Decode the rest of cels
+  decoder.decode();
+
   fop->createDocument(sprite);
   sprite.release();
 
+  fop->document->compressedImageCache()->swap(decoder.cache());
+
   if (ferror(f)) {
     fop_error(fop, "Error reading file.\n");
     return false;
@@ -300,6 +436,22 @@ bool AseFormat::onSave(FileOp* fop)
   Sprite* sprite = fop->document->sprite();
   FileHandle f(open_file_with_exception(fop->filename, "wb"));
 
+  // Compression level from the format options of the file operation,
+  // or from the "[ASE] Compression" entry of the configuration file
+  // (0=fast, 1=default, 2=max) in interactive mode.
+  AseOptions::Compression compression = AseOptions::DefaultCompression;
+  AseOptions* ase_options = dynamic_cast<AseOptions*>(fop->seq.format_options.get());
+  if (ase_options)
+    compression = ase_options->compression();
+  else if (fop->context && fop->context->isUiAvailable())
+    compression = (AseOptions::Compression)get_config_int("ASE", "Compression", (int)compression);
+
+  CelEncoder encoder(sprite,
+    compression == AseOptions::FastCompression ? Z_BEST_SPEED:
+    compression == AseOptions::MaxCompression ? Z_BEST_COMPRESSION:
+                                                Z_DEFAULT_COMPRESSION,
+    fop->document->compressedImageCache());
+
   // Write the header
   ASE_Header header;
   ase_file_prepare_header(f, &header, sprite);
@@ -332,7 +484,8 @@ bool AseFormat::onSave(FileOp* fop)
     }
 
     // Write cel chunks
-    ase_file_write_cels(f, &frame_header, sprite, sprite->folder(), frame);
+    encoder.encodeFrames(frame);
+    ase_file_write_cels(f, &frame_header, sprite, sprite->folder(), frame, &encoder);
 
     // Write the frame header
     ase_file_write_frame_header(f, &frame_header);
@@ -345,6 +498,8 @@ bool AseFormat::onSave(FileOp* fop)
       break;
   }
 
+  encoder.removeUnusedFromCache();
+
   // Write the missing field (filesize) of the header.
   ase_file_write_header_filesize(f, &header);
 
@@ -495,7 +650,7 @@ static void ase_file_write_layers(FILE* f, ASE_FrameHeader* frame_header, Layer*
   }
 }
 
-static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, FrameNumber frame)
+static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, FrameNumber frame, CelEncoder* encoder)
 {
   if (layer->isImage()) {
     Cel* cel = static_cast<LayerImage*>(layer)->getCel(frame);
@@ -503,7 +658,7 @@ static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite*
 /*       fop_error(fop, "New cel in frame %d, in layer %d\n", */
 /*                   frame, sprite_layer2index(sprite, layer)); */
 
-      ase_file_write_cel_chunk(f, frame_header, cel, static_cast<LayerImage*>(layer), sprite);
+      ase_file_write_cel_chunk(f, frame_header, cel, static_cast<LayerImage*>(layer), sprite, encoder);
     }
   }
 
@@ -512,7 +667,7 @@ static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite*
     LayerIterator end = static_cast<LayerFolder*>(layer)->getLayerEnd();
 
     for (; it != end; ++it)
-      ase_file_write_cels(f, frame_header, sprite, *it, frame);
+      ase_file_write_cels(f, frame_header, sprite, *it, frame, encoder);
   }
 }
 
@@ -864,8 +1019,9 @@ static void write_raw_image(FILE* f, Image* image)
 // Compressed Image
 //////////////////////////////////////////////////////////////////////
 
+// Returns false if the zlib stream is truncated.
 template<typename ImageTraits>
-static void read_compressed_image(FILE* f, Image* image, size_t chunk_end, FileOp* fop, ASE_Header* header)
+static bool read_compressed_image(const std::vector<uint8_t>& compressed, Image* image)
 {
   PixelIO<ImageTraits> pixel_io;
   z_stream zstream;
@@ -880,67 +1036,70 @@ static void read_compressed_image(FILE* f, Image* image, size_t chunk_end, FileO
     throw base::Exception("ZLib error %d in inflateInit().", err);
 
   std::vector<uint8_t> scanline(ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> uncompressed(image->height() * ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> compressed(4096);
-  int uncompressed_offset = 0;
-
-  while (true) {
-    size_t input_bytes;
+  bool stream_end = false;
+  bool truncated = false;
 
-    if (ftell(f)+compressed.size() > chunk_end) {
-      input_bytes = chunk_end - ftell(f); // Remaining bytes
-      ASSERT(input_bytes < compressed.size());
+  zstream.next_in = (Bytef*)(compressed.empty() ? NULL: &compressed[0]);
+  zstream.avail_in = compressed.size();
 
-      if (input_bytes == 0)
-        break;                  // Done, we consumed all chunk
-    }
-    else
-      input_bytes = compressed.size();
+  // Each row is inflated directly in the scanline buffer and then
+  // unpacked in the image.
+  for (y=0; y<image->height(); y++) {
+    zstream.next_out = (Bytef*)&scanline[0];
+    zstream.avail_out = scanline.size();
 
-    size_t bytes_read = fread(&compressed[0], 1, input_bytes, f);
-    zstream.next_in = (Bytef*)&compressed[0];
-    zstream.avail_in = bytes_read;
-
-    do {
-      zstream.next_out = (Bytef*)&scanline[0];
-      zstream.avail_out = scanline.size();
+    while (zstream.avail_out > 0 && !stream_end) {
+      uInt avail_out = zstream.avail_out;
 
       err = inflate(&zstream, Z_NO_FLUSH);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+      if (err == Z_STREAM_END)
+        stream_end = true;
+      else if (err == Z_BUF_ERROR || (err == Z_OK && zstream.avail_out == avail_out)) {
+        // No more input (a truncated stream)
+        stream_end = true;
+        truncated = true;
+      }
+      else if (err != Z_OK) {
+        inflateEnd(&zstream);
         throw base::Exception("ZLib error %d in inflate().", err);
-
-      size_t uncompressed_bytes = scanline.size() - zstream.avail_out;
-      if (uncompressed_bytes > 0) {
-        if (uncompressed_offset+uncompressed_bytes > uncompressed.size())
-          throw base::Exception("Bad compressed image.");
-
-        std::copy(scanline.begin(), scanline.begin()+uncompressed_bytes,
-                  uncompressed.begin()+uncompressed_offset);
-
-        uncompressed_offset += uncompressed_bytes;
       }
-    } while (zstream.avail_out == 0);
+    }
 
-    fop_progress(fop, (float)ftell(f) / (float)header->size);
-  }
+    // Missing pixels of incomplete streams are zero
+    if (zstream.avail_out > 0)
+      std::fill(scanline.end()-zstream.avail_out, scanline.end(), 0);
 
-  uncompressed_offset = 0;
-  for (y=0; y<image->height(); y++) {
     typename ImageTraits::address_t address =
       (typename ImageTraits::address_t)image->getPixelAddress(0, y);
 
-    pixel_io.read_scanline(address, image->width(), &uncompressed[uncompressed_offset]);
+    pixel_io.read_scanline(address, image->width(), &scanline[0]);
+  }
 
-    uncompressed_offset += ImageTraits::getRowStrideBytes(image->width());
+  // Data after the last row
+  if (!stream_end && zstream.avail_in > 0) {
+    uint8_t extra;
+    zstream.next_out = (Bytef*)&extra;
+    zstream.avail_out = 1;
+    err = inflate(&zstream, Z_NO_FLUSH);
+    if (err == Z_OK && zstream.avail_out == 0) {
+      inflateEnd(&zstream);
+      throw base::Exception("Bad compressed image.");
+    }
+    if (err != Z_STREAM_END)
+      truncated = true;
   }
+  else if (!stream_end)
+    truncated = true;
 
   err = inflateEnd(&zstream);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in inflateEnd().", err);
+
+  return !truncated;
 }
 
 template<typename ImageTraits>
-static void write_compressed_image(FILE* f, Image* image)
+static void write_compressed_image(const Image* image, int level, std::vector<uint8_t>& output)
 {
   PixelIO<ImageTraits> pixel_io;
   z_stream zstream;
@@ -949,7 +1108,7 @@ static void write_compressed_image(FILE* f, Image* image)
   zstream.zalloc = (alloc_func)0;
   zstream.zfree  = (free_func)0;
   zstream.opaque = (voidpf)0;
-  err = deflateInit(&zstream, Z_DEFAULT_COMPRESSION);
+  err = deflateInit(&zstream, level);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateInit().", err);
 
@@ -976,11 +1135,8 @@ static void write_compressed_image(FILE* f, Image* image)
         throw base::Exception("ZLib error %d in deflate().", err);
 
       int output_bytes = compressed.size() - zstream.avail_out;
-      if (output_bytes > 0) {
-        if ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
-            || ferror(f))
-          throw base::Exception("Error writing compressed image pixels.\n");
-      }
+      if (output_bytes > 0)
+        output.insert(output.end(), compressed.begin(), compressed.begin()+output_bytes);
     } while (zstream.avail_out == 0);
   }
 
@@ -989,13 +1145,288 @@ static void write_compressed_image(FILE* f, Image* image)
     throw base::Exception("ZLib error %d in deflateEnd().", err);
 }
 
+//////////////////////////////////////////////////////////////////////
+// Cel Decoder
+//////////////////////////////////////////////////////////////////////
+
+// Maximum size of compressed data to keep in memory before decoding
+// it.
+static const size_t max_pending_cel_bytes = 64*1024*1024;
+
+class CelDecoder::DecodeJob {
+public:
+  DecodeJob(CelDecoder* decoder) : m_decoder(decoder) { }
+
+  void operator()(int i) const {
+    Job* job = m_decoder->m_jobs[i];
+
+    try {
+      switch (job->image->pixelFormat()) {
+
+        case IMAGE_RGB:
+          job->complete = read_compressed_image<RgbTraits>(job->compressed, job->image);
+          break;
+
+        case IMAGE_GRAYSCALE:
+          job->complete = read_compressed_image<GrayscaleTraits>(job->compressed, job->image);
+          break;
+
+        case IMAGE_INDEXED:
+          job->complete = read_compressed_image<IndexedTraits>(job->compressed, job->image);
+          break;
+      }
+    }
+    // OK, in case of error we can show the problem, but continue
+    // loading more cels.
+    catch (const std::exception& e) {
+      job->error = e.what();
+    }
+
+    size_t bytes = job->compressed.size();
+
+    long pos;
+    {
+      base::scoped_lock lock(m_decoder->m_mutex);
+      m_decoder->m_decodedBytes += bytes;
+      pos = m_decoder->m_readPos;
+    }
+    m_decoder->progress(pos);
+  }
+
+private:
+  CelDecoder* m_decoder;
+};
+
+CelDecoder::CelDecoder(FileOp* fop, ASE_Header* header)
+  : m_fop(fop)
+  , m_header(header)
+  , m_pendingBytes(0)
+  , m_readPos(0)
+  , m_decodedBytes(0)
+{
+}
+
+CelDecoder::~CelDecoder()
+{
+  for (size_t i=0; i<m_jobs.size(); ++i)
+    delete m_jobs[i];
+}
+
+void CelDecoder::addImage(int imageIndex, Image* image, std::vector<uint8_t>& compressed)
+{
+  Job* job = new Job;
+  job->imageIndex = imageIndex;
+  job->image = image;
+  job->compressed.swap(compressed);
+  job->complete = false;
+  m_pendingBytes += job->compressed.size();
+  m_jobs.push_back(job);
+}
+
+void CelDecoder::addLink(Sprite* sprite, Cel* cel, Cel* link)
+{
+  Link item;
+  item.sprite = sprite;
+  item.cel = cel;
+  item.link = link;
+  m_links.push_back(item);
+}
+
+bool CelDecoder::isFull() const
+{
+  return (m_pendingBytes >= max_pending_cel_bytes);
+}
+
+void CelDecoder::decode()
+{
+  base::thread_pool::shared().for_each_index((int)m_jobs.size(), DecodeJob(this));
+
+  for (size_t i=0; i<m_jobs.size(); ++i) {
+    Job* job = m_jobs[i];
+    if (!job->error.empty())
+      fop_error(m_fop, job->error.c_str());
+    // The level used to compress the file is unknown, so the data
+    // is reused only to save with the default level.
+    else if (job->complete)
+      m_cache.store(job->imageIndex, job->image, Z_DEFAULT_COMPRESSION, job->compressed);
+    delete job;
+  }
+  m_jobs.clear();
+  m_pendingBytes = 0;
+
+  // Links are resolved in file order (a link can point to other
+  // linked cel).
+  for (size_t i=0; i<m_links.size(); ++i) {
+    const Link& item = m_links[i];
+
+    // Create a copy of the linked cel (avoid using links cel)
+    Image* image = Image::createCopy(item.link->image());
+    item.cel->setImage(item.sprite->stock()->addImage(image));
+  }
+  m_links.clear();
+}
+
+void CelDecoder::progress(long pos)
+{
+  size_t decoded;
+  {
+    base::scoped_lock lock(m_mutex);
+    m_readPos = pos;
+    decoded = m_decodedBytes;
+  }
+
+  // Half of the progress is reading the file, the other half is
+  // decoding the cels.
+  fop_progress(m_fop, ((double)pos + (double)decoded) / (2.0 * m_header->size));
+}
+
+//////////////////////////////////////////////////////////////////////
+// Cel Encoder
+//////////////////////////////////////////////////////////////////////
+
+// Limits for each batch of frames compressed at the same time (at
+// least one frame is compressed).
+static const size_t max_encoded_cel_bytes = 64*1024*1024;
+static const int max_encoded_cels = 256;
+
+class CelEncoder::EncodeJob {
+public:
+  EncodeJob(const CelEncoder* encoder) : m_encoder(encoder) { }
+
+  void operator()(int i) const {
+    Job* job = m_encoder->m_jobs[i];
+    int level = m_encoder->m_compressionLevel;
+
+    if (job->cached)
+      return;
+
+    switch (job->image->pixelFormat()) {
+
+      case IMAGE_RGB:
+        write_compressed_image<RgbTraits>(job->image, level, job->compressed);
+        break;
+
+      case IMAGE_GRAYSCALE:
+        write_compressed_image<GrayscaleTraits>(job->image, level, job->compressed);
+        break;
+
+      case IMAGE_INDEXED:
+        write_compressed_image<IndexedTraits>(job->image, level, job->compressed);
+        break;
+    }
+  }
+
+private:
+  const CelEncoder* m_encoder;
+};
+
+CelEncoder::CelEncoder(Sprite* sprite, int compressionLevel, CompressedImageCache* cache)
+  : m_sprite(sprite)
+  , m_compressionLevel(compressionLevel)
+  , m_cache(cache)
+  , m_nextFrame(0)
+  , m_batchBytes(0)
+{
+}
+
+CelEncoder::~CelEncoder()
+{
+  clear();
+}
+
+void CelEncoder::encodeFrames(FrameNumber frame)
+{
+  if (frame < m_nextFrame)
+    return;
+
+  clear();
+
+  for (m_nextFrame=frame; m_nextFrame<m_sprite->totalFrames(); ++m_nextFrame) {
+    if (m_nextFrame > frame &&
+        (m_batchBytes >= max_encoded_cel_bytes ||
+         (int)m_jobs.size() >= max_encoded_cels))
+      break;
+
+    addImages(m_sprite->folder(), m_nextFrame);
+  }
+
+  // Exceptions (zlib errors) are re-thrown here
+  base::thread_pool::shared().for_each_index((int)m_jobs.size(), EncodeJob(this));
+
+  // Keep the new compressed images for the next save
+  if (m_cache) {
+    for (size_t i=0; i<m_jobs.size(); ++i) {
+      Job* job = m_jobs[i];
+      if (!job->cached) {
+        m_cache->store(job->imageIndex, job->image, m_compressionLevel, job->compressed);
+        job->cached = m_cache->find(job->imageIndex, job->image, m_compressionLevel);
+      }
+    }
+  }
+}
+
+const std::vector<uint8_t>& CelEncoder::compressedImage(const Image* image) const
+{
+  std::map<const Image*, Job*>::const_iterator it = m_images.find(image);
+  ASSERT(it != m_images.end());
+  const Job* job = it->second;
+  return (job->cached ? *job->cached: job->compressed);
+}
+
+void CelEncoder::removeUnusedFromCache()
+{
+  if (m_cache)
+    m_cache->keepOnly(m_usedImages);
+}
+
+void CelEncoder::clear()
+{
+  for (size_t i=0; i<m_jobs.size(); ++i)
+    delete m_jobs[i];
+
+  m_jobs.clear();
+  m_images.clear();
+  m_batchBytes = 0;
+}
+
+void CelEncoder::addImages(Layer* layer, FrameNumber frame)
+{
+  if (layer->isImage()) {
+    Cel* cel = static_cast<LayerImage*>(layer)->getCel(frame);
+    const Image* image = (cel ? cel->image(): NULL);
+
+    // Images shared by several cels are compressed once
+    if (image && m_images.find(image) == m_images.end()) {
+      Job* job = new Job;
+      job->imageIndex = cel->imageIndex();
+      job->image = image;
+      job->cached = (m_cache ? m_cache->find(job->imageIndex, image, m_compressionLevel): NULL);
+      m_jobs.push_back(job);
+      m_images[image] = job;
+      m_usedImages.insert(job->imageIndex);
+
+      if (!job->cached)
+        m_batchBytes += image->getMemSize();
+    }
+  }
+
+  if (layer->isFolder()) {
+    LayerIterator it = static_cast<LayerFolder*>(layer)->getLayerBegin();
+    LayerIterator end = static_cast<LayerFolder*>(layer)->getLayerEnd();
+
+    for (; it != end; ++it)
+      addImages(*it, frame);
+  }
+}
+
 //////////////////////////////////////////////////////////////////////
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
 
 static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, FrameNumber frame,
                                     PixelFormat pixelFormat,
-                                    FileOp* fop, ASE_Header* header, size_t chunk_end)
+                                    FileOp* fop, ASE_Header* header, size_t chunk_end,
+                                    CelDecoder* decoder)
 {
   /* read chunk data */
   LayerIndex layer_index = LayerIndex(fgetw(f));
@@ -1061,9 +1492,9 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, FrameNumber frame,
       Cel* link = static_cast<LayerImage*>(layer)->getCel(link_frame);
 
       if (link) {
-        // Create a copy of the linked cel (avoid using links cel)
-        Image* image = Image::createCopy(link->image());
-        cel->setImage(sprite->stock()->addImage(image));
+        // The linked cel could be pending to be decoded, so the image
+        // is copied later.
+        decoder->addLink(sprite, cel.get(), link);
       }
       else {
         // Linked cel doesn't found
@@ -1080,30 +1511,15 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, FrameNumber frame,
       if (w > 0 && h > 0) {
         Image* image = Image::create(pixelFormat, w, h);
 
-        // Try to read pixel data
-        try {
-          switch (image->pixelFormat()) {
-
-            case IMAGE_RGB:
-              read_compressed_image<RgbTraits>(f, image, chunk_end, fop, header);
-              break;
+        // Read the compressed pixel data, it's decoded later
+        long pos = ftell(f);
+        std::vector<uint8_t> compressed(pos < (long)chunk_end ? chunk_end - pos: 0);
+        if (!compressed.empty())
+          compressed.resize(fread(&compressed[0], 1, compressed.size(), f));
 
-            case IMAGE_GRAYSCALE:
-              read_compressed_image<GrayscaleTraits>(f, image, chunk_end, fop, header);
-              break;
-
-            case IMAGE_INDEXED:
-              read_compressed_image<IndexedTraits>(f, image, chunk_end, fop, header);
-              break;
-          }
-        }
-        // OK, in case of error we can show the problem, but continue
-        // loading more cels.
-        catch (const std::exception& e) {
-          fop_error(fop, e.what());
-        }
-
-        cel->setImage(sprite->stock()->addImage(image));
+        int imageIndex = sprite->stock()->addImage(image);
+        decoder->addImage(imageIndex, image, compressed);
+        cel->setImage(imageIndex);
       }
       break;
     }
@@ -1115,7 +1531,7 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, FrameNumber frame,
   return newCel;
 }
 
-static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite)
+static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite, CelEncoder* encoder)
 {
   ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_CEL);
 
@@ -1177,21 +1593,12 @@ static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel
         fputw(image->width(), f);
         fputw(image->height(), f);
 
-        // Pixel data
-        switch (image->pixelFormat()) {
-
-          case IMAGE_RGB:
-            write_compressed_image<RgbTraits>(f, image);
-            break;
-
-          case IMAGE_GRAYSCALE:
-            write_compressed_image<GrayscaleTraits>(f, image);
-            break;
-
-          case IMAGE_INDEXED:
-            write_compressed_image<IndexedTraits>(f, image);
-            break;
-        }
+        // Pixel data (already compressed)
+        const std::vector<uint8_t>& compressed = encoder->compressedImage(image);
+        if (!compressed.empty() &&
+            ((fwrite(&compressed[0], 1, compressed.size(), f) != compressed.size())
+             || ferror(f)))
+          throw base::Exception("Error writing compressed image pixels.\n");
       }
       else {
         // Width and height
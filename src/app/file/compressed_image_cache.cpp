@@ -0,0 +1,110 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/file/compressed_image_cache.h"
+
+#include "raster/image.h"
+
+#include <algorithm>
+
+namespace app {
+
+CompressedImageCache::CompressedImageCache(size_t maxSize)
+  : m_size(0)
+  , m_maxSize(maxSize)
+{
+}
+
+CompressedImageCache::~CompressedImageCache()
+{
+  clear();
+}
+
+const std::vector<uint8_t>* CompressedImageCache::find(int imageIndex, const Image* image, int level) const
+{
+  std::map<int, Entry*>::const_iterator it = m_entries.find(imageIndex);
+  if (it == m_entries.end())
+    return NULL;
+
+  const Entry* entry = it->second;
+  if (entry->level == level &&
+      entry->serial == image->serial() &&
+      entry->version == image->version())
+    return &entry->data;
+  else
+    return NULL;
+}
+
+void CompressedImageCache::store(int imageIndex, const Image* image, int level, std::vector<uint8_t>& data)
+{
+  std::map<int, Entry*>::iterator it = m_entries.find(imageIndex);
+  if (it != m_entries.end())
+    remove(it);
+
+  if (m_size + data.size() > m_maxSize) {
+    std::vector<uint8_t>().swap(data);
+    return;
+  }
+
+  Entry* entry = new Entry;
+  entry->serial = image->serial();
+  entry->version = image->version();
+  entry->level = level;
+  entry->data.swap(data);
+
+  m_entries[imageIndex] = entry;
+  m_size += entry->data.size();
+}
+
+void CompressedImageCache::keepOnly(const std::set<int>& imageIndexes)
+{
+  std::map<int, Entry*>::iterator it = m_entries.begin();
+  while (it != m_entries.end()) {
+    if (imageIndexes.find(it->first) == imageIndexes.end())
+      remove(it++);
+    else
+      ++it;
+  }
+}
+
+void CompressedImageCache::clear()
+{
+  for (std::map<int, Entry*>::iterator it=m_entries.begin(); it!=m_entries.end(); ++it)
+    delete it->second;
+  m_entries.clear();
+  m_size = 0;
+}
+
+void CompressedImageCache::swap(CompressedImageCache& other)
+{
+  m_entries.swap(other.m_entries);
+  std::swap(m_size, other.m_size);
+}
+
+void CompressedImageCache::remove(std::map<int, Entry*>::iterator it)
+{
+  m_size -= it->second->data.size();
+  delete it->second;
+  m_entries.erase(it);
+}
+
+} // namespace app
@@ -0,0 +1,95 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef APP_FILE_COMPRESSED_IMAGE_CACHE_H_INCLUDED
+#define APP_FILE_COMPRESSED_IMAGE_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace raster {
+  class Image;
+}
+
+namespace app {
+
+  using namespace raster;
+
+  // Compressed (zlib) pixels of the stock images of a document, as
+  // they were read or written in the last load/save of the file. It
+  // is used to save images that weren't modified without compressing
+  // them again.
+  //
+  // Each entry is identified by the Image::serial() and
+  // Image::version() of the image when it was stored, so any change
+  // in the image (or a different image in the same stock index)
+  // invalidates the entry. The cache doesn't keep any reference to
+  // the pixels of the image.
+  class CompressedImageCache {
+  public:
+    // Maximum number of compressed bytes in the cache, images that
+    // don't fit aren't stored.
+    static const size_t MaxSize = 128*1024*1024;
+
+    CompressedImageCache(size_t maxSize = MaxSize);
+    ~CompressedImageCache();
+
+    // Total number of compressed bytes in the cache.
+    size_t size() const { return m_size; }
+
+    // Returns the compressed pixels of the given stock image, or NULL
+    // if "image" was modified (or it's other image) since its
+    // pixels were stored with the given zlib compression level.
+    const std::vector<uint8_t>* find(int imageIndex, const Image* image, int level) const;
+
+    // Stores the compressed pixels of "image" (the "data" vector is
+    // swapped, so it's empty after the call). If there is no space in
+    // the cache, the data isn't stored.
+    void store(int imageIndex, const Image* image, int level, std::vector<uint8_t>& data);
+
+    // Removes the entries of all stock images not included in the
+    // given set (e.g. removed images).
+    void keepOnly(const std::set<int>& imageIndexes);
+
+    void clear();
+    void swap(CompressedImageCache& other);
+
+  private:
+    struct Entry {
+      uint32_t serial;          // Image::serial()
+      uint32_t version;         // Image::version()
+      int level;
+      std::vector<uint8_t> data;
+    };
+
+    void remove(std::map<int, Entry*>::iterator it);
+
+    std::map<int, Entry*> m_entries;
+    size_t m_size;
+    size_t m_maxSize;
+
+    DISABLE_COPYING(CompressedImageCache);
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,110 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "tests/test.h"
+
+#include "app/file/compressed_image_cache.h"
+#include "base/unique_ptr.h"
+#include "raster/image.h"
+#include "raster/primitives.h"
+
+using namespace app;
+using namespace raster;
+
+TEST(CompressedImageCache, ModifiedImages)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP };
+
+  for (int i=0; i<int(sizeof(formats)/sizeof(formats[0])); ++i) {
+    base::UniquePtr<Image> image(Image::create(formats[i], 32, 300));
+    clear_image(image, 0);
+
+    CompressedImageCache cache;
+    std::vector<uint8_t> data(10, 1);
+    cache.store(3, image, 6, data);
+    EXPECT_TRUE(data.empty());
+
+    ASSERT_TRUE(cache.find(3, image, 6) != NULL);
+    EXPECT_EQ(10u, cache.find(3, image, 6)->size());
+    EXPECT_TRUE(cache.find(3, image, 9) == NULL);
+    EXPECT_TRUE(cache.find(2, image, 6) == NULL);
+
+    // Other image (even with the same pixels) isn't in the cache
+    base::UniquePtr<Image> copy(Image::createCopy(image));
+    EXPECT_TRUE(cache.find(3, copy, 6) == NULL);
+
+    // Reading pixels doesn't modify the image
+    get_pixel(image, 3, 200);
+    EXPECT_TRUE(cache.find(3, image, 6) != NULL);
+
+    put_pixel(image, 3, 200, 1);
+    EXPECT_TRUE(cache.find(3, image, 6) == NULL);
+
+    data.assign(10, 1);
+    cache.store(3, image, 6, data);
+    EXPECT_TRUE(cache.find(3, image, 6) != NULL);
+    clear_image(image, 1);
+    EXPECT_TRUE(cache.find(3, image, 6) == NULL);
+  }
+}
+
+TEST(CompressedImageCache, MaxSize)
+{
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 8, 8));
+  CompressedImageCache cache(100);
+
+  std::vector<uint8_t> data(60, 1);
+  cache.store(0, image, 6, data);
+  EXPECT_EQ(60u, cache.size());
+
+  // It doesn't fit
+  data.assign(50, 1);
+  cache.store(1, image, 6, data);
+  EXPECT_TRUE(data.empty());
+  EXPECT_TRUE(cache.find(1, image, 6) == NULL);
+  EXPECT_EQ(60u, cache.size());
+
+  // Replace the entry of the image 0
+  data.assign(90, 1);
+  cache.store(0, image, 6, data);
+  EXPECT_TRUE(cache.find(0, image, 6) != NULL);
+  EXPECT_EQ(90u, cache.size());
+
+  cache.clear();
+  EXPECT_EQ(0u, cache.size());
+}
+
+TEST(CompressedImageCache, KeepOnly)
+{
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 8, 8));
+  CompressedImageCache cache;
+
+  for (int i=0; i<4; ++i) {
+    std::vector<uint8_t> data(1, i);
+    cache.store(i, image, 6, data);
+  }
+
+  std::set<int> used;
+  used.insert(1);
+  used.insert(3);
+  cache.keepOnly(used);
+
+  EXPECT_TRUE(cache.find(0, image, 6) == NULL);
+  EXPECT_TRUE(cache.find(1, image, 6) != NULL);
+  EXPECT_TRUE(cache.find(2, image, 6) == NULL);
+  EXPECT_TRUE(cache.find(3, image, 6) != NULL);
+}
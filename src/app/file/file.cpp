@@ -38,12 +38,14 @@
 #include "base/scoped_lock.h"
 #include "base/shared_ptr.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "raster/quantization.h"
 #include "raster/raster.h"
 #include "ui/alert.h"
 
 #include <allegro.h>
 #include <cstring>
+#include <vector>
 
 namespace app {
 
@@ -51,6 +53,9 @@ using namespace base;
 
 static FileOp* fop_new(FileOpType type, Context* context);
 static void fop_prepare_for_sequence(FileOp* fop);
+static void fop_prepare_for_sequence_frame(FileOp* frame_fop);
+static bool fop_add_sequence_frame(FileOp* fop, FileOp* frame_fop, FrameNumber frame);
+static void fop_free_sequence_frame(FileOp* frame_fop);
 static int split_filename(const char* filename, char* left, char* right, int* width);
 
 void get_readable_extensions(char* buf, int size)
@@ -432,6 +437,26 @@ FileOp* fop_to_save_document(Context* context, Document* document, const char* f
   return fop;
 }
 
+namespace {
+
+  // Loads the files of a sequence in parallel, each one with its own
+  // FileOp (see fop_prepare_for_sequence_frame()).
+  class LoadSequenceFrame {
+  public:
+    LoadSequenceFrame(const std::vector<FileOp*>& frame_fops)
+      : m_frame_fops(frame_fops) { }
+
+    void operator()(int i) const {
+      FileOp* frame_fop = m_frame_fops[i];
+      frame_fop->seq.loaded = frame_fop->format->load(frame_fop);
+    }
+
+  private:
+    const std::vector<FileOp*>& m_frame_fops;
+  };
+
+} // anonymous namespace
+
 // Executes the file operation: loads or saves the sprite.
 //
 // It can be called from a different thread of the one used
@@ -452,105 +477,61 @@ void fop_operate(FileOp *fop, IFileOpProgress* progress)
       fop->format->support(FILE_SUPPORT_LOAD)) {
     // Load a sequence
     if (fop->is_sequence()) {
-      int image_index = 0;
-      Image* old_image;
-      bool loadres;
-
       // Default palette
       fop->seq.palette->makeBlack();
 
-      // TODO set_palette for each frame???
-#define SEQUENCE_IMAGE()                                                \
-      do {                                                              \
-        image_index = fop->document                                     \
-          ->sprite()                                                    \
-          ->stock()->addImage(fop->seq.image);                       \
-                                                                        \
-        fop->seq.last_cel->setImage(image_index);                       \
-        fop->seq.layer->addCel(fop->seq.last_cel);                      \
-                                                                        \
-        if (fop->document->sprite()->getPalette(frame)                  \
-              ->countDiff(fop->seq.palette, NULL, NULL) > 0) {          \
-          fop->seq.palette->setFrame(frame);                            \
-          fop->document->sprite()->setPalette(fop->seq.palette, true);  \
-        }                                                               \
-                                                                        \
-        old_image = fop->seq.image;                                     \
-        fop->seq.image = NULL;                                          \
-        fop->seq.last_cel = NULL;                                       \
-      } while (0)
-
-      /* load the sequence */
       FrameNumber frames(fop->seq.filename_list.size());
       FrameNumber frame(0);
-      old_image = NULL;
 
       fop->seq.has_alpha = false;
       fop->seq.progress_offset = 0.0f;
       fop->seq.progress_fraction = 1.0f / (double)frames;
 
-      std::vector<std::string>::iterator it = fop->seq.filename_list.begin();
-      std::vector<std::string>::iterator end = fop->seq.filename_list.end();
-      for (; it != end; ++it) {
-        fop->filename = it->c_str();
-
-        // Call the "load" procedure to read the first bitmap.
-        loadres = fop->format->load(fop);
-        if (!loadres) {
-          fop_error(fop, "Error loading frame %d from file \"%s\"\n",
-                    frame+1, fop->filename.c_str());
+      // Files are loaded in batches (each file in its own FileOp by
+      // several threads), and then added to the sprite in order.
+      int batch_size = 4*base::thread_pool::shared().size();
+      std::vector<FileOp*> frame_fops;
+      bool done = false;
+
+      while (!done && frame < frames) {
+        FrameNumber first = frame;
+
+        for (int i=0; i<batch_size && first+i < frames; ++i) {
+          FileOp* frame_fop = fop_new(FileOpLoad, fop->context);
+          frame_fop->format = fop->format;
+          frame_fop->filename = fop->seq.filename_list[first+i];
+          fop_prepare_for_sequence_frame(frame_fop);
+          frame_fops.push_back(frame_fop);
         }
 
-        // For the first frame...
-        if (!old_image) {
-          // Error reading the first frame
-          if (!loadres || !fop->document || !fop->seq.last_cel) {
-            delete fop->seq.image;
-            delete fop->seq.last_cel;
-            delete fop->document;
-            fop->document = NULL;
-            break;
-          }
-          // Read ok
-          else {
-            // Add the keyframe
-            SEQUENCE_IMAGE();
-          }
+        try {
+          base::thread_pool::shared().for_each_index(
+            (int)frame_fops.size(), LoadSequenceFrame(frame_fops));
+        }
+        catch (...) {
+          for (size_t i=0; i<frame_fops.size(); ++i)
+            fop_free_sequence_frame(frame_fops[i]);
+          throw;
         }
-        // For other frames
-        else {
-          // All done (or maybe not enough memory)
-          if (!loadres || !fop->seq.last_cel) {
-            delete fop->seq.image;
-            delete fop->seq.last_cel;
-            break;
-          }
-
-          // Compare the old frame with the new one
-#if USE_LINK // TODO this should be configurable through a check-box
-          if (count_diff_between_images(old_image, fop->seq.image)) {
-            SEQUENCE_IMAGE();
-          }
-          // We don't need this image
-          else {
-            delete fop->seq.image;
-
-            // But add a link frame
-            fop->seq.last_cel->image = image_index;
-            layer_add_frame(fop->seq.layer, fop->seq.last_cel);
 
-            fop->seq.last_image = NULL;
-            fop->seq.last_cel = NULL;
+        for (size_t i=0; i<frame_fops.size(); ++i) {
+          if (!done) {
+            if (fop_add_sequence_frame(fop, frame_fops[i], frame)) {
+              fop_progress(fop, 1.0);
+              ++frame;
+              fop->seq.progress_offset += fop->seq.progress_fraction;
+            }
+            // All done (or maybe not enough memory)
+            else
+              done = true;
           }
-#else
-          SEQUENCE_IMAGE();
-#endif
+          fop_free_sequence_frame(frame_fops[i]);
         }
+        frame_fops.clear();
 
-        ++frame;
-        fop->seq.progress_offset += fop->seq.progress_fraction;
+        if (fop_is_stop(fop))
+          break;
       }
-      fop->filename = *fop->seq.filename_list.begin();
 
       // Final setup
       if (fop->document != NULL) {
@@ -867,6 +848,7 @@ static FileOp* fop_new(FileOpType type, Context* context)
   fop->seq.frame = FrameNumber(0);
   fop->seq.layer = NULL;
   fop->seq.last_cel = NULL;
+  fop->seq.loaded = false;
 
   return fop;
 }
@@ -877,6 +859,108 @@ static void fop_prepare_for_sequence(FileOp* fop)
   fop->seq.format_options.reset();
 }
 
+// Prepares a FileOp to load one file of a sequence. The format
+// creates its own document/sprite and sets the palette of the file
+// in "seq.palette" (entries not defined by the file keep a zero
+// alpha, as fop_sequence_set_color() always uses 255).
+static void fop_prepare_for_sequence_frame(FileOp* frame_fop)
+{
+  frame_fop->seq.palette = new Palette(FrameNumber(0), 256);
+  for (int i=0; i<frame_fop->seq.palette->size(); ++i)
+    frame_fop->seq.palette->setEntry(i, rgba(0, 0, 0, 0));
+
+  frame_fop->seq.has_alpha = false;
+  frame_fop->seq.loaded = false;
+}
+
+// Adds the image loaded in "frame_fop" to the sequence sprite (the
+// document of the first frame is used as the sequence document).
+// Returns false if the file couldn't be loaded.
+static bool fop_add_sequence_frame(FileOp* fop, FileOp* frame_fop, FrameNumber frame)
+{
+  if (frame_fop->has_error()) {
+    scoped_lock lock(*fop->mutex);
+    fop->error += frame_fop->error;
+  }
+
+  bool loadres = frame_fop->seq.loaded;
+  if (loadres && fop->document && frame_fop->document &&
+      frame_fop->document->sprite()->pixelFormat() != fop->document->sprite()->pixelFormat()) {
+    fop_error(fop, "Error: all files must have the same color mode.\n");
+    loadres = false;
+  }
+
+  if (!loadres) {
+    fop_error(fop, "Error loading frame %d from file \"%s\"\n",
+              frame+1, frame_fop->filename.c_str());
+    return false;
+  }
+
+  if (!frame_fop->document || !frame_fop->seq.last_cel)
+    return false;
+
+  Sprite* sprite;
+
+  // For the first frame...
+  if (!fop->document) {
+    fop->document = frame_fop->document;
+    fop->seq.layer = frame_fop->seq.layer;
+    frame_fop->document = NULL;
+
+    sprite = fop->document->sprite();
+  }
+  // For other frames
+  else {
+    sprite = fop->document->sprite();
+
+    // Formats set the transparent color only if the file has one
+    int mask_entry = frame_fop->document->sprite()->transparentColor();
+    if (mask_entry != 0)
+      sprite->setTransparentColor(mask_entry);
+  }
+
+  // Palette entries defined by this file (other entries are kept from
+  // previous files)
+  Palette* frame_palette = frame_fop->seq.palette;
+  for (int i=0; i<frame_palette->size(); ++i) {
+    color_t color = frame_palette->getEntry(i);
+    if (rgba_geta(color) != 0)
+      fop->seq.palette->setEntry(i, color);
+  }
+
+  if (frame_fop->seq.has_alpha)
+    fop->seq.has_alpha = true;
+
+  if (fop->seq.format_options == NULL)
+    fop->seq.format_options = frame_fop->seq.format_options;
+
+  // Add the keyframe
+  Cel* cel = frame_fop->seq.last_cel;
+  int image_index = sprite->stock()->addImage(frame_fop->seq.image);
+  frame_fop->seq.image = NULL;
+  frame_fop->seq.last_cel = NULL;
+
+  cel->setFrame(frame);
+  cel->setImage(image_index);
+  fop->seq.layer->addCel(cel);
+
+  // TODO set_palette for each frame???
+  if (sprite->getPalette(frame)->countDiff(fop->seq.palette, NULL, NULL) > 0) {
+    fop->seq.palette->setFrame(frame);
+    sprite->setPalette(fop->seq.palette, true);
+  }
+
+  return true;
+}
+
+static void fop_free_sequence_frame(FileOp* frame_fop)
+{
+  delete frame_fop->seq.image;
+  delete frame_fop->seq.last_cel;
+  delete frame_fop->document;
+  delete frame_fop;
+}
+
 // Splits a file-name like "my_ani0000.pcx" to "my_ani" and ".pcx",
 // returning the number of the center; returns "-1" if the function
 // can't split anything
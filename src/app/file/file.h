@@ -105,6 +105,7 @@ namespace app {
       LayerImage* layer;
       Cel* last_cel;
       SharedPtr<FormatOptions> format_options;
+      bool loaded;                // Result of loading one file of the sequence.
     } seq;
 
     ~FileOp();
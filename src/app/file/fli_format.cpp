@@ -31,12 +31,16 @@
 
 #include <allegro/color.h>
 #include <stdio.h>
+#include <string.h>
+#include <vector>
 
 namespace app {
 
 using namespace base;
 
 static int get_time_precision(Sprite *sprite);
+static void copy_framebuf_to_image(const uint8_t* framebuf, Image* image);
+static void copy_image_to_framebuf(const Image* image, uint8_t* framebuf);
 
 class FliFormat : public FileFormat {
   const char* onGetName() const { return "flc"; }
@@ -97,9 +101,9 @@ bool FliFormat::onLoad(FileOp* fop)
   w = fli_header.width;
   h = fli_header.height;
 
-  // Create the bitmaps
-  base::UniquePtr<Image> bmp(Image::create(IMAGE_INDEXED, w, h));
-  base::UniquePtr<Image> old(Image::create(IMAGE_INDEXED, w, h));
+  // Frame buffers of w*h pixels for fli_read_frame()
+  std::vector<uint8_t> framebuf(w*h);
+  std::vector<uint8_t> old_framebuf(w*h);
   base::UniquePtr<Palette> pal(new Palette(FrameNumber(0), 256));
 
   // Create the image
@@ -118,12 +122,12 @@ bool FliFormat::onLoad(FileOp* fop)
        ++frpos_in) {
     /* read the frame */
     fli_read_frame(f, &fli_header,
-                   (unsigned char *)old->getPixelAddress(0, 0), omap,
-                   (unsigned char *)bmp->getPixelAddress(0, 0), cmap);
+                   &old_framebuf[0], omap,
+                   &framebuf[0], cmap);
 
     /* first frame, or the frames changes, or the palette changes */
     if ((frpos_in == 0) ||
-        (count_diff_between_images(old, bmp))
+        (memcmp(&old_framebuf[0], &framebuf[0], w*h) != 0)
 #ifndef USE_LINK /* TODO this should be configurable through a check-box */
         || (memcmp(omap, cmap, 768) != 0)
 #endif
@@ -133,7 +137,8 @@ bool FliFormat::onLoad(FileOp* fop)
         ++frpos_out;
 
       // Add the new frame
-      Image* image = Image::createCopy(bmp);
+      Image* image = Image::create(IMAGE_INDEXED, w, h);
+      copy_framebuf_to_image(&framebuf[0], image);
       index = sprite->stock()->addImage(image);
 
       Cel* cel = new Cel(frpos_out, index);
@@ -161,7 +166,7 @@ bool FliFormat::onLoad(FileOp* fop)
     }
 
     /* update the old image and color-map to the new ones to compare later */
-    copy_image(old, bmp, 0, 0);
+    old_framebuf = framebuf;
     memcpy(omap, cmap, 768);
 
     /* update progress */
@@ -216,9 +221,10 @@ bool FliFormat::onSave(FileOp* fop)
 
   fseek(f, 128, SEEK_SET);
 
-  // Create the bitmaps
+  // Create the bitmap, and the frame buffers for fli_write_frame()
   base::UniquePtr<Image> bmp(Image::create(IMAGE_INDEXED, sprite->width(), sprite->height()));
-  base::UniquePtr<Image> old(Image::create(IMAGE_INDEXED, sprite->width(), sprite->height()));
+  std::vector<uint8_t> framebuf(sprite->width()*sprite->height());
+  std::vector<uint8_t> old_framebuf(framebuf.size());
 
   // Write frame by frame
   for (FrameNumber frpos(0);
@@ -235,6 +241,7 @@ bool FliFormat::onSave(FileOp* fop)
     /* render the frame in the bitmap */
     clear_image(bmp, 0);
     layer_render(sprite->folder(), bmp, 0, 0, frpos);
+    copy_image_to_framebuf(bmp, &framebuf[0]);
 
     /* how many times this frame should be written to get the same
        time that it has in the sprite */
@@ -244,14 +251,14 @@ bool FliFormat::onSave(FileOp* fop)
       /* write this frame */
       if (frpos == 0 && c == 0)
         fli_write_frame(f, &fli_header, NULL, NULL,
-                        (unsigned char *)bmp->getPixelAddress(0, 0), cmap, W_ALL);
+                        &framebuf[0], cmap, W_ALL);
       else
         fli_write_frame(f, &fli_header,
-                        (unsigned char *)old->getPixelAddress(0, 0), omap,
-                        (unsigned char *)bmp->getPixelAddress(0, 0), cmap, W_ALL);
+                        &old_framebuf[0], omap,
+                        &framebuf[0], cmap, W_ALL);
 
       /* update the old image and color-map to the new ones to compare later */
-      copy_image(old, bmp, 0, 0);
+      old_framebuf = framebuf;
       memcpy(omap, cmap, 768);
     }
 
@@ -280,4 +287,18 @@ static int get_time_precision(Sprite *sprite)
   return precision;
 }
 
+// FLI functions use frame buffers of width*height contiguous pixels,
+// but rows of big images aren't contiguous (see SparseImageImpl).
+static void copy_framebuf_to_image(const uint8_t* framebuf, Image* image)
+{
+  for (int y=0; y<image->height(); ++y, framebuf+=image->width())
+    memcpy(image->getPixelAddress(0, y), framebuf, image->width());
+}
+
+static void copy_image_to_framebuf(const Image* image, uint8_t* framebuf)
+{
+  for (int y=0; y<image->height(); ++y, framebuf+=image->width())
+    memcpy(framebuf, image->getPixelAddress(0, y), image->width());
+}
+
 } // namespace app
@@ -30,7 +30,9 @@
 #include "app/ini_file.h"
 #include "app/modules/gui.h"
 #include "app/util/autocrop.h"
+#include "base/disable_copying.h"
 #include "base/file_handle.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "raster/raster.h"
 #include "ui/alert.h"
@@ -39,6 +41,7 @@
 #include "generated_gif_options.h"
 
 #include <gif_lib.h>
+#include <cstring>
 
 namespace app {
 
@@ -76,6 +79,12 @@ struct GifData
   int sprite_h;
   int bgcolor_index;
   GifFrames frames;
+
+  // Transparent color used by all frames (or -1 if there is no
+  // transparent pixel), and true if some frame draws with the color
+  // used as transparent color by other frame.
+  int global_mask_index;
+  bool ask_for_conversion;
 };
 
 class GifFormat : public FileFormat {
@@ -139,6 +148,36 @@ private:
   CloseFunc m_closeFunc;
 };
 
+// Updates the transparent color used by all frames with the pixels
+// of a new frame. Returns false if the frame draws with the global
+// transparent color (so the GIF cannot be loaded as an indexed sprite
+// with one transparent color).
+static bool update_global_mask_index(const Image* frame_image, int mask_index, int& global_mask_index)
+{
+  // If we haven't set a global transparent color yet, the first
+  // frame that uses its transparent color sets it. Otherwise, the
+  // frame cannot draw with the global transparent color (unless it's
+  // its own transparent color too).
+  int search_index = (global_mask_index < 0 ? mask_index: global_mask_index);
+  if (search_index < 0 || mask_index == global_mask_index)
+    return true;
+
+  for (int y=0; y<frame_image->height(); ++y) {
+    const uint8_t* address = frame_image->getPixelAddress(0, y);
+
+    if (std::memchr(address, search_index, frame_image->width())) {
+      if (global_mask_index < 0) {
+        global_mask_index = mask_index;
+        return true;
+      }
+      else
+        return false;
+    }
+  }
+
+  return true;
+}
+
 bool GifFormat::onLoad(FileOp* fop)
 {
   int errCode;
@@ -154,6 +193,8 @@ bool GifFormat::onLoad(FileOp* fop)
 
   data->sprite_w = gif_file->SWidth;
   data->sprite_h = gif_file->SHeight;
+  data->global_mask_index = -1;
+  data->ask_for_conversion = false;
 
   UniquePtr<Palette> current_palette(new Palette(FrameNumber(0), 256));
   UniquePtr<Palette> previous_palette(new Palette(FrameNumber(0), 256));
@@ -257,6 +298,13 @@ bool GifFormat::onLoad(FileOp* fop)
           }
         }
 
+        // Check the transparent color now that the frame pixels are
+        // in cache (instead of scanning all frames in onPostLoad()).
+        if (!fop->oneframe && !data->ask_for_conversion)
+          data->ask_for_conversion =
+            !update_global_mask_index(frame_image, transparent_index,
+                                      data->global_mask_index);
+
         // Detach the pointer of the frame-image and put it in the list of frames.
         data->frames[frame_num].image = frame_image.release();
         data->frames[frame_num].disposal_method = disposal_method;
@@ -325,42 +373,12 @@ bool GifFormat::onPostLoad(FileOp* fop)
   PixelFormat pixelFormat = IMAGE_INDEXED;
   bool askForConversion = false;
 
+  // The transparent color was checked in onLoad()
   if (!fop->oneframe) {
-    int global_mask_index = -1;
-
-    for (GifFrames::iterator
-           frame_it=data->frames.begin(),
-           frame_end=data->frames.end(); frame_it != frame_end; ++frame_it) {
-
-      // Convert the indexed image to RGB
-      for (int y=0; y<frame_it->image->height(); ++y) {
-        for (int x=0; x<frame_it->image->width(); ++x) {
-          int pixel_index = get_pixel_fast<IndexedTraits>(frame_it->image, x, y);
-
-          if (pixel_index >= 0 && pixel_index < 256) {
-            // This pixel matches the frame's transparent color
-            if (pixel_index == frame_it->mask_index) {
-              // If we haven't set a background color yet, this is our new background color.
-              if (global_mask_index < 0) {
-                global_mask_index = pixel_index;
-              }
-            }
-            else {
-              // Drawing the mask color
-              if (global_mask_index == pixel_index) {
-                askForConversion = true;
-                goto done;
-              }
-            }
-          }
-        }
-      }
-    }
-
-    // New background color
-    data->bgcolor_index = global_mask_index;
-
-  done:;
+    if (data->ask_for_conversion)
+      askForConversion = true;
+    else
+      data->bgcolor_index = data->global_mask_index; // New background color
   }
 
   if (askForConversion) {
@@ -421,7 +439,10 @@ bool GifFormat::onPostLoad(FileOp* fop)
     // Set frame palette
     if (frame_it->palette) {
       sprite->setPalette(frame_it->palette, true);
-      current_palette = frame_it->palette;
+      current_palette = sprite->getPalette(frame_num);
+
+      delete frame_it->palette;
+      frame_it->palette = NULL;
     }
 
     switch (pixelFormat) {
@@ -474,6 +495,12 @@ bool GifFormat::onPostLoad(FileOp* fop)
       throw;
     }
 
+    // The pixels of the frame aren't needed anymore
+    int frame_w = frame_it->image->width();
+    int frame_h = frame_it->image->height();
+    delete frame_it->image;
+    frame_it->image = NULL;
+
     // The current_image was already copied to represent the
     // current frame (frame_num), so now we have to clear the
     // area occupied by frame_image using the desired disposal
@@ -489,8 +516,8 @@ bool GifFormat::onPostLoad(FileOp* fop)
         fill_rect(current_image,
                   frame_it->x,
                   frame_it->y,
-                  frame_it->x+frame_it->image->width()-1,
-                  frame_it->y+frame_it->image->height()-1,
+                  frame_it->x+frame_w-1,
+                  frame_it->y+frame_h-1,
                   bgcolor);
         break;
 
@@ -530,6 +557,291 @@ void GifFormat::onDestroyData(FileOp* fop)
 }
 
 #ifdef ENABLE_SAVE
+
+// Frames are rendered (and converted to indexed) in batches by several
+// threads while the previous batch is encoded.
+static const int max_batch_frames = 32;
+static const size_t max_batch_bytes = 64*1024*1024;
+
+// Maximum memory to keep the frames rendered to calculate the palette
+// in GifOptions::QuantizeAll mode (so they aren't rendered again).
+static const size_t max_kept_frames_bytes = 256*1024*1024;
+
+namespace {
+
+  // Images of a batch of frames.
+  class FrameImages {
+  public:
+    FrameImages(int n = 0) : m_images(n, (Image*)NULL) { }
+    ~FrameImages() { reset(0); }
+
+    int size() const { return (int)m_images.size(); }
+    Image*& operator[](int i) { return m_images[i]; }
+    std::vector<Image*>& images() { return m_images; }
+
+    void reset(int n) {
+      for (size_t i=0; i<m_images.size(); ++i)
+        delete m_images[i];
+      m_images.assign(n, (Image*)NULL);
+    }
+
+  private:
+    std::vector<Image*> m_images;
+
+    DISABLE_COPYING(FrameImages);
+  };
+
+  // Writes frames in the GIF file (in order). Each frame is written
+  // as the rectangle that changed from the previous one.
+  class GifEncoder {
+  public:
+    GifEncoder(GifFileType* gif_file, Sprite* sprite, bool interlaced, int loop,
+               int background_color, int transparent_index,
+               bool global_color_map, const Palette& palette)
+      : m_gif_file(gif_file)
+      , m_sprite(sprite)
+      , m_interlaced(interlaced)
+      , m_loop(loop)
+      , m_transparent_index(transparent_index)
+      , m_global_color_map(global_color_map)
+      , m_previous_palette(palette)
+      , m_image_color_map(NULL)
+      , m_previous_image(Image::create(IMAGE_INDEXED, sprite->width(), sprite->height()))
+      , m_background_color(background_color) {
+      clear_image(m_previous_image, background_color);
+    }
+
+    ~GifEncoder() {
+      if (m_image_color_map)
+        GifFreeMapObject(m_image_color_map);
+    }
+
+    // Writes the given indexed image (the encoder takes its
+    // ownership) using the given palette.
+    void encodeFrame(FrameNumber frame_num, Image* image, const Palette& current_palette);
+
+  private:
+    GifFileType* m_gif_file;
+    Sprite* m_sprite;
+    bool m_interlaced;
+    int m_loop;
+    int m_transparent_index;
+    bool m_global_color_map;
+    Palette m_previous_palette;
+    ColorMapObject* m_image_color_map;
+    UniquePtr<Image> m_previous_image;
+    int m_background_color;
+    int m_frame_x, m_frame_y, m_frame_w, m_frame_h;
+  };
+
+  // Renders frames of the sprite in the given images (and quantizes
+  // them with their own palette in GifOptions::QuantizeEach mode).
+  // The index "n" encodes the previous batch of frames at the same
+  // time.
+  class RenderFrames {
+  public:
+    RenderFrames(const Sprite* sprite, int background_color,
+                 const std::vector<FrameNumber>& frames,
+                 const std::vector<Image*>& images)
+      : m_sprite(sprite)
+      , m_background_color(background_color)
+      , m_frames(frames)
+      , m_images(images)
+      , m_quantize(NULL)
+      , m_encode(NULL) {
+    }
+
+    void setQuantizeEach(const std::vector<Image*>& indexed,
+                         std::vector<Palette>& palettes,
+                         DitheringMethod dithering,
+                         int transparent_index,
+                         bool has_background) {
+      m_quantize = &indexed;
+      m_palettes = &palettes;
+      m_dithering = dithering;
+      m_transparent_index = transparent_index;
+      m_has_background = has_background;
+    }
+
+    void setEncode(GifEncoder* encoder, int first,
+                   FrameImages& indexed, const std::vector<Palette>& palettes) {
+      m_encode = encoder;
+      m_encode_first = first;
+      m_encode_images = &indexed;
+      m_encode_palettes = &palettes;
+    }
+
+    void operator()(int i) const {
+      if (i == (int)m_frames.size()) {
+        FrameImages& indexed = *m_encode_images;
+        for (int j=0; j<indexed.size(); ++j) {
+          Image* image = indexed[j];
+          indexed[j] = NULL;
+          m_encode->encodeFrame(FrameNumber(m_encode_first+j), image, (*m_encode_palettes)[j]);
+        }
+        return;
+      }
+
+      Image* image = m_images[i];
+      if (m_frames[i] >= FrameNumber(0)) {
+        clear_image(image, m_background_color);
+        layer_render(m_sprite->folder(), image, 0, 0, m_frames[i]);
+      }
+
+      if (m_quantize) {
+        Palette* palette = &(*m_palettes)[i];
+        palette->makeBlack();
+
+        std::vector<Image*> imgarray(1, image);
+        quantization::create_palette_from_images(imgarray, palette, m_has_background);
+
+        RgbMap rgbmap;
+        rgbmap.regenerate(palette, m_transparent_index);
+
+        quantization::convert_pixel_format(
+          image, (*m_quantize)[i], IMAGE_INDEXED,
+          m_dithering, &rgbmap, palette, m_has_background);
+      }
+    }
+
+    // Number of indexes for thread_pool::for_each_index().
+    int size() const {
+      return (int)m_frames.size() + (m_encode ? 1: 0);
+    }
+
+  private:
+    const Sprite* m_sprite;
+    int m_background_color;
+    const std::vector<FrameNumber>& m_frames;
+    const std::vector<Image*>& m_images;
+    const std::vector<Image*>* m_quantize;
+    std::vector<Palette>* m_palettes;
+    DitheringMethod m_dithering;
+    int m_transparent_index;
+    bool m_has_background;
+    GifEncoder* m_encode;
+    int m_encode_first;
+    FrameImages* m_encode_images;
+    const std::vector<Palette>* m_encode_palettes;
+  };
+
+} // anonymous namespace
+
+void GifEncoder::encodeFrame(FrameNumber frame_num, Image* image, const Palette& current_palette)
+{
+  UniquePtr<Image> current_image(image);
+  int u1, v1, u2, v2;
+  int i1, j1, i2, j2;
+
+  if (frame_num == 0) {
+    m_frame_x = 0;
+    m_frame_y = 0;
+    m_frame_w = m_sprite->width();
+    m_frame_h = m_sprite->height();
+  }
+  else {
+    // Get the rectangle where start differences with the previous frame.
+    if (get_shrink_rect2(&u1, &v1, &u2, &v2, current_image, m_previous_image)) {
+      // Check the minimal area with the background color.
+      if (get_shrink_rect(&i1, &j1, &i2, &j2, current_image, m_background_color)) {
+        m_frame_x = MIN(u1, i1);
+        m_frame_y = MIN(v1, j1);
+        m_frame_w = MAX(u2, i2) - MIN(u1, i1) + 1;
+        m_frame_h = MAX(v2, j2) - MIN(v1, j1) + 1;
+      }
+    }
+  }
+
+  // Specify loop extension.
+  if (frame_num == 0 && m_loop >= 0) {
+    if (EGifPutExtensionLeader(m_gif_file, APPLICATION_EXT_FUNC_CODE) == GIF_ERROR)
+      throw Exception("Error writing GIF graphics extension record (header section).");
+
+    unsigned char extension_bytes[11];
+    memcpy(extension_bytes, "NETSCAPE2.0", 11);
+    if (EGifPutExtensionBlock(m_gif_file, 11, extension_bytes) == GIF_ERROR)
+      throw Exception("Error writing GIF graphics extension record (first block).");
+
+    extension_bytes[0] = 1;
+    extension_bytes[1] = (m_loop & 0xff);
+    extension_bytes[2] = (m_loop >> 8) & 0xff;
+    if (EGifPutExtensionBlock(m_gif_file, 3, extension_bytes) == GIF_ERROR)
+      throw Exception("Error writing GIF graphics extension record (second block).");
+
+    if (EGifPutExtensionTrailer(m_gif_file) == GIF_ERROR)
+      throw Exception("Error writing GIF graphics extension record (trailer section).");
+  }
+
+  // Write graphics extension record (to save the duration of the
+  // frame and maybe the transparency index).
+  {
+    unsigned char extension_bytes[5];
+    int disposal_method = (m_sprite->backgroundLayer() ? DISPOSAL_METHOD_DO_NOT_DISPOSE:
+                                                         DISPOSAL_METHOD_RESTORE_BGCOLOR);
+    int frame_delay = m_sprite->getFrameDuration(frame_num) / 10;
+
+    extension_bytes[0] = (((disposal_method & 7) << 2) |
+                          (m_transparent_index >= 0 ? 1: 0));
+    extension_bytes[1] = (frame_delay & 0xff);
+    extension_bytes[2] = (frame_delay >> 8) & 0xff;
+    extension_bytes[3] = (m_transparent_index >= 0 ? m_transparent_index: 0);
+
+    if (EGifPutExtension(m_gif_file, GRAPHICS_EXT_FUNC_CODE, 4, extension_bytes) == GIF_ERROR)
+      throw Exception("Error writing GIF graphics extension record for frame %d.\n", (int)frame_num);
+  }
+
+  // Image color map
+  if ((!m_global_color_map && frame_num == 0) ||
+      (current_palette.countDiff(&m_previous_palette, NULL, NULL) > 0)) {
+    if (!m_image_color_map) {
+      m_image_color_map = GifMakeMapObject(current_palette.size(), NULL);
+      if (m_image_color_map == NULL)
+        throw std::bad_alloc();
+    }
+
+    for (int i = 0; i < current_palette.size(); ++i) {
+      m_image_color_map->Colors[i].Red   = rgba_getr(current_palette.getEntry(i));
+      m_image_color_map->Colors[i].Green = rgba_getg(current_palette.getEntry(i));
+      m_image_color_map->Colors[i].Blue  = rgba_getb(current_palette.getEntry(i));
+    }
+
+    current_palette.copyColorsTo(&m_previous_palette);
+  }
+
+  // Write the image record.
+  if (EGifPutImageDesc(m_gif_file,
+                       m_frame_x, m_frame_y,
+                       m_frame_w, m_frame_h, m_interlaced ? 1: 0,
+                       m_image_color_map) == GIF_ERROR)
+    throw Exception("Error writing GIF frame %d.\n", (int)frame_num);
+
+  // Write the image data (pixels).
+  if (m_interlaced) {
+    // Need to perform 4 passes on the images.
+    for (int i=0; i<4; ++i)
+      for (int y = interlaced_offset[i]; y < m_frame_h; y += interlaced_jumps[i]) {
+        IndexedTraits::address_t addr =
+          (IndexedTraits::address_t)current_image->getPixelAddress(m_frame_x, m_frame_y + y);
+
+        if (EGifPutLine(m_gif_file, addr, m_frame_w) == GIF_ERROR)
+          throw Exception("Error writing GIF image scanlines for frame %d.\n", (int)frame_num);
+      }
+  }
+  else {
+    // Write all image scanlines (not interlaced in this case).
+    for (int y=0; y<m_frame_h; ++y) {
+      IndexedTraits::address_t addr =
+        (IndexedTraits::address_t)current_image->getPixelAddress(m_frame_x, m_frame_y + y);
+
+      if (EGifPutLine(m_gif_file, addr, m_frame_w) == GIF_ERROR)
+        throw Exception("Error writing GIF image scanlines for frame %d.\n", (int)frame_num);
+    }
+  }
+
+  // The current image is the previous one of the next frame.
+  m_previous_image.reset(current_image.release());
+}
+
 bool GifFormat::onSave(FileOp* fop)
 {
   int errCode;
@@ -550,7 +862,6 @@ bool GifFormat::onSave(FileOp* fop)
   int transparent_index = (has_background ? -1: sprite->transparentColor());
 
   Palette current_palette = *sprite->getPalette(FrameNumber(0));
-  Palette previous_palette(current_palette);
   RgbMap rgbmap;
 
   // The color map must be a power of two.
@@ -593,32 +904,47 @@ bool GifFormat::onSave(FileOp* fop)
                         background_color, color_map) == GIF_ERROR)
     throw Exception("Error writing GIF header.\n");
 
-  UniquePtr<Image> buffer_image;
-  UniquePtr<Image> current_image(Image::create(IMAGE_INDEXED, sprite_w, sprite_h));
-  UniquePtr<Image> previous_image(Image::create(IMAGE_INDEXED, sprite_w, sprite_h));
-  int frame_x, frame_y, frame_w, frame_h;
-  int u1, v1, u2, v2;
-  int i1, j1, i2, j2;
-
-  // If the sprite is not Indexed type, we will need a temporary
-  // buffer to render the full RGB or Grayscale sprite.
-  if (sprite_format != IMAGE_INDEXED)
-    buffer_image.reset(Image::create(sprite_format, sprite_w, sprite_h));
+  GifEncoder encoder(gif_file, sprite, interlaced, loop,
+                     background_color, transparent_index,
+                     color_map != NULL, current_palette);
 
-  clear_image(current_image, background_color);
-  clear_image(previous_image, background_color);
+  // If the sprite is not Indexed type, we will need temporary
+  // buffers to render the full RGB or Grayscale frames.
+  bool quantize = (sprite_format != IMAGE_INDEXED);
+  int total_frames = sprite->totalFrames();
+  size_t frame_bytes = size_t(sprite_w) * sprite_h * 4;
+  int batch_frames = MID(1, int(max_batch_bytes / frame_bytes), max_batch_frames);
 
-  ColorMapObject* image_color_map = NULL;
+  // Frames rendered for GifOptions::QuantizeAll that are reused
+  FrameImages kept_frames(total_frames);
 
   // Check if the user wants one optimized palette for all frames.
-  if (sprite_format != IMAGE_INDEXED &&
+  if (quantize &&
       gif_options->quantize() == GifOptions::QuantizeAll) {
     // Feed the optimizer with all rendered frames.
     raster::quantization::PaletteOptimizer optimizer;
-    for (FrameNumber frame_num(0); frame_num<sprite->totalFrames(); ++frame_num) {
-      clear_image(buffer_image, background_color);
-      layer_render(sprite->folder(), buffer_image, 0, 0, frame_num);
-      optimizer.feedWithImage(buffer_image);
+    size_t kept_bytes = 0;
+
+    for (int first=0; first<total_frames; first+=batch_frames) {
+      int n = MIN(batch_frames, total_frames-first);
+      std::vector<FrameNumber> frames(n);
+      FrameImages rendered(n);
+      for (int i=0; i<n; ++i) {
+        frames[i] = FrameNumber(first+i);
+        rendered[i] = Image::create(sprite_format, sprite_w, sprite_h);
+      }
+
+      base::thread_pool::shared().for_each_index(n, RenderFrames(sprite, background_color, frames, rendered.images()));
+
+      for (int i=0; i<n; ++i) {
+        optimizer.feedWithImage(rendered[i]);
+
+        if (kept_bytes + frame_bytes <= max_kept_frames_bytes) {
+          kept_frames[first+i] = rendered[i];
+          rendered[i] = NULL;
+          kept_bytes += frame_bytes;
+        }
+      }
     }
 
     current_palette.makeBlack();
@@ -627,153 +953,99 @@ bool GifFormat::onSave(FileOp* fop)
     rgbmap.regenerate(&current_palette, transparent_index);
   }
 
-  for (FrameNumber frame_num(0); frame_num<sprite->totalFrames(); ++frame_num) {
-    // If the sprite is RGB or Grayscale, we must to convert it to Indexed on the fly.
-    if (sprite_format != IMAGE_INDEXED) {
-      clear_image(buffer_image, background_color);
-      layer_render(sprite->folder(), buffer_image, 0, 0, frame_num);
-
-      switch (gif_options->quantize()) {
-        case GifOptions::NoQuantize:
-          sprite->getPalette(frame_num)->copyColorsTo(&current_palette);
-          rgbmap.regenerate(&current_palette, transparent_index);
-          break;
-        case GifOptions::QuantizeEach:
-          {
-            current_palette.makeBlack();
-
-            std::vector<Image*> imgarray(1);
-            imgarray[0] = buffer_image;
-            raster::quantization::create_palette_from_images(imgarray, &current_palette, has_background);
-            rgbmap.regenerate(&current_palette, transparent_index);
-          }
-          break;
-        case GifOptions::QuantizeAll:
-          // Do nothing, we've already calculate the palette for all frames.
-          break;
-      }
-
-      quantization::convert_pixel_format(
-        buffer_image,
-        current_image,
-        IMAGE_INDEXED,
-        gif_options->dithering(),
-        &rgbmap,
-        &current_palette,
-        has_background);
-    }
-    // If the sprite is Indexed, we can render directly into "current_image".
-    else {
-      clear_image(current_image, background_color);
-      layer_render(sprite->folder(), current_image, 0, 0, frame_num);
-    }
-
-    if (frame_num == 0) {
-      frame_x = 0;
-      frame_y = 0;
-      frame_w = sprite->width();
-      frame_h = sprite->height();
-    }
-    else {
-      // Get the rectangle where start differences with the previous frame.
-      if (get_shrink_rect2(&u1, &v1, &u2, &v2, current_image, previous_image)) {
-        // Check the minimal area with the background color.
-        if (get_shrink_rect(&i1, &j1, &i2, &j2, current_image, background_color)) {
-          frame_x = MIN(u1, i1);
-          frame_y = MIN(v1, j1);
-          frame_w = MAX(u2, i2) - MIN(u1, i1) + 1;
-          frame_h = MAX(v2, j2) - MIN(v1, j1) + 1;
+  // Frames of the batch that is being encoded
+  FrameImages encode_images;
+  std::vector<Palette> encode_palettes;
+  int encode_first = 0;
+
+  for (int first=0; ; first+=batch_frames) {
+    int n = MAX(0, MIN(batch_frames, total_frames-first));
+    std::vector<FrameNumber> frames(n);
+    std::vector<Palette> palettes(n, current_palette);
+    FrameImages rendered(n);    // RGB or Grayscale frames
+    FrameImages indexed(n);
+
+    for (int i=0; i<n; ++i) {
+      frames[i] = FrameNumber(first+i);
+      indexed[i] = Image::create(IMAGE_INDEXED, sprite_w, sprite_h);
+
+      if (quantize) {
+        // Reuse the frame rendered to calculate the palette
+        if (kept_frames[first+i]) {
+          rendered[i] = kept_frames[first+i];
+          kept_frames[first+i] = NULL;
+          frames[i] = FrameNumber(-1);
         }
+        else
+          rendered[i] = Image::create(sprite_format, sprite_w, sprite_h);
       }
     }
 
-    // Specify loop extension.
-    if (frame_num == 0 && loop >= 0) {
-      if (EGifPutExtensionLeader(gif_file, APPLICATION_EXT_FUNC_CODE) == GIF_ERROR)
-        throw Exception("Error writing GIF graphics extension record (header section).");
-
-      unsigned char extension_bytes[11];
-      memcpy(extension_bytes, "NETSCAPE2.0", 11);
-      if (EGifPutExtensionBlock(gif_file, 11, extension_bytes) == GIF_ERROR)
-        throw Exception("Error writing GIF graphics extension record (first block).");
+    // Render this batch while the previous one is encoded. If the
+    // sprite is Indexed, we can render directly into the indexed
+    // images.
+    RenderFrames render(sprite, background_color, frames,
+                        quantize ? rendered.images(): indexed.images());
 
-      extension_bytes[0] = 1;
-      extension_bytes[1] = (loop & 0xff);
-      extension_bytes[2] = (loop >> 8) & 0xff;
-      if (EGifPutExtensionBlock(gif_file, 3, extension_bytes) == GIF_ERROR)
-        throw Exception("Error writing GIF graphics extension record (second block).");
+    if (quantize && gif_options->quantize() == GifOptions::QuantizeEach)
+      render.setQuantizeEach(indexed.images(), palettes,
+                             gif_options->dithering(),
+                             transparent_index, has_background);
 
-      if (EGifPutExtensionTrailer(gif_file) == GIF_ERROR)
-        throw Exception("Error writing GIF graphics extension record (trailer section).");
-    }
+    if (encode_images.size() > 0)
+      render.setEncode(&encoder, encode_first, encode_images, encode_palettes);
 
-    // Write graphics extension record (to save the duration of the
-    // frame and maybe the transparency index).
-    {
-      unsigned char extension_bytes[5];
-      int disposal_method = (sprite->backgroundLayer() ? DISPOSAL_METHOD_DO_NOT_DISPOSE:
-                                                         DISPOSAL_METHOD_RESTORE_BGCOLOR);
-      int frame_delay = sprite->getFrameDuration(frame_num) / 10;
+    base::thread_pool::shared().for_each_index(render.size(), render);
 
-      extension_bytes[0] = (((disposal_method & 7) << 2) |
-                            (transparent_index >= 0 ? 1: 0));
-      extension_bytes[1] = (frame_delay & 0xff);
-      extension_bytes[2] = (frame_delay >> 8) & 0xff;
-      extension_bytes[3] = (transparent_index >= 0 ? transparent_index: 0);
+    fop_progress(fop, (double)first / (double)total_frames);
+    if (n == 0)
+      break;
 
-      if (EGifPutExtension(gif_file, GRAPHICS_EXT_FUNC_CODE, 4, extension_bytes) == GIF_ERROR)
-        throw Exception("Error writing GIF graphics extension record for frame %d.\n", (int)frame_num);
-    }
+    // If the sprite is RGB or Grayscale, we must to convert it to
+    // Indexed (the palette of each frame is calculated in
+    // RenderFrames in the QuantizeEach case).
+    if (quantize) {
+      std::vector<bool> is_background(n, has_background);
 
-    // Image color map
-    if ((!color_map && frame_num == 0) ||
-        (current_palette.countDiff(&previous_palette, NULL, NULL) > 0)) {
-      if (!image_color_map) {
-        image_color_map = GifMakeMapObject(current_palette.size(), NULL);
-        if (image_color_map == NULL)
-          throw std::bad_alloc();
-      }
+      switch (gif_options->quantize()) {
 
-      for (int i = 0; i < current_palette.size(); ++i) {
-        image_color_map->Colors[i].Red   = rgba_getr(current_palette.getEntry(i));
-        image_color_map->Colors[i].Green = rgba_getg(current_palette.getEntry(i));
-        image_color_map->Colors[i].Blue  = rgba_getb(current_palette.getEntry(i));
-      }
+        case GifOptions::NoQuantize:
+          for (int i=0; i<n; ++i)
+            sprite->getPalette(FrameNumber(first+i))->copyColorsTo(&palettes[i]);
+
+          // Convert consecutive frames with the same palette at the same time
+          for (int i=0, j; i<n; i=j) {
+            for (j=i+1; j<n && palettes[j].countDiff(&palettes[i], NULL, NULL) == 0; ++j)
+              ;
+
+            std::vector<const Image*> src(rendered.images().begin()+i, rendered.images().begin()+j);
+            std::vector<Image*> dst(indexed.images().begin()+i, indexed.images().begin()+j);
+            std::vector<bool> bg(is_background.begin()+i, is_background.begin()+j);
+
+            rgbmap.regenerate(&palettes[i], transparent_index);
+            quantization::convert_images_pixel_format(
+              src, dst, bg, IMAGE_INDEXED,
+              gif_options->dithering(), &rgbmap, &palettes[i]);
+          }
+          break;
 
-      current_palette.copyColorsTo(&previous_palette);
-    }
+        case GifOptions::QuantizeEach:
+          // Do nothing, we've already converted the frames.
+          break;
 
-    // Write the image record.
-    if (EGifPutImageDesc(gif_file,
-                         frame_x, frame_y,
-                         frame_w, frame_h, interlaced ? 1: 0,
-                         image_color_map) == GIF_ERROR)
-      throw Exception("Error writing GIF frame %d.\n", (int)frame_num);
-
-    // Write the image data (pixels).
-    if (interlaced) {
-      // Need to perform 4 passes on the images.
-      for (int i=0; i<4; ++i)
-        for (int y = interlaced_offset[i]; y < frame_h; y += interlaced_jumps[i]) {
-          IndexedTraits::address_t addr =
-            (IndexedTraits::address_t)current_image->getPixelAddress(frame_x, frame_y + y);
-
-          if (EGifPutLine(gif_file, addr, frame_w) == GIF_ERROR)
-            throw Exception("Error writing GIF image scanlines for frame %d.\n", (int)frame_num);
+        case GifOptions::QuantizeAll: {
+          std::vector<const Image*> src(rendered.images().begin(), rendered.images().end());
+          quantization::convert_images_pixel_format(
+            src, indexed.images(), is_background, IMAGE_INDEXED,
+            gif_options->dithering(), &rgbmap, &current_palette);
+          break;
         }
-    }
-    else {
-      // Write all image scanlines (not interlaced in this case).
-      for (int y=0; y<frame_h; ++y) {
-        IndexedTraits::address_t addr =
-          (IndexedTraits::address_t)current_image->getPixelAddress(frame_x, frame_y + y);
-
-        if (EGifPutLine(gif_file, addr, frame_w) == GIF_ERROR)
-          throw Exception("Error writing GIF image scanlines for frame %d.\n", (int)frame_num);
       }
     }
 
-    copy_image(previous_image, current_image, 0, 0);
+    encode_images.images().swap(indexed.images());
+    encode_palettes.swap(palettes);
+    encode_first = first;
   }
 
   return true;
@@ -20,6 +20,7 @@
 #define APP_DOC_OBJECTS_CONTAINER_H_INCLUDED
 #pragma once
 
+#include "app/undoers/tile_store.h"
 #include "undo/objects_container.h"
 
 #include <map>
@@ -38,10 +39,14 @@ namespace app {
     void removeObject(undo::ObjectId id);
     void* getObject(undo::ObjectId id);
 
+    // Tiles of images saved by undoers of the document.
+    undoers::TileStore* tileStore() { return &m_tileStore; }
+
   private:
     undo::ObjectId m_idCounter;
     std::map<undo::ObjectId, void*> m_idToPtr;
     std::map<void*, undo::ObjectId> m_ptrToId;
+    undoers::TileStore m_tileStore;
   };
 
 } // namespace app
@@ -34,7 +34,6 @@
 #include "raster/image.h"
 #include "raster/palette.h"
 #include "raster/primitives.h"
-#include "raster/rotate.h"
 #include "raster/sprite.h"
 #include "she/system.h"
 
@@ -83,26 +82,24 @@ private:
         RenderEngine renderEngine(m_fop->document,
           sprite, NULL, FrameNumber(0));
 
+        // Render the sprite directly with the thumbnail size (zooming
+        // out big sprites).
+        int size = MAX(sprite->width(), sprite->height());
+        Zoom zoom(1, 1);
+        if (size > MAX_THUMBNAIL_SIZE)
+          zoom = Zoom(MAX_THUMBNAIL_SIZE, size);
+
+        int thumb_w = MID(1, zoom.apply(sprite->width()), MAX_THUMBNAIL_SIZE);
+        int thumb_h = MID(1, zoom.apply(sprite->height()), MAX_THUMBNAIL_SIZE);
+
         raster::ImageBufferPtr thumbnail_buffer(new raster::ImageBuffer);
         base::UniquePtr<Image> image(renderEngine.renderSprite(
-            0, 0, sprite->width(), sprite->height(),
-            FrameNumber(0), 0, true, false,
+            0, 0, thumb_w, thumb_h,
+            FrameNumber(0), zoom, true, false,
             thumbnail_buffer));
 
-        // Calculate the thumbnail size
-        int thumb_w = MAX_THUMBNAIL_SIZE * image->width() / MAX(image->width(), image->height());
-        int thumb_h = MAX_THUMBNAIL_SIZE * image->height() / MAX(image->width(), image->height());
-        if (MAX(thumb_w, thumb_h) > MAX(image->width(), image->height())) {
-          thumb_w = image->width();
-          thumb_h = image->height();
-        }
-        thumb_w = MID(1, thumb_w, MAX_THUMBNAIL_SIZE);
-        thumb_h = MID(1, thumb_h, MAX_THUMBNAIL_SIZE);
-
-        // Stretch the 'image'
         m_thumbnail.reset(Image::create(image->pixelFormat(), thumb_w, thumb_h));
-        clear_image(m_thumbnail, 0);
-        image_scale(m_thumbnail, image, 0, 0, thumb_w, thumb_h);
+        copy_image(m_thumbnail, image, 0, 0);
       }
 
       // Close file
@@ -98,7 +98,9 @@ template<typename Derived, typename ImageTraits>
 class DoubleInkProcessing : public InkProcessing<Derived> {
 public:
   void initIterators(ToolLoop* loop, int x1, int y) {
-    m_srcAddress = (typename ImageTraits::address_t)loop->getSrcImage()->getPixelAddress(x1, y);
+    // The source image is only read, so we use the const version of
+    // getPixelAddress() to avoid unsharing its pixels (copy-on-write).
+    m_srcAddress = (typename ImageTraits::address_t)static_cast<const Image*>(loop->getSrcImage())->getPixelAddress(x1, y);
     m_dstAddress = (typename ImageTraits::address_t)loop->getDstImage()->getPixelAddress(x1, y);
   }
 
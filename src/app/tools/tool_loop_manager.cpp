@@ -185,6 +185,11 @@ void ToolLoopManager::doLoopStep(bool last_step)
   for (size_t i=0; i<points_to_interwine.size(); ++i)
     points_to_interwine[i] += offset;
 
+  // Area of the images modified by the previous trace (source and
+  // destination are equal in the rest of the image).
+  Region old_trace_area(m_oldDirtyArea);
+  old_trace_area.offset(offset);
+
   switch (m_toolLoop->getTracePolicy()) {
 
     case TracePolicyAccumulate:
@@ -194,14 +199,13 @@ void ToolLoopManager::doLoopStep(bool last_step)
     case TracePolicyLast:
       // Copy source to destination (reset the previous trace). Useful
       // for tools like Line and Ellipse tools (we kept the last trace only).
-      clear_image(m_toolLoop->getDstImage(), 0);
-      copy_image(m_toolLoop->getDstImage(), m_toolLoop->getSrcImage(), 0, 0);
+      copy_image(m_toolLoop->getDstImage(), m_toolLoop->getSrcImage(), old_trace_area);
       break;
 
     case TracePolicyOverlap:
       // Copy destination to source (yes, destination to source). In
       // this way each new trace overlaps the previous one.
-      copy_image(m_toolLoop->getSrcImage(), m_toolLoop->getDstImage(), 0, 0);
+      copy_image(m_toolLoop->getSrcImage(), m_toolLoop->getDstImage(), old_trace_area);
       break;
   }
 
@@ -220,6 +224,8 @@ void ToolLoopManager::doLoopStep(bool last_step)
     dirty_area.createUnion(dirty_area, m_oldDirtyArea);
     m_oldDirtyArea = prev_dirty_area;
   }
+  else if (m_toolLoop->getTracePolicy() == TracePolicyOverlap)
+    m_oldDirtyArea = dirty_area;
 
   if (!dirty_area.isEmpty())
     m_toolLoop->updateDirtyArea();
@@ -284,7 +284,8 @@ void Editor::drawBrushPreview(int x, int y, bool refresh)
         (m_sprite,
          gfx::Region(gfx::Rect(x+brushBounds.x,
                                y+brushBounds.y,
-                               brushBounds.w, brushBounds.h)));
+                               brushBounds.w, brushBounds.h)),
+         m_layer);
     }
   }
 
@@ -338,7 +339,7 @@ void Editor::moveBrushPreview(int x, int y, bool refresh)
       gfx::Rect rc1(old_x+brushBounds.x, old_y+brushBounds.y, brushBounds.w, brushBounds.h);
       gfx::Rect rc2(new_x+brushBounds.x, new_y+brushBounds.y, brushBounds.w, brushBounds.h);
       m_document->notifySpritePixelsModified
-        (m_sprite, gfx::Region(rc1.createUnion(rc2)));
+        (m_sprite, gfx::Region(rc1.createUnion(rc2)), m_layer);
     }
 
     // Save area and draw the cursor
@@ -395,7 +396,8 @@ void Editor::clearBrushPreview(bool refresh)
         (m_sprite,
          gfx::Region(gfx::Rect(x+brushBounds.x,
                                y+brushBounds.y,
-                               brushBounds.w, brushBounds.h)));
+                               brushBounds.w, brushBounds.h)),
+         m_layer);
     }
   }
 
@@ -53,6 +53,7 @@
 #include "app/util/boundary.h"
 #include "app/util/misc.h"
 #include "app/util/render.h"
+#include "app/util/render_cache.h"
 #include "base/bind.h"
 #include "base/unique_ptr.h"
 #include "raster/conversion_she.h"
@@ -157,6 +158,7 @@ Editor::Editor(Document* document, EditorFlags flags)
   , m_docView(NULL)
   , m_flags(flags)
   , m_secondaryButton(false)
+  , m_renderCache(new RenderCache(document))
 {
   // Add the first state into the history.
   m_statesHistory.push(m_state);
@@ -392,6 +394,7 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc, in
   // Draw the sprite
   if ((width > 0) && (height > 0)) {
     RenderEngine renderEngine(m_document, m_sprite, m_layer, m_frame);
+    renderEngine.setRenderCache(m_renderCache);
 
     // Generate the rendered image
     if (!render_buffer)
@@ -401,7 +404,7 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc, in
     try {
       rendered.reset(renderEngine.renderSprite(
           source_x, source_y, width, height,
-          m_frame, m_zoom, true,
+          m_frame, Zoom::fromShift(m_zoom), true,
           ((m_flags & kShowOnionskin) == kShowOnionskin),
           render_buffer));
     }
@@ -28,6 +28,7 @@
 #include "app/ui/editor/editor_state.h"
 #include "app/ui/editor/editor_states_history.h"
 #include "base/connection.h"
+#include "base/unique_ptr.h"
 #include "gfx/fwd.h"
 #include "raster/frame_number.h"
 #include "raster/image_buffer.h"
@@ -56,6 +57,7 @@ namespace app {
   class DocumentView;
   class EditorCustomizationDelegate;
   class PixelsMovement;
+  class RenderCache;
 
   namespace tools {
     class Ink;
@@ -309,6 +311,10 @@ namespace app {
     EditorFlags m_flags;
 
     bool m_secondaryButton;
+
+    // Layers below/above the active layer already blended (to avoid
+    // blending all layers again on each repaint).
+    base::UniquePtr<RenderCache> m_renderCache;
   };
 
   ui::WidgetType editor_type();
@@ -412,7 +412,7 @@ void PixelsMovement::moveImage(int x, int y, MoveModifier moveModifier)
   // If "fullBounds" is empty is because the cel was not moved
   if (!fullBounds.isEmpty()) {
     // Notify the modified region.
-    m_document->notifySpritePixelsModified(m_sprite, gfx::Region(fullBounds));
+    m_document->notifySpritePixelsModified(m_sprite, gfx::Region(fullBounds), m_layer);
   }
 }
 
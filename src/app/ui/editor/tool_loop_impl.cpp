@@ -268,7 +268,7 @@ public:
   void updateDirtyArea() override
   {
     m_dirtyBounds = m_dirtyBounds.createUnion(m_dirtyArea.bounds());
-    m_document->notifySpritePixelsModified(m_sprite, m_dirtyArea);
+    m_document->notifySpritePixelsModified(m_sprite, m_dirtyArea, m_layer);
   }
 
   void updateStatusBar(const char* text) override
@@ -0,0 +1,138 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/undoers/compressed_data.h"
+
+#include "undo/undo_exception.h"
+
+#include "zlib.h"
+
+#include <algorithm>
+#include <string>
+
+namespace app {
+namespace undoers {
+
+using namespace undo;
+
+CompressedData::CompressedData()
+  : m_rawSize(0)
+  , m_compressed(false)
+  , m_spillPos(0)
+  , m_spillSize(0)
+{
+}
+
+CompressedData::~CompressedData()
+{
+  releaseSpilledData();
+}
+
+void CompressedData::compress(const uint8_t* data, size_t size)
+{
+  releaseSpilledData();
+
+  m_rawSize = size;
+  m_compressed = false;
+  m_data.clear();
+
+  if (size == 0)
+    return;
+
+  std::vector<uint8_t> buf(compressBound(size));
+  uLongf compressedSize = buf.size();
+
+  if (compress2(&buf[0], &compressedSize,
+                data, size, Z_BEST_SPEED) == Z_OK &&
+      compressedSize < size) {
+    m_compressed = true;
+    m_data.assign(buf.begin(), buf.begin()+compressedSize);
+  }
+  // Data that cannot be compressed is stored as is.
+  else
+    m_data.assign(data, data+size);
+}
+
+void CompressedData::compress(const std::stringstream& stream)
+{
+  std::string buf = stream.str();
+  compress((const uint8_t*)buf.data(), buf.size());
+}
+
+void CompressedData::decompress(uint8_t* data) const
+{
+  if (m_rawSize == 0)
+    return;
+
+  // Read the data back from the spill file.
+  std::vector<uint8_t> spilledData;
+  if (m_spillFile) {
+    spilledData.resize(m_spillSize);
+    m_spillFile->read(m_spillPos, &spilledData[0], m_spillSize);
+  }
+  const std::vector<uint8_t>& src = (m_spillFile ? spilledData: m_data);
+
+  if (!m_compressed) {
+    std::copy(src.begin(), src.end(), data);
+    return;
+  }
+
+  uLongf size = m_rawSize;
+  if (uncompress(data, &size, &src[0], src.size()) != Z_OK ||
+      size != m_rawSize)
+    throw UndoException("Error decompressing undo data");
+}
+
+void CompressedData::decompress(std::stringstream& stream) const
+{
+  std::string buf(m_rawSize, 0);
+  if (m_rawSize > 0)
+    decompress((uint8_t*)&buf[0]);
+  stream.str(buf);
+}
+
+bool CompressedData::spill()
+{
+  if (m_spillFile || m_data.empty())
+    return false;
+
+  SpillFilePtr file = SpillFile::current();
+  if (!file || !file->write(&m_data[0], m_data.size(), m_spillPos))
+    return false;
+
+  m_spillFile = file;
+  m_spillSize = m_data.size();
+  std::vector<uint8_t>().swap(m_data);
+  return true;
+}
+
+void CompressedData::releaseSpilledData()
+{
+  if (m_spillFile) {
+    m_spillFile->release(m_spillSize);
+    m_spillFile.reset();
+    m_spillSize = 0;
+  }
+}
+
+} // namespace undoers
+} // namespace app
@@ -0,0 +1,78 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef APP_UNDOERS_COMPRESSED_DATA_H_INCLUDED
+#define APP_UNDOERS_COMPRESSED_DATA_H_INCLUDED
+#pragma once
+
+#include "app/undoers/spill_file.h"
+#include "base/disable_copying.h"
+
+#include <sstream>
+#include <vector>
+
+namespace app {
+  namespace undoers {
+
+    // Data of an undoer compressed with zlib (fastest level). It's
+    // compressed when the undoer is created and decompressed only
+    // when the undoer is reverted, so undoers with pixels use less
+    // memory of the undo history. The data can be moved to the
+    // SpillFile, in that case it's read from the file to decompress it.
+    class CompressedData {
+    public:
+      CompressedData();
+      ~CompressedData();
+
+      // Size of the data in memory (compressed bytes, or zero if the
+      // data is in the spill file).
+      size_t size() const { return m_data.size(); }
+
+      // Size of the original data.
+      size_t rawSize() const { return m_rawSize; }
+
+      void compress(const uint8_t* data, size_t size);
+      void compress(const std::stringstream& stream);
+
+      // Throws an UndoException if the data cannot be decompressed.
+      void decompress(uint8_t* data) const;
+      void decompress(std::stringstream& stream) const;
+
+      // Moves the data to the current SpillFile. Returns false if
+      // there is no spill file or the data cannot be written.
+      bool spill();
+
+    private:
+      void releaseSpilledData();
+
+      size_t m_rawSize;
+      bool m_compressed;
+      std::vector<uint8_t> m_data;
+
+      // Location of the data in the spill file.
+      SpillFilePtr m_spillFile;
+      long m_spillPos;
+      size_t m_spillSize;
+
+      DISABLE_COPYING(CompressedData);
+    };
+
+  } // namespace undoers
+} // namespace app
+
+#endif  // UNDOERS_COMPRESSED_DATA_H_INCLUDED
@@ -0,0 +1,130 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "app/undoers/compressed_data.h"
+
+#include <sstream>
+#include <vector>
+
+using namespace app::undoers;
+
+TEST(CompressedData, RoundTrip)
+{
+  std::vector<uint8_t> data(4096);
+  for (size_t i=0; i<data.size(); ++i)
+    data[i] = uint8_t(i / 64);
+
+  CompressedData compressed;
+  compressed.compress(&data[0], data.size());
+  EXPECT_EQ(data.size(), compressed.rawSize());
+
+  std::vector<uint8_t> output(data.size(), 0);
+  compressed.decompress(&output[0]);
+  EXPECT_EQ(data, output);
+}
+
+TEST(CompressedData, RoundTripWithStreams)
+{
+  std::stringstream input;
+  for (int i=0; i<100; ++i)
+    input << "line " << i << "\n";
+
+  CompressedData compressed;
+  compressed.compress(input);
+  EXPECT_EQ(input.str().size(), compressed.rawSize());
+
+  std::stringstream output;
+  compressed.decompress(output);
+  EXPECT_EQ(input.str(), output.str());
+}
+
+TEST(CompressedData, EmptyInput)
+{
+  CompressedData compressed;
+  EXPECT_EQ(0u, compressed.size());
+  EXPECT_EQ(0u, compressed.rawSize());
+
+  std::stringstream input;
+  compressed.compress(input);
+  EXPECT_EQ(0u, compressed.size());
+  EXPECT_EQ(0u, compressed.rawSize());
+
+  std::stringstream output;
+  compressed.decompress(output);
+  EXPECT_EQ("", output.str());
+
+  // Nothing to move to the spill file
+  EXPECT_FALSE(compressed.spill());
+}
+
+TEST(CompressedData, SizeOfCompressibleData)
+{
+  std::vector<uint8_t> data(64*1024, 7);
+
+  CompressedData compressed;
+  compressed.compress(&data[0], data.size());
+  EXPECT_EQ(data.size(), compressed.rawSize());
+  EXPECT_LT(compressed.size(), data.size() / 10);
+}
+
+TEST(CompressedData, SizeOfIncompressibleData)
+{
+  // Data that zlib cannot compress is stored as is
+  std::vector<uint8_t> data(1024);
+  uint32_t seed = 1;
+  for (size_t i=0; i<data.size(); ++i) {
+    seed = seed*1103515245 + 12345;
+    data[i] = uint8_t(seed >> 16);
+  }
+
+  CompressedData compressed;
+  compressed.compress(&data[0], data.size());
+  EXPECT_EQ(data.size(), compressed.rawSize());
+  EXPECT_EQ(data.size(), compressed.size());
+
+  std::vector<uint8_t> output(data.size(), 0);
+  compressed.decompress(&output[0]);
+  EXPECT_EQ(data, output);
+}
+
+TEST(CompressedData, Spill)
+{
+  SpillFilePtr file(new SpillFile("compressed_data_tests.spill"));
+  std::vector<uint8_t> data(4096, 1);
+
+  CompressedData compressed;
+  compressed.compress(&data[0], data.size());
+
+  // Without spill file
+  EXPECT_FALSE(compressed.spill());
+  EXPECT_NE(0u, compressed.size());
+
+  SpillFile::setCurrent(file);
+  EXPECT_TRUE(compressed.spill());
+  EXPECT_EQ(0u, compressed.size());
+  EXPECT_EQ(data.size(), compressed.rawSize());
+  EXPECT_FALSE(compressed.spill());
+
+  std::vector<uint8_t> output(data.size(), 0);
+  compressed.decompress(&output[0]);
+  EXPECT_EQ(data, output);
+
+  SpillFile::setCurrent(SpillFilePtr());
+}
@@ -29,6 +29,8 @@
 #include "undo/objects_container.h"
 #include "undo/undoers_collector.h"
 
+#include <sstream>
+
 namespace app {
 namespace undoers {
 
@@ -37,7 +39,12 @@ using namespace undo;
 DirtyArea::DirtyArea(ObjectsContainer* objects, Image* image, Dirty* dirty)
   : m_imageId(objects->addObject(image))
 {
-  raster::write_dirty(m_stream, dirty);
+  // Only the rows/columns are serialized, the pixels are compressed
+  // directly from the dirty buffer.
+  std::stringstream stream;
+  raster::write_dirty_layout(stream, dirty);
+  m_layout = stream.str();
+  m_data.compress(dirty->data(), dirty->dataSize());
 }
 
 void DirtyArea::dispose()
@@ -48,7 +55,9 @@ void DirtyArea::dispose()
 void DirtyArea::revert(ObjectsContainer* objects, UndoersCollector* redoers)
 {
   Image* image = objects->getObjectT<Image>(m_imageId);
-  base::UniquePtr<Dirty> dirty(raster::read_dirty(m_stream));
+  std::stringstream stream(m_layout);
+  base::UniquePtr<Dirty> dirty(raster::read_dirty_layout(stream));
+  m_data.decompress(dirty->data());
 
   // Swap the saved pixels in the dirty with the pixels in the image
   dirty->swapImagePixels(image);
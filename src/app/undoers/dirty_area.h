@@ -20,10 +20,11 @@
 #define APP_UNDOERS_DIRTY_AREA_H_INCLUDED
 #pragma once
 
+#include "app/undoers/compressed_data.h"
 #include "app/undoers/undoer_base.h"
 #include "undo/object_id.h"
 
-#include <sstream>
+#include <string>
 
 namespace raster {
   class Dirty;
@@ -40,16 +41,14 @@ namespace app {
       DirtyArea(ObjectsContainer* objects, Image* image, Dirty* dirty);
 
       void dispose() override;
-      size_t getMemSize() const override { return sizeof(*this) + getStreamSize(); }
+      size_t getMemSize() const override { return sizeof(*this) + m_layout.size() + m_data.size(); }
+      bool spill() override { return m_data.spill(); }
       void revert(ObjectsContainer* objects, UndoersCollector* redoers) override;
 
     private:
-      size_t getStreamSize() const {
-        return const_cast<std::stringstream*>(&m_stream)->tellp();
-      }
-
       ObjectId m_imageId;
-      std::stringstream m_stream;
+      std::string m_layout;     // Rows/columns of the Dirty
+      CompressedData m_data;    // Pixels of the Dirty
     };
 
   } // namespace undoers
@@ -28,6 +28,7 @@
 #include "undo/undoers_collector.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace app {
 namespace undoers {
@@ -39,17 +40,19 @@ ImageArea::ImageArea(ObjectsContainer* objects, Image* image, int x, int y, int
   , m_format(image->pixelFormat())
   , m_x(x), m_y(y), m_w(w), m_h(h)
   , m_lineSize(image->getRowStrideSize(w))
-  , m_data(m_lineSize * h)
 {
   ASSERT(w >= 1 && h >= 1);
   ASSERT(x >= 0 && y >= 0 && x+w <= image->width() && y+h <= image->height());
 
-  std::vector<uint8_t>::iterator it = m_data.begin();
+  std::vector<uint8_t> data(m_lineSize * h);
+  std::vector<uint8_t>::iterator it = data.begin();
   for (int v=0; v<h; ++v) {
     uint8_t* addr = image->getPixelAddress(x, y+v);
     std::copy(addr, addr+m_lineSize, it);
     it += m_lineSize;
   }
+
+  m_data.compress(&data[0], data.size());
 }
 
 void ImageArea::dispose()
@@ -64,11 +67,14 @@ void ImageArea::revert(ObjectsContainer* objects, UndoersCollector* redoers)
   if (image->pixelFormat() != m_format)
     throw UndoException("Image type does not match");
 
+  std::vector<uint8_t> data(m_data.rawSize());
+  m_data.decompress(&data[0]);
+
   // Backup the current image portion
   redoers->pushUndoer(new ImageArea(objects, image, m_x, m_y, m_w, m_h));
 
   // Restore the old image portion
-  std::vector<uint8_t>::iterator it = m_data.begin();
+  std::vector<uint8_t>::iterator it = data.begin();
   for (int v=0; v<m_h; ++v) {
     uint8_t* addr = image->getPixelAddress(m_x, m_y+v);
     std::copy(it, it+m_lineSize, addr);
@@ -20,11 +20,10 @@
 #define APP_UNDOERS_IMAGE_AREA_H_INCLUDED
 #pragma once
 
+#include "app/undoers/compressed_data.h"
 #include "app/undoers/undoer_base.h"
 #include "undo/object_id.h"
 
-#include <vector>
-
 namespace raster {
   class Image;
 }
@@ -40,6 +39,7 @@ namespace app {
 
       void dispose() override;
       size_t getMemSize() const override { return sizeof(*this) + m_data.size(); }
+      bool spill() override { return m_data.spill(); }
       void revert(ObjectsContainer* objects, UndoersCollector* redoers) override;
 
     private:
@@ -47,7 +47,7 @@ namespace app {
       uint8_t m_format;
       uint16_t m_x, m_y, m_w, m_h;
       uint32_t m_lineSize;
-      std::vector<uint8_t> m_data;
+      CompressedData m_data;
     };
 
   } // namespace undoers
@@ -43,6 +43,7 @@ namespace app {
 
       void dispose() override;
       size_t getMemSize() const override { return sizeof(*this); }
+      bool spill() override { return false; }
       Modification getModification() const { return m_modification; }
       bool isOpenGroup() const override { return true; }
       bool isCloseGroup() const override { return false; }
@@ -23,9 +23,8 @@
 #include "app/undoers/remove_image.h"
 
 #include "app/undoers/add_image.h"
-#include "app/undoers/object_io.h"
+#include "base/unique_ptr.h"
 #include "raster/image.h"
-#include "raster/image_io.h"
 #include "raster/stock.h"
 #include "undo/objects_container.h"
 #include "undo/undoers_collector.h"
@@ -39,10 +38,11 @@ using namespace undo;
 RemoveImage::RemoveImage(ObjectsContainer* objects, Stock* stock, int imageIndex)
   : m_stockId(objects->addObject(stock))
   , m_imageIndex(imageIndex)
+  , m_imageId(objects->addObject(stock->getImage(imageIndex)))
+  , m_tiles(TileStore::fromObjects(objects), stock->getImage(imageIndex))
 {
-  Image* image = stock->getImage(imageIndex);
-
-  write_object(objects, m_stream, image, raster::write_image);
+  // The image will be re-added with the same ID in revert().
+  objects->removeObject(m_imageId);
 }
 
 void RemoveImage::dispose()
@@ -53,7 +53,9 @@ void RemoveImage::dispose()
 void RemoveImage::revert(ObjectsContainer* objects, UndoersCollector* redoers)
 {
   Stock* stock = objects->getObjectT<Stock>(m_stockId);
-  Image* image = read_object<Image>(objects, m_stream, raster::read_image);
+  base::UniquePtr<Image> newImage(m_tiles.createImage());
+  objects->insertObject(m_imageId, newImage);
+  Image* image = newImage.release();
 
   // Push an AddImage as redoer
   redoers->pushUndoer(new AddImage(objects, stock, m_imageIndex));
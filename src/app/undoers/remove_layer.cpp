@@ -100,7 +100,9 @@ RemoveLayer::RemoveLayer(ObjectsContainer* objects, Document* document, Layer* l
   m_afterId = (after ? objects->addObject(after): 0);
 
   LayerSubObjectsSerializerImpl serializer(objects, layer->sprite());
-  write_object(objects, m_stream, layer, serializer);
+  std::stringstream stream;
+  write_object(objects, stream, layer, serializer);
+  m_data.compress(stream);
 }
 
 void RemoveLayer::dispose()
@@ -116,7 +118,9 @@ void RemoveLayer::revert(ObjectsContainer* objects, UndoersCollector* redoers)
 
   // Read the layer from the stream
   LayerSubObjectsSerializerImpl serializer(objects, folder->sprite());
-  Layer* layer = read_object<Layer>(objects, m_stream, serializer);
+  std::stringstream stream;
+  m_data.decompress(stream);
+  Layer* layer = read_object<Layer>(objects, stream, serializer);
 
   document->getApi(redoers).addLayer(folder, layer, after);
 }
@@ -20,11 +20,10 @@
 #define APP_UNDOERS_REMOVE_LAYER_H_INCLUDED
 #pragma once
 
+#include "app/undoers/compressed_data.h"
 #include "app/undoers/undoer_base.h"
 #include "undo/object_id.h"
 
-#include <sstream>
-
 namespace raster {
   class Layer;
 }
@@ -41,18 +40,15 @@ namespace app {
       RemoveLayer(ObjectsContainer* objects, Document* document, Layer* layer);
 
       void dispose() override;
-      size_t getMemSize() const override { return sizeof(*this) + getStreamSize(); }
+      size_t getMemSize() const override { return sizeof(*this) + m_data.size(); }
+      bool spill() override { return m_data.spill(); }
       void revert(ObjectsContainer* objects, UndoersCollector* redoers) override;
 
     private:
-      size_t getStreamSize() const {
-        return const_cast<std::stringstream*>(&m_stream)->tellp();
-      }
-
       ObjectId m_documentId;
       ObjectId m_folderId;
       ObjectId m_afterId;
-      std::stringstream m_stream;
+      CompressedData m_data;
     };
 
   } // namespace undoers
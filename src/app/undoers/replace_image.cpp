@@ -22,9 +22,8 @@
 
 #include "app/undoers/replace_image.h"
 
-#include "app/undoers/object_io.h"
+#include "base/unique_ptr.h"
 #include "raster/image.h"
-#include "raster/image_io.h"
 #include "raster/stock.h"
 #include "undo/objects_container.h"
 #include "undo/undoers_collector.h"
@@ -37,10 +36,11 @@ using namespace undo;
 ReplaceImage::ReplaceImage(ObjectsContainer* objects, Stock* stock, int imageIndex)
   : m_stockId(objects->addObject(stock))
   , m_imageIndex(imageIndex)
+  , m_imageId(objects->addObject(stock->getImage(imageIndex)))
+  , m_tiles(TileStore::fromObjects(objects), stock->getImage(imageIndex))
 {
-  Image* image = stock->getImage(imageIndex);
-
-  write_object(objects, m_stream, image, raster::write_image);
+  // The image will be re-added with the same ID in revert().
+  objects->removeObject(m_imageId);
 }
 
 void ReplaceImage::dispose()
@@ -52,8 +52,10 @@ void ReplaceImage::revert(ObjectsContainer* objects, UndoersCollector* redoers)
 {
   Stock* stock = objects->getObjectT<Stock>(m_stockId);
 
-  // Read the image to be restored from the stream
-  Image* image = read_object<Image>(objects, m_stream, raster::read_image);
+  // Create the image to be restored with the same ID it had
+  base::UniquePtr<Image> newImage(m_tiles.createImage());
+  objects->insertObject(m_imageId, newImage);
+  Image* image = newImage.release();
 
   // Save the current image in the redoers
   redoers->pushUndoer(new ReplaceImage(objects, stock, m_imageIndex));
@@ -20,11 +20,10 @@
 #define APP_UNDOERS_REPLACE_IMAGE_H_INCLUDED
 #pragma once
 
+#include "app/undoers/tile_store.h"
 #include "app/undoers/undoer_base.h"
 #include "undo/object_id.h"
 
-#include <sstream>
-
 namespace raster {
   class Stock;
 }
@@ -39,17 +38,15 @@ namespace app {
       ReplaceImage(ObjectsContainer* objects, Stock* stock, int imageIndex);
 
       void dispose() override;
-      size_t getMemSize() const override { return sizeof(*this) + getStreamSize(); }
+      size_t getMemSize() const override { return sizeof(*this) + m_tiles.getMemSize(); }
+      bool spill() override { return m_tiles.spill(); }
       void revert(ObjectsContainer* objects, UndoersCollector* redoers) override;
 
     private:
-      size_t getStreamSize() const {
-        return const_cast<std::stringstream*>(&m_stream)->tellp();
-      }
-
       ObjectId m_stockId;
       uint32_t m_imageIndex;
-      std::stringstream m_stream;
+      ObjectId m_imageId;
+      ImageTiles m_tiles;
     };
 
   } // namespace undoers
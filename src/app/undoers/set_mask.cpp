@@ -38,8 +38,11 @@ SetMask::SetMask(ObjectsContainer* objects, Document* document)
   : m_documentId(objects->addObject(document))
   , m_isMaskVisible(document->isMaskVisible())
 {
-  if (m_isMaskVisible)
-    raster::write_mask(m_stream, document->mask());
+  if (m_isMaskVisible) {
+    std::stringstream stream;
+    raster::write_mask(stream, document->mask());
+    m_data.compress(stream);
+  }
 }
 
 void SetMask::dispose()
@@ -55,7 +58,9 @@ void SetMask::revert(ObjectsContainer* objects, UndoersCollector* redoers)
   redoers->pushUndoer(new SetMask(objects, document));
 
   if (m_isMaskVisible) {
-    base::UniquePtr<Mask> mask(raster::read_mask(m_stream));
+    std::stringstream stream;
+    m_data.decompress(stream);
+    base::UniquePtr<Mask> mask(raster::read_mask(stream));
 
     document->setMask(mask);
 
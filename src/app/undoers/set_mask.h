@@ -20,11 +20,10 @@
 #define APP_UNDOERS_SET_MASK_H_INCLUDED
 #pragma once
 
+#include "app/undoers/compressed_data.h"
 #include "app/undoers/undoer_base.h"
 #include "undo/object_id.h"
 
-#include <sstream>
-
 namespace app {
   class Document;
   
@@ -35,17 +34,14 @@ namespace app {
       SetMask(undo::ObjectsContainer* objects, Document* document);
 
       void dispose() override;
-      size_t getMemSize() const override { return sizeof(*this) + getStreamSize(); }
+      size_t getMemSize() const override { return sizeof(*this) + m_data.size(); }
+      bool spill() override { return m_data.spill(); }
       void revert(undo::ObjectsContainer* objects, undo::UndoersCollector* redoers) override;
 
     private:
-      size_t getStreamSize() const {
-        return const_cast<std::stringstream*>(&m_stream)->tellp();
-      }
-
       undo::ObjectId m_documentId;
       bool m_isMaskVisible;
-      std::stringstream m_stream;
+      CompressedData m_data;
     };
 
   } // namespace undoers
@@ -0,0 +1,130 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/undoers/spill_file.h"
+
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "undo/undo_exception.h"
+
+namespace app {
+namespace undoers {
+
+using namespace undo;
+
+// The file doesn't grow more than this (offsets must fit in a long
+// in all platforms).
+static const long max_spill_file_size = 1024*1024*1024;
+
+static SpillFilePtr current_spill_file;
+
+SpillFile::SpillFile(const std::string& filename)
+  : m_filename(filename)
+  , m_file(NULL)
+  , m_end(0)
+  , m_usedBytes(0)
+  , m_closed(false)
+{
+}
+
+SpillFile::~SpillFile()
+{
+  close();
+}
+
+// static
+SpillFilePtr SpillFile::current()
+{
+  return current_spill_file;
+}
+
+// static
+void SpillFile::setCurrent(const SpillFilePtr& file)
+{
+  current_spill_file = file;
+}
+
+bool SpillFile::write(const uint8_t* data, size_t size, long& pos)
+{
+  if (m_closed || size > size_t(max_spill_file_size - m_end))
+    return false;
+
+  // The file is created the first time it's needed.
+  if (!m_file) {
+    m_file = base::open_file_raw(m_filename, "w+b");
+    if (!m_file)
+      return false;
+    m_end = 0;
+  }
+
+  // In case of error the next write overwrites the partial data.
+  if (fseek(m_file, m_end, SEEK_SET) != 0 ||
+      fwrite(data, 1, size, m_file) != size)
+    return false;
+
+  pos = m_end;
+  m_end += long(size);
+  m_usedBytes += size;
+  return true;
+}
+
+void SpillFile::read(long pos, uint8_t* data, size_t size)
+{
+  if (!m_file ||
+      fflush(m_file) != 0 ||
+      fseek(m_file, pos, SEEK_SET) != 0 ||
+      fread(data, 1, size, m_file) != size)
+    throw UndoException("Error reading undo data from disk");
+}
+
+void SpillFile::release(size_t size)
+{
+  ASSERT(m_usedBytes >= size);
+  m_usedBytes -= size;
+
+  // All the data was released, so the file can be truncated.
+  if (m_usedBytes == 0 && m_file) {
+    fclose(m_file);
+    m_file = base::open_file_raw(m_filename, "w+b");
+    m_end = 0;
+  }
+}
+
+void SpillFile::close()
+{
+  m_closed = true;
+
+  if (m_file) {
+    fclose(m_file);
+    m_file = NULL;
+
+    try {
+      base::delete_file(m_filename);
+    }
+    catch (...) {
+      // Ignore errors deleting the file.
+    }
+  }
+}
+
+} // namespace undoers
+} // namespace app
@@ -0,0 +1,76 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef APP_UNDOERS_SPILL_FILE_H_INCLUDED
+#define APP_UNDOERS_SPILL_FILE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/shared_ptr.h"
+
+#include <cstdio>
+#include <string>
+
+namespace app {
+  namespace undoers {
+
+    class SpillFile;
+    typedef SharedPtr<SpillFile> SpillFilePtr;
+
+    // Append-only file where the data of the oldest undoers is moved
+    // when the undo history uses more memory than the limit. Undoers
+    // keep a reference to the file while their data is there. The
+    // file is truncated when all its data was released.
+    class SpillFile {
+    public:
+      SpillFile(const std::string& filename);
+      ~SpillFile();
+
+      // File used to move the data of undoers (NULL if there is no
+      // one, so the oldest undoers are discarded).
+      static SpillFilePtr current();
+      static void setCurrent(const SpillFilePtr& file);
+
+      // Appends the given data at the end of the file. Returns false
+      // if the data cannot be written (e.g. the file is too big).
+      bool write(const uint8_t* data, size_t size, long& pos);
+
+      // Reads data written with write(). Throws an UndoException in
+      // case of error.
+      void read(long pos, uint8_t* data, size_t size);
+
+      // Marks "size" bytes of the file as unused.
+      void release(size_t size);
+
+      // Closes and deletes the file, the data cannot be read anymore.
+      void close();
+
+    private:
+      std::string m_filename;
+      FILE* m_file;
+      long m_end;
+      size_t m_usedBytes;
+      bool m_closed;
+
+      DISABLE_COPYING(SpillFile);
+    };
+
+  } // namespace undoers
+} // namespace app
+
+#endif  // UNDOERS_SPILL_FILE_H_INCLUDED
@@ -0,0 +1,338 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/undoers/tile_store.h"
+
+#include "app/objects_container_impl.h"
+#include "raster/image.h"
+#include "undo/undo_exception.h"
+
+#include "zlib.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace app {
+namespace undoers {
+
+using namespace undo;
+
+// Deflate/inflate streams are initialized once, and reset for each
+// tile (initializing a stream is more expensive than compressing a
+// small tile).
+class TileStore::Zlib {
+public:
+  Zlib() {
+    memset(&m_deflate, 0, sizeof(m_deflate));
+    memset(&m_inflate, 0, sizeof(m_inflate));
+
+    if (deflateInit(&m_deflate, Z_BEST_SPEED) != Z_OK)
+      throw UndoException("Error initializing zlib");
+
+    if (inflateInit(&m_inflate) != Z_OK) {
+      deflateEnd(&m_deflate);
+      throw UndoException("Error initializing zlib");
+    }
+  }
+
+  ~Zlib() {
+    deflateEnd(&m_deflate);
+    inflateEnd(&m_inflate);
+  }
+
+  // Returns false if the data cannot be compressed.
+  bool compress(const uint8_t* data, size_t size, std::vector<uint8_t>& output) {
+    m_buffer.resize(deflateBound(&m_deflate, size));
+
+    deflateReset(&m_deflate);
+    m_deflate.next_in = (Bytef*)data;
+    m_deflate.avail_in = size;
+    m_deflate.next_out = &m_buffer[0];
+    m_deflate.avail_out = m_buffer.size();
+
+    if (deflate(&m_deflate, Z_FINISH) != Z_STREAM_END ||
+        m_deflate.total_out >= size)
+      return false;
+
+    output.assign(m_buffer.begin(), m_buffer.begin()+m_deflate.total_out);
+    return true;
+  }
+
+  void decompress(const std::vector<uint8_t>& input, uint8_t* data, size_t size) {
+    inflateReset(&m_inflate);
+    m_inflate.next_in = (Bytef*)&input[0];
+    m_inflate.avail_in = input.size();
+    m_inflate.next_out = data;
+    m_inflate.avail_out = size;
+
+    if (inflate(&m_inflate, Z_FINISH) != Z_STREAM_END ||
+        m_inflate.total_out != size)
+      throw UndoException("Error decompressing undo data");
+  }
+
+private:
+  z_stream m_deflate;
+  z_stream m_inflate;
+  std::vector<uint8_t> m_buffer;
+};
+
+TileStore::TileStore()
+  : m_memSize(0)
+  , m_zlib(new Zlib)
+{
+}
+
+TileStore::~TileStore()
+{
+  // All tiles should be released by their snapshots.
+  ASSERT(m_tiles.empty());
+
+  for (Tiles::iterator it=m_tiles.begin(), end=m_tiles.end(); it!=end; ++it)
+    deleteTile(it->second);
+}
+
+// static
+TileStore* TileStore::fromObjects(ObjectsContainer* objects)
+{
+  // ObjectsContainerImpl is the container used by all documents.
+  return static_cast<ObjectsContainerImpl*>(objects)->tileStore();
+}
+
+// static
+uint64_t TileStore::hash(const uint8_t* data, size_t size)
+{
+  // FNV-1a processing 32-bit words.
+  uint64_t hash = 14695981039346656037ull;
+  size_t i = 0;
+
+  for (; i+4 <= size; i += 4) {
+    uint32_t word;
+    memcpy(&word, data+i, 4);
+    hash = (hash ^ word) * 1099511628211ull;
+  }
+  for (; i<size; ++i)
+    hash = (hash ^ data[i]) * 1099511628211ull;
+
+  return hash;
+}
+
+Tile* TileStore::addTile(ImageTiles* snapshot, const uint8_t* data, size_t size)
+{
+  uint64_t hash = TileStore::hash(data, size);
+  std::vector<uint8_t> pixels;
+
+  // Look for a tile with the same pixels.
+  std::pair<Tiles::iterator, Tiles::iterator> range = m_tiles.equal_range(hash);
+  for (Tiles::iterator it=range.first; it!=range.second; ++it) {
+    Tile* tile = it->second;
+    if (tile->m_rawSize != size)
+      continue;
+
+    pixels.resize(size);
+    readTile(tile, &pixels[0]);
+
+    if (memcmp(&pixels[0], data, size) == 0) {
+      // Tiles of a snapshot are added all together, so other
+      // references of this snapshot can only be in the last holder.
+      if (tile->m_holders.back().snapshot == snapshot)
+        ++tile->m_holders.back().refs;
+      else
+        tile->m_holders.push_back(Tile::Holder(snapshot));
+      return tile;
+    }
+  }
+
+  base::UniquePtr<Tile> tile(new Tile(hash));
+  tile->m_rawSize = size;
+  tile->m_compressed = m_zlib->compress(data, size, tile->m_data);
+  if (!tile->m_compressed)
+    tile->m_data.assign(data, data+size);
+
+  tile->m_holders.push_back(Tile::Holder(snapshot));
+  m_tiles.insert(std::make_pair(hash, tile.get()));
+
+  m_memSize += tile->getMemSize();
+  snapshot->m_memSize += tile->getMemSize();
+  return tile.release();
+}
+
+void TileStore::releaseTile(ImageTiles* snapshot, Tile* tile)
+{
+  Tile::Holders& holders = tile->m_holders;
+  Tile::Holders::iterator holder = holders.begin();
+  while (holder != holders.end() && holder->snapshot != snapshot)
+    ++holder;
+
+  ASSERT(holder != holders.end());
+  if (holder == holders.end() || --holder->refs > 0)
+    return;
+
+  bool charged = (holder == holders.begin());
+  holders.erase(holder);
+  if (!charged)
+    return;
+
+  snapshot->m_memSize -= tile->getMemSize();
+
+  // Charge the tile to the next snapshot that uses it.
+  if (!holders.empty()) {
+    holders.front().snapshot->m_memSize += tile->getMemSize();
+    return;
+  }
+
+  std::pair<Tiles::iterator, Tiles::iterator> range = m_tiles.equal_range(tile->m_hash);
+  for (Tiles::iterator it=range.first; it!=range.second; ++it) {
+    if (it->second == tile) {
+      m_tiles.erase(it);
+      break;
+    }
+  }
+
+  m_memSize -= tile->getMemSize();
+  deleteTile(tile);
+}
+
+void TileStore::readTile(const Tile* tile, uint8_t* data)
+{
+  // Read the data back from the spill file.
+  std::vector<uint8_t> spilledData;
+  if (tile->m_spillFile) {
+    spilledData.resize(tile->m_spillSize);
+    tile->m_spillFile->read(tile->m_spillPos, &spilledData[0], tile->m_spillSize);
+  }
+  const std::vector<uint8_t>& src = (tile->m_spillFile ? spilledData: tile->m_data);
+
+  if (tile->m_compressed)
+    m_zlib->decompress(src, data, tile->m_rawSize);
+  else
+    std::copy(src.begin(), src.end(), data);
+}
+
+bool TileStore::spillTile(ImageTiles* snapshot, Tile* tile)
+{
+  if (tile->m_holders.front().snapshot != snapshot ||
+      tile->m_spillFile || tile->m_data.empty())
+    return false;
+
+  SpillFilePtr file = SpillFile::current();
+  if (!file || !file->write(&tile->m_data[0], tile->m_data.size(), tile->m_spillPos))
+    return false;
+
+  tile->m_spillFile = file;
+  tile->m_spillSize = tile->m_data.size();
+  std::vector<uint8_t>().swap(tile->m_data);
+
+  m_memSize -= tile->m_spillSize;
+  snapshot->m_memSize -= tile->m_spillSize;
+  return true;
+}
+
+void TileStore::deleteTile(Tile* tile)
+{
+  if (tile->m_spillFile)
+    tile->m_spillFile->release(tile->m_spillSize);
+
+  delete tile;
+}
+
+ImageTiles::ImageTiles(TileStore* store, const Image* image)
+  : m_store(store)
+  , m_format(image->pixelFormat())
+  , m_width(image->width())
+  , m_height(image->height())
+  , m_maskColor(image->maskColor())
+  , m_memSize(0)
+{
+  const int tileSize = TileStore::TileSize;
+  std::vector<uint8_t> data;
+
+  try {
+    for (int y=0; y<m_height; y+=tileSize) {
+      for (int x=0; x<m_width; x+=tileSize) {
+        int w = MIN(tileSize, m_width-x);
+        int h = MIN(tileSize, m_height-y);
+        int rowSize = image->getRowStrideSize(w);
+
+        data.resize(rowSize*h);
+        for (int v=0; v<h; ++v) {
+          const uint8_t* addr = image->getPixelAddress(x, y+v);
+          std::copy(addr, addr+rowSize, data.begin()+v*rowSize);
+        }
+
+        m_tiles.push_back(m_store->addTile(this, &data[0], data.size()));
+      }
+    }
+  }
+  catch (...) {
+    for (size_t i=0; i<m_tiles.size(); ++i)
+      m_store->releaseTile(this, m_tiles[i]);
+    throw;
+  }
+}
+
+ImageTiles::~ImageTiles()
+{
+  for (size_t i=0; i<m_tiles.size(); ++i)
+    m_store->releaseTile(this, m_tiles[i]);
+}
+
+bool ImageTiles::spill()
+{
+  bool spilled = false;
+
+  for (size_t i=0; i<m_tiles.size(); ++i) {
+    if (m_store->spillTile(this, m_tiles[i]))
+      spilled = true;
+  }
+
+  return spilled;
+}
+
+Image* ImageTiles::createImage() const
+{
+  const int tileSize = TileStore::TileSize;
+  base::UniquePtr<Image> image(Image::create(m_format, m_width, m_height));
+  std::vector<uint8_t> data;
+  int i = 0;
+
+  for (int y=0; y<m_height; y+=tileSize) {
+    for (int x=0; x<m_width; x+=tileSize, ++i) {
+      int w = MIN(tileSize, m_width-x);
+      int h = MIN(tileSize, m_height-y);
+      int rowSize = image->getRowStrideSize(w);
+
+      data.resize(rowSize*h);
+      m_store->readTile(m_tiles[i], &data[0]);
+
+      for (int v=0; v<h; ++v) {
+        uint8_t* addr = image->getPixelAddress(x, y+v);
+        std::copy(data.begin()+v*rowSize, data.begin()+(v+1)*rowSize, addr);
+      }
+    }
+  }
+
+  image->setMaskColor(m_maskColor);
+  return image.release();
+}
+
+} // namespace undoers
+} // namespace app
@@ -0,0 +1,179 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef APP_UNDOERS_TILE_STORE_H_INCLUDED
+#define APP_UNDOERS_TILE_STORE_H_INCLUDED
+#pragma once
+
+#include "app/undoers/spill_file.h"
+#include "base/disable_copying.h"
+#include "base/unique_ptr.h"
+#include "raster/color.h"
+#include "raster/pixel_format.h"
+
+#include <map>
+#include <vector>
+
+namespace raster {
+  class Image;
+}
+
+namespace undo {
+  class ObjectsContainer;
+}
+
+namespace app {
+  namespace undoers {
+    using namespace raster;
+
+    class ImageTiles;
+    class TileStore;
+
+    // Pixels of a tile of an image (compressed with zlib). The same
+    // tile can be used by several snapshots.
+    class Tile {
+    public:
+      // Size of the tile in memory (without the pixels if they were
+      // moved to the spill file).
+      size_t getMemSize() const { return sizeof(*this) + m_data.size(); }
+
+    private:
+      friend class TileStore;
+
+      // A snapshot that uses this tile "refs" times.
+      struct Holder {
+        ImageTiles* snapshot;
+        int refs;
+        Holder(ImageTiles* snapshot) : snapshot(snapshot), refs(1) { }
+      };
+      typedef std::vector<Holder> Holders;
+
+      Tile(uint64_t hash) : m_hash(hash), m_rawSize(0), m_compressed(false)
+                          , m_spillPos(0), m_spillSize(0) { }
+
+      uint64_t m_hash;
+      size_t m_rawSize;
+      bool m_compressed;
+      std::vector<uint8_t> m_data;
+
+      // Snapshots using this tile, in the order they were added. The
+      // memory of the tile is charged to the first one.
+      Holders m_holders;
+
+      // Location of the data in the spill file.
+      SpillFilePtr m_spillFile;
+      long m_spillPos;
+      size_t m_spillSize;
+    };
+
+    // Content-addressed storage of tiles of images for the undo
+    // history of a document. Tiles are identified by the hash of
+    // their pixels, so equal parts of images saved by different
+    // undoers (e.g. an image before and after rotating it twice) are
+    // stored only once.
+    class TileStore {
+    public:
+      enum { TileSize = 32 };
+
+      TileStore();
+      ~TileStore();
+
+      // Returns the tile store used by the undoers of the given
+      // container of objects.
+      static TileStore* fromObjects(undo::ObjectsContainer* objects);
+
+      // Hash used to identify tiles with the same pixels.
+      static uint64_t hash(const uint8_t* data, size_t size);
+
+      // Returns a tile with the given pixels (a new one, or a tile
+      // with the same pixels already stored) referenced by the given
+      // snapshot. Each call must be balanced with a call to
+      // releaseTile().
+      Tile* addTile(ImageTiles* snapshot, const uint8_t* data, size_t size);
+
+      // Removes a reference of the snapshot to the tile. If the memory
+      // of the tile was charged to the snapshot, it's charged to the
+      // next snapshot that uses the tile, or the tile is deleted.
+      void releaseTile(ImageTiles* snapshot, Tile* tile);
+
+      // Copies the pixels of the tile in "data".
+      void readTile(const Tile* tile, uint8_t* data);
+
+      // Moves the pixels of the tile to the current SpillFile if the
+      // tile is charged to the given snapshot. Returns false if the
+      // tile wasn't moved.
+      bool spillTile(ImageTiles* snapshot, Tile* tile);
+
+      // Number of different tiles and memory used by all of them.
+      size_t countTiles() const { return m_tiles.size(); }
+      size_t getMemSize() const { return m_memSize; }
+
+    private:
+      class Zlib;
+      typedef std::multimap<uint64_t, Tile*> Tiles;
+
+      void deleteTile(Tile* tile);
+
+      Tiles m_tiles;
+      size_t m_memSize;
+
+      // zlib streams reused for all tiles.
+      base::UniquePtr<Zlib> m_zlib;
+
+      DISABLE_COPYING(TileStore);
+    };
+
+    // Snapshot of an image saved in tiles of a TileStore.
+    class ImageTiles {
+    public:
+      ImageTiles(TileStore* store, const Image* image);
+      ~ImageTiles();
+
+      // Memory used by the tiles charged to this snapshot. Each tile
+      // is charged to only one of the snapshots that use it, so the
+      // undo history counts shared tiles once. The value changes when
+      // other snapshots that share tiles with this one are destroyed
+      // or spilled.
+      size_t getMemSize() const {
+        return m_memSize + m_tiles.size()*sizeof(Tile*);
+      }
+
+      // Moves the tiles charged to this snapshot to the spill file.
+      bool spill();
+
+      // Creates a new image with the saved pixels.
+      Image* createImage() const;
+
+    private:
+      friend class TileStore;
+
+      TileStore* m_store;
+      PixelFormat m_format;
+      int m_width;
+      int m_height;
+      color_t m_maskColor;
+      std::vector<Tile*> m_tiles;
+      size_t m_memSize;
+
+      DISABLE_COPYING(ImageTiles);
+    };
+
+  } // namespace undoers
+} // namespace app
+
+#endif  // UNDOERS_TILE_STORE_H_INCLUDED
@@ -0,0 +1,182 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "app/undoers/tile_store.h"
+#include "base/unique_ptr.h"
+#include "raster/image.h"
+#include "raster/primitives.h"
+
+#include <cstring>
+
+using namespace app::undoers;
+using namespace raster;
+
+static void expect_same_pixels(const Image* a, const Image* b)
+{
+  ASSERT_EQ(a->pixelFormat(), b->pixelFormat());
+  ASSERT_EQ(a->width(), b->width());
+  ASSERT_EQ(a->height(), b->height());
+  EXPECT_EQ(a->maskColor(), b->maskColor());
+
+  for (int y=0; y<a->height(); ++y)
+    for (int x=0; x<a->width(); ++x)
+      ASSERT_EQ(get_pixel(a, x, y), get_pixel(b, x, y)) << x << "," << y;
+}
+
+TEST(TileStore, Hash)
+{
+  uint8_t a[7] = { 1, 2, 3, 4, 5, 6, 7 };
+  uint8_t b[7];
+  memcpy(b, a, sizeof(a));
+
+  EXPECT_EQ(TileStore::hash(a, sizeof(a)), TileStore::hash(b, sizeof(b)));
+
+  // Changes in words and in the trailing bytes
+  b[1] = 0;
+  EXPECT_NE(TileStore::hash(a, sizeof(a)), TileStore::hash(b, sizeof(b)));
+  b[1] = a[1];
+  b[6] = 0;
+  EXPECT_NE(TileStore::hash(a, sizeof(a)), TileStore::hash(b, sizeof(b)));
+
+  // Same data with different size
+  EXPECT_NE(TileStore::hash(a, 4), TileStore::hash(a, 5));
+}
+
+TEST(TileStore, RestoreImages)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP };
+
+  for (int i=0; i<int(sizeof(formats)/sizeof(formats[0])); ++i) {
+    base::UniquePtr<Image> image(Image::create(formats[i], 77, 45));
+    int mask = (formats[i] == IMAGE_BITMAP ? 1: 0xff);
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x)
+        put_pixel(image, x, y, (x*7 + y*13) & mask);
+    image->setMaskColor(1);
+
+    TileStore store;
+    ImageTiles tiles(&store, image);
+    base::UniquePtr<Image> restored(tiles.createImage());
+    expect_same_pixels(image, restored);
+  }
+}
+
+TEST(TileStore, SameTilesAreStoredOnce)
+{
+  TileStore store;
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 256, 256));
+  clear_image(image, 0);
+
+  // All tiles of the image are equal
+  ImageTiles a(&store, image);
+  EXPECT_EQ(1u, store.countTiles());
+
+  put_pixel(image, 100, 100, 1);
+  ImageTiles b(&store, image);
+  EXPECT_EQ(2u, store.countTiles());
+
+  ImageTiles c(&store, image);
+  EXPECT_EQ(2u, store.countTiles());
+
+  base::UniquePtr<Image> restored(b.createImage());
+  expect_same_pixels(image, restored);
+}
+
+TEST(TileStore, TilesAreReleasedWithTheLastSnapshot)
+{
+  TileStore store;
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 64, 64));
+  clear_image(image, 0);
+
+  base::UniquePtr<ImageTiles> a(new ImageTiles(&store, image));
+  put_pixel(image, 0, 0, 1);
+  base::UniquePtr<ImageTiles> b(new ImageTiles(&store, image));
+  base::UniquePtr<ImageTiles> c(new ImageTiles(&store, image));
+  EXPECT_EQ(2u, store.countTiles());
+
+  b.reset();
+  EXPECT_EQ(2u, store.countTiles());
+
+  // The tile with the modified pixel is still used by "c"
+  a.reset();
+  EXPECT_EQ(2u, store.countTiles());
+
+  put_pixel(image, 0, 0, 0);
+  base::UniquePtr<Image> restored(c->createImage());
+  EXPECT_EQ(1, get_pixel(restored, 0, 0));
+
+  c.reset();
+  EXPECT_EQ(0u, store.countTiles());
+  EXPECT_EQ(0u, store.getMemSize());
+}
+
+TEST(TileStore, SharedTilesAreChargedOnce)
+{
+  TileStore store;
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 128, 128));
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image, x, y, x*y);
+
+  base::UniquePtr<ImageTiles> a(new ImageTiles(&store, image));
+  base::UniquePtr<ImageTiles> b(new ImageTiles(&store, image));
+  size_t pointers = 16 * sizeof(Tile*);
+
+  EXPECT_EQ(store.getMemSize() + pointers, a->getMemSize());
+  EXPECT_EQ(pointers, b->getMemSize());
+
+  // The tiles are charged to "b" when "a" is deleted
+  a.reset();
+  EXPECT_EQ(store.getMemSize() + pointers, b->getMemSize());
+}
+
+TEST(TileStore, SpillTiles)
+{
+  SpillFilePtr file(new SpillFile("tile_store_tests.spill"));
+  SpillFile::setCurrent(file);
+
+  TileStore store;
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 100, 100));
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image, x, y, x+y);
+
+  base::UniquePtr<ImageTiles> a(new ImageTiles(&store, image));
+  base::UniquePtr<ImageTiles> b(new ImageTiles(&store, image));
+  size_t oldSize = a->getMemSize();
+
+  // Only the snapshot charged with the tiles can spill them
+  EXPECT_FALSE(b->spill());
+  EXPECT_TRUE(a->spill());
+  EXPECT_LT(a->getMemSize(), oldSize);
+  EXPECT_FALSE(a->spill());
+
+  base::UniquePtr<Image> restored(b->createImage());
+  expect_same_pixels(image, restored);
+
+  // Equal tiles are found in the spill file
+  size_t tiles = store.countTiles();
+  ImageTiles c(&store, image);
+  EXPECT_EQ(tiles, store.countTiles());
+
+  a.reset();
+  b.reset();
+  SpillFile::setCurrent(SpillFilePtr());
+}
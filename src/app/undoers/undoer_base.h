@@ -29,6 +29,7 @@ namespace app {
     // revert(), getMemSize(), and dispose() methods only.
     class UndoerBase : public undo::Undoer {
     public:
+      bool spill() override { return false; }
       undo::Modification getModification() const override { return undo::DoesntModifyDocument; }
       bool isOpenGroup() const override { return false; }
       bool isCloseGroup() const override { return false; }
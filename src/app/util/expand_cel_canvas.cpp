@@ -127,15 +127,24 @@ ExpandCelCanvas::ExpandCelCanvas(DocumentLocation location,
   }
 
   // create two copies of the image region which we'll modify with the tool
-  m_srcImage = crop_image(m_celImage,
-    bounds.x - celBounds.x,
-    bounds.y - celBounds.y,
-    bounds.w,
-    bounds.h,
-    m_sprite->transparentColor(),
-    src_buffer);
-
-  m_dstImage = Image::createCopy(m_srcImage, dst_buffer);
+  if (bounds == celBounds) {
+    // The cel doesn't need to be expanded, so both copies can share
+    // the pixels of the cel image (the m_dstImage pixels will be
+    // copied only when the tool modifies it for the first time).
+    m_srcImage = Image::createCopy(m_celImage);
+    m_dstImage = Image::createCopy(m_srcImage);
+  }
+  else {
+    m_srcImage = crop_image(m_celImage,
+      bounds.x - celBounds.x,
+      bounds.y - celBounds.y,
+      bounds.w,
+      bounds.h,
+      m_sprite->transparentColor(),
+      src_buffer);
+
+    m_dstImage = Image::createCopy(m_srcImage, dst_buffer);
+  }
 
   // We have to adjust the cel position to match the m_dstImage
   // position (the new m_dstImage will be used in RenderEngine to
@@ -233,7 +242,8 @@ void ExpandCelCanvas::commit(const gfx::Rect& bounds)
     }
 
     // Replace the image in the stock. We need to create a copy of
-    // image because m_dstImage's ImageBuffer cannot be shared.
+    // image because m_dstImage can be using an external ImageBuffer
+    // (in other case the copy just shares its pixels).
     m_sprite->stock()->replaceImage(m_cel->imageIndex(),
       Image::createCopy(m_dstImage));
 
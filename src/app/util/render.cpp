@@ -25,92 +25,119 @@
 #include "app/color_utils.h"
 #include "app/document.h"
 #include "app/ini_file.h"
+#include "app/util/render_cache.h"
+#include "base/thread_pool.h"
+#include "base/unique_ptr.h"
+#include "raster/blend_rows.h"
 #include "raster/raster.h"
 #include "app/settings/document_settings.h"
 #include "app/settings/settings.h"
 #include "app/ui_context.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 //////////////////////////////////////////////////////////////////////
 // Zoomed merge
 
-template<class DstTraits, class SrcTraits>
-class BlenderHelper
+// Rows of the source image converted to RGBA to be blended with
+// rgba_blend_row().
+template<class SrcTraits>
+class FrontRow;
+
+template<>
+class FrontRow<RgbTraits>
 {
-  BLEND_COLOR m_blend_color;
-  uint32_t m_mask_color;
+  int m_blend_mode;
+  color_t m_mask_color;
 public:
-  BlenderHelper(const Image* src, const Palette* pal, int blend_mode)
+  FrontRow(const Image* src, const Palette* pal, int blend_mode, int width)
   {
-    m_blend_color = SrcTraits::get_blender(blend_mode);
+    m_blend_mode = blend_mode;
     m_mask_color = src->maskColor();
   }
-  inline void operator()(typename DstTraits::pixel_t& scanline,
-                         const typename DstTraits::pixel_t& dst,
-                         const typename SrcTraits::pixel_t& src,
-                         int opacity)
+  int blendMode() const { return m_blend_mode; }
+  color_t maskColor() const { return m_mask_color; }
+  const color_t* operator()(const RgbTraits::pixel_t* src, int n)
   {
-    if (src != m_mask_color)
-      scanline = (*m_blend_color)(dst, src, opacity);
-    else
-      scanline = dst;
+    return src;
   }
 };
 
 template<>
-class BlenderHelper<RgbTraits, GrayscaleTraits>
+class FrontRow<GrayscaleTraits>
 {
-  BLEND_COLOR m_blend_color;
-  uint32_t m_mask_color;
+  int m_blend_mode;
+  color_t m_mask_color;
+  std::vector<color_t> m_row;
 public:
-  BlenderHelper(const Image* src, const Palette* pal, int blend_mode)
+  FrontRow(const Image* src, const Palette* pal, int blend_mode, int width)
+    : m_row(width)
   {
-    m_blend_color = RgbTraits::get_blender(blend_mode);
+    m_blend_mode = blend_mode;
     m_mask_color = src->maskColor();
   }
-  inline void operator()(RgbTraits::pixel_t& scanline,
-                         const RgbTraits::pixel_t& dst,
-                         const GrayscaleTraits::pixel_t& src,
-                         int opacity)
+  int blendMode() const { return m_blend_mode; }
+
+  // Gray pixels are converted to RGBA colors with equal r/g/b
+  // components, so masked pixels are marked with a color with
+  // different components.
+  color_t maskColor() const { return rgba(255, 0, 0, 0); }
+
+  const color_t* operator()(const GrayscaleTraits::pixel_t* src, int n)
   {
-    if (src != m_mask_color) {
-      int v = graya_getv(src);
-      scanline = (*m_blend_color)(dst, rgba(v, v, v, graya_geta(src)), opacity);
+    for (int x=0; x<n; ++x) {
+      if (src[x] != m_mask_color) {
+        int v = graya_getv(src[x]);
+        m_row[x] = rgba(v, v, v, graya_geta(src[x]));
+      }
+      else
+        m_row[x] = maskColor();
     }
-    else
-      scanline = dst;
+    return &m_row[0];
   }
 };
 
 template<>
-class BlenderHelper<RgbTraits, IndexedTraits>
+class FrontRow<IndexedTraits>
 {
   const Palette* m_pal;
   int m_blend_mode;
-  uint32_t m_mask_color;
+  color_t m_mask_color;
+  color_t m_rgba_mask_color;
+  std::vector<color_t> m_row;
 public:
-  BlenderHelper(const Image* src, const Palette* pal, int blend_mode)
+  FrontRow(const Image* src, const Palette* pal, int blend_mode, int width)
+    : m_row(width)
   {
-    m_blend_mode = blend_mode;
-    m_mask_color = src->maskColor();
+    // Indexed images are always blended as normal layers, except to
+    // copy them (in that case the mask color isn't used).
     m_pal = pal;
+    m_blend_mode = (blend_mode == BLEND_MODE_COPY ? BLEND_MODE_COPY: BLEND_MODE_NORMAL);
+    m_mask_color = (blend_mode == BLEND_MODE_COPY ? -1: src->maskColor());
+
+    // Masked pixels are marked with a color that isn't in the palette.
+    m_rgba_mask_color = 0;
+    for (int i=0; i<pal->size(); ++i) {
+      if (pal->getEntry(i) == m_rgba_mask_color) {
+        ++m_rgba_mask_color;
+        i = -1;
+      }
+    }
   }
-  inline void operator()(RgbTraits::pixel_t& scanline,
-                         const RgbTraits::pixel_t& dst,
-                         const IndexedTraits::pixel_t& src,
-                         int opacity)
+  int blendMode() const { return m_blend_mode; }
+  color_t maskColor() const { return m_rgba_mask_color; }
+  const color_t* operator()(const IndexedTraits::pixel_t* src, int n)
   {
-    if (m_blend_mode == BLEND_MODE_COPY) {
-      scanline = m_pal->getEntry(src);
-    }
-    else {
-      if (src != m_mask_color) {
-        scanline = rgba_blend_normal(dst, m_pal->getEntry(src), opacity);
-      }
+    for (int x=0; x<n; ++x) {
+      if (src[x] != m_mask_color)
+        m_row[x] = m_pal->getEntry(src[x]);
       else
-        scanline = dst;
+        m_row[x] = m_rgba_mask_color;
     }
+    return &m_row[0];
   }
 };
 
@@ -119,10 +146,12 @@ static void merge_zoomed_image(Image* dst, const Image* src, const Palette* pal,
                                int x, int y, int opacity,
                                int blend_mode, int zoom)
 {
-  BlenderHelper<DstTraits, SrcTraits> blender(src, pal, blend_mode);
+  typedef typename DstTraits::pixel_t dst_pixel_t;
+  typedef typename SrcTraits::pixel_t src_pixel_t;
+
   int src_x, src_y, src_w, src_h;
   int dst_x, dst_y, dst_w, dst_h;
-  int box_x, box_y, box_w, box_h;
+  int box_y, box_w, box_h;
   int first_box_w, first_box_h;
   int line_h, bottom;
 
@@ -176,49 +205,54 @@ static void merge_zoomed_image(Image* dst, const Image* src, const Palette* pal,
 
   bottom = dst_y+dst_h-1;
 
-  // the scanline variable is used to blend src/dst pixels one time for each pixel
-  typedef std::vector<typename DstTraits::pixel_t> Scanline;
-  Scanline scanline(src_w);
-  typename Scanline::iterator scanline_it;
-#ifdef _DEBUG
-  typename Scanline::iterator scanline_end = scanline.end();
-#endif
+  FrontRow<SrcTraits> front_row(src, pal, blend_mode, src_w);
+  int row_blend_mode = front_row.blendMode();
+  color_t row_mask_color = front_row.maskColor();
 
-  // Lock all necessary bits
-  const LockImageBits<SrcTraits> srcBits(src, gfx::Rect(src_x, src_y, src_w, src_h));
-  LockImageBits<DstTraits> dstBits(dst, gfx::Rect(dst_x, dst_y, dst_w, dst_h));
-  typename LockImageBits<SrcTraits>::const_iterator src_it = srcBits.begin();
-#ifdef _DEBUG
-  typename LockImageBits<SrcTraits>::const_iterator src_end = srcBits.end();
-#endif
-  typename LockImageBits<DstTraits>::iterator dst_it, dst_end;
+  // The scanline is used to blend src/dst pixels one time for each
+  // source pixel, then it's replicated in the whole zoomed box.
+  std::vector<dst_pixel_t> scanline(src_w);
 
   // For each line to draw of the source image...
-  for (y=0; y<src_h; ++y) {
-    dst_it = dstBits.begin_area(gfx::Rect(dst_x, dst_y, dst_w, 1));
-    dst_end = dstBits.end_area(gfx::Rect(dst_x, dst_y, dst_w, 1));
-
-    // Read 'src' and 'dst' and blend them, put the result in `scanline'
-    scanline_it = scanline.begin();
-    for (x=0; x<src_w; ++x) {
-      ASSERT(src_it >= srcBits.begin() && src_it < src_end);
-      ASSERT(dst_it >= dstBits.begin() && dst_it < dst_end);
-      ASSERT(scanline_it >= scanline.begin() && scanline_it < scanline_end);
-
-      blender(*scanline_it, *dst_it, *src_it, opacity);
-
-      ++src_it;
+  for (y=0; y<src_h; ++y, ++src_y) {
+    const src_pixel_t* src_row = (const src_pixel_t*)src->getPixelAddress(src_x, src_y);
+    dst_pixel_t* dst_row = (dst_pixel_t*)dst->getPixelAddress(dst_x, dst_y);
+
+    if (zoom == 0) {
+      // Blend 'src' and 'dst' directly, no replication is needed
+      rgba_blend_row(row_blend_mode, dst_row, dst_row, front_row(src_row, src_w),
+                     src_w, opacity, row_mask_color);
+    }
+    else {
+      // Blend each 'src' pixel with the first 'dst' pixel of its box,
+      // and put the result in 'scanline'
+      int n = 0;
+      for (int u=0; n<src_w && u<dst_w; ++n) {
+        scanline[n] = dst_row[u];
+        u += ((n == 0 && first_box_w > 0) ? first_box_w: box_w);
+      }
+      rgba_blend_row(row_blend_mode, &scanline[0], &scanline[0], front_row(src_row, n),
+                     n, opacity, row_mask_color);
 
-      int delta;
-      if ((x == 0) && (first_box_w > 0))
-        delta = first_box_w;
-      else
-        delta = box_w;
+      // Replicate each 'scanline' pixel in the first line of its box
+      // (the first and last boxes can be clipped)
+      dst_pixel_t* dst_ptr = dst_row;
+      dst_pixel_t* dst_end = dst_row + dst_w;
+      x = 0;
+      if (first_box_w > 0) {
+        int w = MIN(first_box_w, dst_w);
+        std::fill(dst_ptr, dst_ptr+w, scanline[0]);
+        dst_ptr += w;
+        x = 1;
+      }
 
-      while (dst_it != dst_end && delta-- > 0)
-        ++dst_it;
+      int boxes = MIN(n-x, int(dst_end - dst_ptr) / box_w);
+      rgba_zoom_row(dst_ptr, &scanline[x], boxes, box_w);
+      dst_ptr += boxes*box_w;
+      x += boxes;
 
-      ++scanline_it;
+      if (x < n && dst_ptr < dst_end)
+        std::fill(dst_ptr, dst_end, scanline[x]);
     }
 
     // Get the 'height' of the line to be painted in 'dst'
@@ -227,56 +261,18 @@ static void merge_zoomed_image(Image* dst, const Image* src, const Palette* pal,
     else
       line_h = box_h;
 
-    // Draw the line in 'dst'
-    for (box_y=0; box_y<line_h; ++box_y) {
-      dst_it = dstBits.begin_area(gfx::Rect(dst_x, dst_y, dst_w, 1));
-      dst_end = dstBits.end_area(gfx::Rect(dst_x, dst_y, dst_w, 1));
-      scanline_it = scanline.begin();
-
-      x = 0;
-
-      // first pixel
-      if (first_box_w > 0) {
-        for (box_x=0; box_x<first_box_w; ++box_x) {
-          ASSERT(scanline_it != scanline_end);
-          ASSERT(dst_it != dst_end);
-
-          *dst_it = *scanline_it;
-
-          ++dst_it;
-          if (dst_it == dst_end)
-            goto done_with_line;
-        }
-
-        ++scanline_it;
-        ++x;
-      }
-
-      // the rest of the line
-      for (; x<src_w; ++x) {
-        for (box_x=0; box_x<box_w; ++box_x) {
-          ASSERT(dst_it !=  dst_end);
-
-          *dst_it = *scanline_it;
-
-          ++dst_it;
-          if (dst_it == dst_end)
-            goto done_with_line;
-        }
-
-        ++scanline_it;
-      }
-
-done_with_line:;
+    // Copy the first line of the box in the rest of lines
+    for (box_y=1; box_y<line_h; ++box_y) {
       if (++dst_y > bottom)
-        goto done_with_blit;
+        return;
+
+      std::copy(dst_row, dst_row+dst_w,
+                (dst_pixel_t*)dst->getPixelAddress(dst_x, dst_y));
     }
 
-    // go to the next line in the source image
-    ++src_y;
+    if (++dst_y > bottom)
+      return;
   }
-
-done_with_blit:;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -287,7 +283,6 @@ static bool checked_bg_zoom;
 static app::Color checked_bg_color1;
 static app::Color checked_bg_color2;
 
-static int global_opacity = 255;
 static const Layer* selected_layer = NULL;
 static FrameNumber selected_frame(0);
 static Image* preview_image = NULL;
@@ -364,6 +359,7 @@ RenderEngine::RenderEngine(const Document* document,
   , m_sprite(sprite)
   , m_currentLayer(currentLayer)
   , m_currentFrame(currentFrame)
+  , m_cache(NULL)
 {
 }
 
@@ -375,6 +371,202 @@ void RenderEngine::setPreviewImage(const Layer* layer, FrameNumber frame, Image*
   preview_image = image;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Arbitrary zoom levels
+
+// Biggest box used to filter the sprite when it is zoomed out (bigger
+// boxes are too expensive and don't improve the result).
+static const int max_box_size = 16;
+
+// Gaps between sampled rows of the sprite smaller than this are
+// rendered with the sampled rows when the sprite is scaled.
+static const int min_skipped_rows = 4;
+
+// Returns the size of the box filter for the given zoom, i.e. the
+// biggest power of two that fits in one pixel of the zoomed image (1
+// when the sprite is zoomed in).
+static int box_size(const Zoom& zoom)
+{
+  int size = 1;
+  while (size < max_box_size && (size*2)*zoom.num() <= zoom.den())
+    size *= 2;
+  return size;
+}
+
+// Returns the sprite pixel (the top-left pixel of the box) sampled
+// for the given zoomed coordinate.
+static int sampled_pixel(const Zoom& zoom, int box, int x)
+{
+  x = zoom.remove(x);
+  return x - (((x % box) + box) % box);
+}
+
+// Returns the area of the sprite (at 100%) that is sampled to render
+// the given zoomed area.
+static gfx::Rect scaled_area(const Zoom& zoom,
+                             int source_x, int source_y,
+                             int width, int height)
+{
+  int box = box_size(zoom);
+  int x1 = sampled_pixel(zoom, box, source_x);
+  int y1 = sampled_pixel(zoom, box, source_y);
+  int x2 = sampled_pixel(zoom, box, source_x+width-1) + box;
+  int y2 = sampled_pixel(zoom, box, source_y+height-1) + box;
+  return gfx::Rect(x1, y1, x2-x1, y2-y1);
+}
+
+// Averages the given box of the image. Colors are weighted by their
+// alpha so transparent pixels don't darken the result.
+static uint32_t box_average(const Image* src, int x, int y, int size)
+{
+  int r = 0, g = 0, b = 0, a = 0;
+
+  for (int v=0; v<size; ++v) {
+    const uint32_t* row = (const uint32_t*)src->getPixelAddress(x, y+v);
+    for (int u=0; u<size; ++u, ++row) {
+      int ca = rgba_geta(*row);
+      r += rgba_getr(*row) * ca;
+      g += rgba_getg(*row) * ca;
+      b += rgba_getb(*row) * ca;
+      a += ca;
+    }
+  }
+
+  if (a == 0)
+    return 0;
+
+  return rgba(r / a, g / a, b / a, a / (size*size));
+}
+
+// Scales "src" (the sprite area located at src_x/src_y rendered at
+// 100%) to the rows [dst_y1, dst_y2) of "dst" (located at
+// source_x/source_y in the zoomed sprite). Only the sampled pixels
+// (or boxes of pixels when zooming out) of "src" are read. If "blend"
+// is true the scaled pixels are blended with the current content of
+// "dst".
+static void scale_image(Image* dst, const Image* src,
+                        int src_x, int src_y,
+                        int source_x, int source_y,
+                        int dst_y1, int dst_y2,
+                        const Zoom& zoom, bool blend)
+{
+  ASSERT(dst->pixelFormat() == IMAGE_RGB);
+  ASSERT(src->pixelFormat() == IMAGE_RGB);
+  ASSERT(dst_y1 >= 0 && dst_y2 <= dst->height());
+
+  int box = box_size(zoom);
+  int dst_w = dst->width();
+
+  std::vector<int> cols(dst_w);
+  for (int u=0; u<dst_w; ++u)
+    cols[u] = sampled_pixel(zoom, box, source_x+u) - src_x;
+
+  int prev_y = -1;
+  for (int v=dst_y1; v<dst_y2; ++v) {
+    int y = sampled_pixel(zoom, box, source_y+v) - src_y;
+    uint32_t* dst_row = (uint32_t*)dst->getPixelAddress(0, v);
+
+    // Same source row than the previous one (zoom in)
+    if (y == prev_y && !blend) {
+      const uint32_t* prev_row = (const uint32_t*)dst->getPixelAddress(0, v-1);
+      std::copy(prev_row, prev_row+dst_w, dst_row);
+      continue;
+    }
+    prev_y = y;
+
+    if (box == 1) {
+      const uint32_t* src_row = (const uint32_t*)src->getPixelAddress(0, y);
+      if (blend) {
+        for (int u=0; u<dst_w; ++u)
+          dst_row[u] = rgba_blend_normal_fast(dst_row[u], src_row[cols[u]], 255);
+      }
+      else {
+        for (int u=0; u<dst_w; ++u)
+          dst_row[u] = src_row[cols[u]];
+      }
+    }
+    else {
+      for (int u=0; u<dst_w; ++u) {
+        uint32_t c = box_average(src, cols[u], y, box);
+        dst_row[u] = (blend ? rgba_blend_normal_fast(dst_row[u], c, 255): c);
+      }
+    }
+  }
+}
+
+// Images are split in horizontal tiles (bands) of this height at
+// least, smaller tiles are not worth the extra threads.
+static const int min_tile_height = 32;
+
+struct RenderEngine::RenderContext {
+  FrameNumber frame;
+  int zoom;                     // Zoom used to blend layers (2^zoom)
+  ZoomedFunc zoomed_func;
+  bool checked_bg;
+  uint32_t bg_color;
+
+  // True if the sprite must be rendered at 100% and then scaled by
+  // "scale" (for zoom levels that aren't a power of two).
+  bool scaled;
+  Zoom scale;
+
+  // True if the checked background is drawn in the scaled image
+  // (i.e. its tiles aren't zoomed with the sprite).
+  bool screen_bg;
+
+  // True if the cache planes are used (see prepareCachedFrame()).
+  bool cached;
+
+  // Image to be used instead of the cel image of "preview_layer" in
+  // "preview_frame" (it's a copy of the state given in
+  // setPreviewImage() when the rendering started).
+  const Layer* preview_layer;
+  FrameNumber preview_frame;
+  Image* preview_image;
+
+  // Onion-skin frames to be drawn over the current frame.
+  struct OnionSkinFrame {
+    FrameNumber frame;
+    int opacity;
+    int blend_mode;
+  };
+  std::vector<OnionSkinFrame> onionskin;
+};
+
+// Renders one tile of the image in a temporary image and copies it
+// to the final destination (tiles don't overlap, so each thread
+// writes its own rows).
+class RenderEngine::RenderTile {
+public:
+  RenderTile(RenderEngine* engine, const RenderContext& ctx,
+             Image* image, int source_x, int source_y, int tile_h)
+    : m_engine(engine)
+    , m_ctx(&ctx)
+    , m_image(image)
+    , m_source_x(source_x)
+    , m_source_y(source_y)
+    , m_tile_h(tile_h) {
+  }
+
+  void operator()(int i) const {
+    int y = i*m_tile_h;
+    int h = MIN(m_tile_h, m_image->height() - y);
+    if (h <= 0)
+      return;
+
+    base::UniquePtr<Image> tile(Image::create(IMAGE_RGB, m_image->width(), h));
+    m_engine->renderArea(*m_ctx, tile, m_source_x, m_source_y+y);
+    copy_image(m_image, tile, 0, y);
+  }
+
+private:
+  RenderEngine* m_engine;
+  const RenderContext* m_ctx;
+  Image* m_image;
+  int m_source_x, m_source_y;
+  int m_tile_h;
+};
+
 /**
    Draws the @a frame of animation of the specified @a sprite
    in a new image and return it.
@@ -384,31 +576,49 @@ void RenderEngine::setPreviewImage(const Layer* layer, FrameNumber frame, Image*
  */
 Image* RenderEngine::renderSprite(int source_x, int source_y,
   int width, int height,
-  FrameNumber frame, int zoom,
+  FrameNumber frame, const Zoom& zoom,
   bool draw_tiled_bg,
   bool enable_onionskin,
   ImageBufferPtr& buffer)
 {
-  void (*zoomed_func)(Image*, const Image*, const Palette*, int, int, int, int, int);
   const LayerImage* background = m_sprite->backgroundLayer();
   bool need_checked_bg = (background != NULL ? !background->isReadable(): true);
-  uint32_t bg_color = 0;
+  RenderContext ctx;
   Image *image;
 
+  ctx.frame = frame;
+  ctx.zoom = zoom.shift();
+  ctx.checked_bg = (need_checked_bg && draw_tiled_bg);
+  ctx.bg_color = 0;
+  ctx.scaled = (ctx.zoom < 0);
+  ctx.scale = zoom;
+  ctx.screen_bg = false;
+
+  if (ctx.scaled) {
+    ctx.zoom = 0;
+    if (ctx.checked_bg && !checked_bg_zoom) {
+      ctx.checked_bg = false;
+      ctx.screen_bg = true;
+    }
+  }
+  ctx.preview_layer = selected_layer;
+  ctx.preview_frame = selected_frame;
+  ctx.preview_image = preview_image;
+
   switch (m_sprite->pixelFormat()) {
 
     case IMAGE_RGB:
-      zoomed_func = merge_zoomed_image<RgbTraits, RgbTraits>;
+      ctx.zoomed_func = merge_zoomed_image<RgbTraits, RgbTraits>;
       break;
 
     case IMAGE_GRAYSCALE:
-      zoomed_func = merge_zoomed_image<RgbTraits, GrayscaleTraits>;
+      ctx.zoomed_func = merge_zoomed_image<RgbTraits, GrayscaleTraits>;
       break;
 
     case IMAGE_INDEXED:
-      zoomed_func = merge_zoomed_image<RgbTraits, IndexedTraits>;
+      ctx.zoomed_func = merge_zoomed_image<RgbTraits, IndexedTraits>;
       if (!need_checked_bg)
-        bg_color = m_sprite->getPalette(frame)->getEntry(m_sprite->transparentColor());
+        ctx.bg_color = m_sprite->getPalette(frame)->getEntry(m_sprite->transparentColor());
       break;
 
     default:
@@ -420,16 +630,18 @@ Image* RenderEngine::renderSprite(int source_x, int source_y,
   if (!image)
     return NULL;
 
-  // Draw checked background
-  if (need_checked_bg && draw_tiled_bg)
-    renderCheckedBackground(image, source_x, source_y, zoom);
-  else
-    clear_image(image, bg_color);
-
-  // Draw the current frame.
-  global_opacity = 255;
-  renderLayer(m_sprite->folder(), image,
-    source_x, source_y, frame, zoom, zoomed_func, true, true, -1);
+  // The cache planes are updated here (in the calling thread), the
+  // tiles only read them.
+  gfx::Rect visible;
+  if (ctx.scaled)
+    visible = scaled_area(zoom, source_x, source_y, width, height);
+  else {
+    visible.x = source_x >> ctx.zoom;
+    visible.y = source_y >> ctx.zoom;
+    visible.w = ((source_x + width + (1<<ctx.zoom) - 1) >> ctx.zoom) - visible.x;
+    visible.h = ((source_y + height + (1<<ctx.zoom) - 1) >> ctx.zoom) - visible.y;
+  }
+  ctx.cached = prepareCachedFrame(ctx, visible);
 
   // Onion-skin feature: Draw previous/next frames with different
   // opacity (<255) (it is the onion-skinning)
@@ -445,30 +657,132 @@ Image* RenderEngine::renderSprite(int source_x, int source_y,
     for (FrameNumber f=frame.previous(prevs); f <= frame.next(nexts); ++f) {
       if (f == frame || f < 0 || f > m_sprite->lastFrame())
         continue;
-      else if (f < frame)
-        global_opacity = opacity_base - opacity_step * ((frame - f)-1);
+
+      RenderContext::OnionSkinFrame onion;
+      onion.frame = f;
+
+      if (f < frame)
+        onion.opacity = opacity_base - opacity_step * ((frame - f)-1);
       else
-        global_opacity = opacity_base - opacity_step * ((f - frame)-1);
+        onion.opacity = opacity_base - opacity_step * ((f - frame)-1);
 
-      if (global_opacity > 0) {
-        global_opacity = MID(0, global_opacity, 255);
+      if (onion.opacity > 0) {
+        onion.opacity = MID(0, onion.opacity, 255);
 
-        int blend_mode = -1;
+        onion.blend_mode = -1;
         if (docSettings->getOnionskinType() == IDocumentSettings::Onionskin_Merge)
-          blend_mode = BLEND_MODE_NORMAL;
+          onion.blend_mode = BLEND_MODE_NORMAL;
         else if (docSettings->getOnionskinType() == IDocumentSettings::Onionskin_RedBlueTint)
-          blend_mode = (f < frame ? BLEND_MODE_RED_TINT: BLEND_MODE_BLUE_TINT);
+          onion.blend_mode = (f < frame ? BLEND_MODE_RED_TINT: BLEND_MODE_BLUE_TINT);
 
-        renderLayer(m_sprite->folder(), image,
-          source_x, source_y, f, zoom, zoomed_func,
-          true, true, blend_mode);
+        ctx.onionskin.push_back(onion);
       }
     }
   }
 
+  renderTiles(ctx, image, source_x, source_y);
   return image;
 }
 
+// Draws the image in tiles using all available processors.
+void RenderEngine::renderTiles(
+  const RenderContext& ctx,
+  Image* image,
+  int source_x, int source_y)
+{
+  int height = image->height();
+  int tiles = MIN(base::thread_pool::shared().size()*4, height / min_tile_height);
+  if (tiles > 1) {
+    int tile_h = (height + tiles - 1) / tiles;
+    tiles = (height + tile_h - 1) / tile_h;
+
+    base::thread_pool::shared().for_each_index(tiles,
+      RenderTile(this, ctx, image, source_x, source_y, tile_h));
+  }
+  else
+    renderArea(ctx, image, source_x, source_y);
+}
+
+// Draws the whole frame (and onion-skin frames) in the given image,
+// where (source_x, source_y) is the position of the image in the
+// zoomed sprite. It can be called from several threads at the same
+// time.
+void RenderEngine::renderArea(
+  const RenderContext& ctx,
+  Image* image,
+  int source_x, int source_y)
+{
+  if (ctx.scaled) {
+    renderScaledArea(ctx, image, source_x, source_y);
+    return;
+  }
+
+  // Draw the current frame.
+  if (ctx.cached)
+    renderCachedArea(ctx, image, source_x, source_y);
+  else {
+    // Draw checked background
+    if (ctx.checked_bg)
+      renderCheckedBackground(image, source_x, source_y, ctx.zoom);
+    else
+      clear_image(image, ctx.bg_color);
+
+    renderLayer(ctx, m_sprite->folder(), image,
+      source_x, source_y, ctx.frame, true, true, -1, 255);
+  }
+
+  for (size_t i=0; i<ctx.onionskin.size(); ++i) {
+    const RenderContext::OnionSkinFrame& onion = ctx.onionskin[i];
+
+    renderLayer(ctx, m_sprite->folder(), image,
+      source_x, source_y, onion.frame,
+      true, true, onion.blend_mode, onion.opacity);
+  }
+}
+
+// Draws the sprite with an arbitrary zoom: the sampled rows of the
+// sprite are rendered at 100% (in runs of consecutive rows) and then
+// scaled to "image".
+void RenderEngine::renderScaledArea(
+  const RenderContext& ctx,
+  Image* image,
+  int source_x, int source_y)
+{
+  gfx::Rect area = scaled_area(ctx.scale, source_x, source_y,
+                               image->width(), image->height());
+  int box = box_size(ctx.scale);
+
+  RenderContext areaCtx = ctx;
+  areaCtx.scaled = false;
+
+  if (ctx.screen_bg)
+    renderCheckedBackground(image, source_x, source_y, 0);
+
+  int h = image->height();
+  int v1 = 0;
+  while (v1 < h) {
+    // Rows [y1, y2) of the sprite are sampled by rows [v1, v2) of
+    // the image. Small gaps between sampled rows are rendered anyway
+    // (they are cheaper than another renderArea() call).
+    int y1 = sampled_pixel(ctx.scale, box, source_y+v1);
+    int y2 = y1 + box;
+    int v2 = v1+1;
+    for (; v2<h; ++v2) {
+      int y = sampled_pixel(ctx.scale, box, source_y+v2);
+      if (y - y2 >= min_skipped_rows)
+        break;
+      y2 = MAX(y2, y + box);
+    }
+
+    base::UniquePtr<Image> tmp(Image::create(IMAGE_RGB, area.w, y2-y1));
+    renderArea(areaCtx, tmp, area.x, y1);
+
+    scale_image(image, tmp, area.x, y1,
+                source_x, source_y, v1, v2, ctx.scale, ctx.screen_bg);
+    v1 = v2;
+  }
+}
+
 // static
 void RenderEngine::renderCheckedBackground(Image* image,
                                            int source_x, int source_y,
@@ -564,15 +878,18 @@ void RenderEngine::renderImage(Image* rgb_image, Image* src_image, const Palette
 }
 
 void RenderEngine::renderLayer(
+  const RenderContext& ctx,
   const Layer* layer,
   Image *image,
   int source_x, int source_y,
-  FrameNumber frame, int zoom,
-  void (*zoomed_func)(Image*, const Image*, const Palette*, int, int, int, int, int),
+  FrameNumber frame,
   bool render_background,
   bool render_transparent,
-  int blend_mode)
+  int blend_mode,
+  int opacity)
 {
+  int zoom = ctx.zoom;
+
   // we can't read from this layer
   if (!layer->isReadable())
     return;
@@ -588,11 +905,11 @@ void RenderEngine::renderLayer(
       if (cel != NULL) {
         Image* src_image;
 
-        // Is the 'preview_image' set to be used with this layer?
-        if ((selected_layer == layer) &&
-            (selected_frame == frame) &&
-            (preview_image != NULL)) {
-          src_image = preview_image;
+        // Is the preview image set to be used with this layer?
+        if ((ctx.preview_layer == layer) &&
+            (ctx.preview_frame == frame) &&
+            (ctx.preview_image != NULL)) {
+          src_image = ctx.preview_image;
         }
         // If not, we use the original cel-image from the images' stock
         else {
@@ -603,11 +920,11 @@ void RenderEngine::renderLayer(
           int t, output_opacity;
 
           output_opacity = MID(0, cel->opacity(), 255);
-          output_opacity = INT_MULT(output_opacity, global_opacity, t);
+          output_opacity = INT_MULT(output_opacity, opacity, t);
 
           ASSERT(src_image->maskColor() == m_sprite->transparentColor());
 
-          (*zoomed_func)(image, src_image, m_sprite->getPalette(frame),
+          (*ctx.zoomed_func)(image, src_image, m_sprite->getPalette(frame),
             (cel->x() << zoom) - source_x,
             (cel->y() << zoom) - source_y,
             output_opacity,
@@ -625,12 +942,11 @@ void RenderEngine::renderLayer(
       LayerConstIterator end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
 
       for (; it != end; ++it) {
-        renderLayer(*it, image,
-          source_x, source_y,
-          frame, zoom, zoomed_func,
+        renderLayer(ctx, *it, image,
+          source_x, source_y, frame,
           render_background,
           render_transparent,
-          blend_mode);
+          blend_mode, opacity);
       }
       break;
     }
@@ -645,7 +961,7 @@ void RenderEngine::renderLayer(
     if (extraCel->opacity() > 0) {
       Image* extraImage = m_document->getExtraCelImage();
 
-      (*zoomed_func)(image, extraImage, m_sprite->getPalette(frame),
+      (*ctx.zoomed_func)(image, extraImage, m_sprite->getPalette(frame),
         (extraCel->x() << zoom) - source_x,
         (extraCel->y() << zoom) - source_y,
         extraCel->opacity(),
@@ -654,4 +970,229 @@ void RenderEngine::renderLayer(
   }
 }
 
+static void collect_visible_layers(const Layer* layer,
+                                   std::vector<const Layer*>& layers)
+{
+  if (!layer->isReadable())
+    return;
+
+  switch (layer->type()) {
+
+    case OBJECT_LAYER_IMAGE:
+      layers.push_back(layer);
+      break;
+
+    case OBJECT_LAYER_FOLDER: {
+      LayerConstIterator it = static_cast<const LayerFolder*>(layer)->getLayerBegin();
+      LayerConstIterator end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
+
+      for (; it != end; ++it)
+        collect_visible_layers(*it, layers);
+      break;
+    }
+
+  }
+}
+
+// Returns true if the cel of the given layer can be merged in a
+// plane with other layers without changing the final result, i.e. it
+// uses the normal blend mode and its pixels in the given bounds are
+// fully opaque or fully transparent.
+static bool is_binary_alpha_cel(const Layer* layer, FrameNumber frame,
+                                const Palette* pal, const gfx::Rect& bounds)
+{
+  if (static_cast<const LayerImage*>(layer)->getBlendMode() != BLEND_MODE_NORMAL)
+    return false;
+
+  const Cel* cel = static_cast<const LayerImage*>(layer)->getCel(frame);
+  if (!cel || !cel->image())
+    return true;
+
+  if (cel->opacity() != 255)
+    return false;
+
+  const Image* image = cel->image();
+  gfx::Rect rc = bounds;
+  rc.offset(-cel->x(), -cel->y());
+  rc = rc.createIntersect(image->bounds());
+  if (rc.isEmpty())
+    return true;
+
+  switch (image->pixelFormat()) {
+
+    case IMAGE_RGB: {
+      const LockImageBits<RgbTraits> bits(image, rc);
+      LockImageBits<RgbTraits>::const_iterator it = bits.begin(), end = bits.end();
+      for (; it != end; ++it) {
+        int a = rgba_geta(*it);
+        if (a != 0 && a != 255)
+          return false;
+      }
+      break;
+    }
+
+    case IMAGE_GRAYSCALE: {
+      const LockImageBits<GrayscaleTraits> bits(image, rc);
+      LockImageBits<GrayscaleTraits>::const_iterator it = bits.begin(), end = bits.end();
+      for (; it != end; ++it) {
+        int a = graya_geta(*it);
+        if (a != 0 && a != 255)
+          return false;
+      }
+      break;
+    }
+
+    case IMAGE_INDEXED:
+      for (int i=0; i<pal->size(); ++i) {
+        if (i != (int)image->maskColor() &&
+            rgba_geta(pal->getEntry(i)) != 255)
+          return false;
+      }
+      break;
+
+  }
+  return true;
+}
+
+// Updates the planes of the cache in the visible area of the sprite
+// (in sprite coordinates). Returns false if the cache cannot be used
+// to render this frame.
+bool RenderEngine::prepareCachedFrame(
+  const RenderContext& ctx,
+  const gfx::Rect& visible)
+{
+  if (!m_cache ||
+      !m_currentLayer ||
+      ctx.frame != m_currentFrame ||
+      // The preview image of other layer would be included in the planes
+      (ctx.preview_image && ctx.preview_layer != m_currentLayer) ||
+      // The checked background must be representable at sprite resolution
+      (ctx.checked_bg && !checked_bg_zoom))
+    return false;
+
+  RenderCache::Key key;
+  key.sprite = m_sprite;
+  key.layer = m_currentLayer;
+  key.pixelFormat = m_sprite->pixelFormat();
+  key.width = m_sprite->width();
+  key.height = m_sprite->height();
+  key.checkedBg = ctx.checked_bg;
+  key.bgType = (int)checked_bg_type;
+  key.bgColor1 = color_utils::color_for_image(checked_bg_color1, IMAGE_RGB);
+  key.bgColor2 = color_utils::color_for_image(checked_bg_color2, IMAGE_RGB);
+
+  RenderCache* cache = m_cache;
+  if (!cache->m_valid || cache->m_key != key) {
+    cache->m_key = key;
+
+    std::vector<const Layer*> layers;
+    collect_visible_layers(m_sprite->folder(), layers);
+
+    std::vector<const Layer*>::iterator it =
+      std::find(layers.begin(), layers.end(), m_currentLayer);
+
+    cache->m_activeVisible = (it != layers.end());
+    cache->m_belowLayers.assign(layers.begin(), it);
+    cache->m_aboveLayers.clear();
+    if (it != layers.end())
+      cache->m_aboveLayers.assign(it+1, layers.end());
+
+    cache->resetAllPlanes();
+    cache->m_valid = true;
+  }
+
+  RenderCache::Planes* planes = cache->getPlanes(
+    ctx.frame, m_sprite->getPalette(ctx.frame)->getModifications());
+
+  // Re-blend the visible portion of the planes that is out-of-date.
+  if (!planes->dirty.isEmpty()) {
+    gfx::Region visibleRgn(visible);
+    gfx::Region rgn;
+    rgn.createIntersection(planes->dirty, visibleRgn);
+
+    for (gfx::Region::const_iterator it=rgn.begin(), end=rgn.end(); it!=end; ++it)
+      updateCachePlanes(ctx, *it);
+
+    planes->dirty.createSubtraction(planes->dirty, visibleRgn);
+  }
+
+  return true;
+}
+
+// Draws the current frame using the cache planes (they must be
+// updated with prepareCachedFrame() before).
+void RenderEngine::renderCachedArea(
+  const RenderContext& ctx,
+  Image* image,
+  int source_x, int source_y)
+{
+  const RenderCache* cache = m_cache;
+  const RenderCache::Planes* planes = cache->m_planes.front();
+
+  // Layers below the active one (and the background)
+  clear_image(image, 0);
+  merge_zoomed_image<RgbTraits, RgbTraits>(image, planes->below, NULL,
+    -source_x, -source_y, 255, BLEND_MODE_COPY, ctx.zoom);
+
+  // Active layer (and the extra cel)
+  if (cache->m_activeVisible)
+    renderLayer(ctx, m_currentLayer, image,
+      source_x, source_y, ctx.frame, true, true, -1, 255);
+
+  // Layers above the active one
+  if (planes->above && planes->aboveExact) {
+    merge_zoomed_image<RgbTraits, RgbTraits>(image, planes->above, NULL,
+      -source_x, -source_y, 255, BLEND_MODE_NORMAL, ctx.zoom);
+  }
+  else {
+    for (const Layer* layer : cache->m_aboveLayers)
+      renderLayer(ctx, layer, image,
+        source_x, source_y, ctx.frame, true, true, -1, 255);
+  }
+}
+
+void RenderEngine::updateCachePlanes(
+  const RenderContext& ctx,
+  const gfx::Rect& bounds)
+{
+  RenderCache* cache = m_cache;
+  RenderCache::Planes* planes = cache->m_planes.front();
+  gfx::Rect rc = bounds.createIntersect(planes->below->bounds());
+  if (rc.isEmpty())
+    return;
+
+  // Planes are rendered at sprite resolution.
+  RenderContext planeCtx = ctx;
+  planeCtx.zoom = 0;
+
+  base::UniquePtr<Image> tmp(Image::create(IMAGE_RGB, rc.w, rc.h));
+
+  if (cache->m_key.checkedBg)
+    renderCheckedBackground(tmp, rc.x, rc.y, 0);
+  else
+    clear_image(tmp, ctx.bg_color);
+
+  for (const Layer* layer : cache->m_belowLayers)
+    renderLayer(planeCtx, layer, tmp, rc.x, rc.y, ctx.frame, true, true, -1, 255);
+
+  copy_image(planes->below, tmp, rc.x, rc.y);
+
+  if (planes->above && planes->aboveExact) {
+    const Palette* pal = m_sprite->getPalette(ctx.frame);
+
+    clear_image(tmp, 0);
+    for (const Layer* layer : cache->m_aboveLayers) {
+      if (!is_binary_alpha_cel(layer, ctx.frame, pal, rc)) {
+        // Layers above will be blended one by one from now on.
+        planes->aboveExact = false;
+        break;
+      }
+      renderLayer(planeCtx, layer, tmp, rc.x, rc.y, ctx.frame, true, true, -1, 255);
+    }
+
+    if (planes->aboveExact)
+      copy_image(planes->above, tmp, rc.x, rc.y);
+  }
+}
+
 } // namespace app
@@ -21,6 +21,8 @@
 #pragma once
 
 #include "app/color.h"
+#include "app/zoom.h"
+#include "gfx/rect.h"
 #include "raster/frame_number.h"
 #include "raster/image_buffer.h"
 
@@ -33,6 +35,7 @@ namespace raster {
 
 namespace app {
   class Document;
+  class RenderCache;
 
   using namespace raster;
 
@@ -42,7 +45,12 @@ namespace app {
                  const Sprite* sprite,
                  const Layer* currentLayer,
                  FrameNumber currentFrame);
-  
+
+    // Uses the given cache to avoid blending again the layers
+    // below/above the current layer on each renderSprite() call. The
+    // cache is not owned by the RenderEngine.
+    void setRenderCache(RenderCache* cache) { m_cache = cache; }
+
     //////////////////////////////////////////////////////////////////////
     // Checked background configuration
 
@@ -69,9 +77,12 @@ namespace app {
     //////////////////////////////////////////////////////////////////////
     // Main function used by sprite-editors to render the sprite
 
+    // Zoom levels that aren't a power of two are rendered at 100% and
+    // then scaled (nearest-neighbour to zoom in, box filter to zoom
+    // out).
     Image* renderSprite(int source_x, int source_y,
       int width, int height,
-      FrameNumber frame, int zoom,
+      FrameNumber frame, const Zoom& zoom,
       bool draw_tiled_bg,
       bool enable_onionskin,
       ImageBufferPtr& buffer);
@@ -87,20 +98,57 @@ namespace app {
                             int x, int y, int zoom);
 
   private:
+    typedef void (*ZoomedFunc)(Image*, const Image*, const Palette*, int, int, int, int, int);
+
+    // State of one renderSprite() call. It's shared (read-only)
+    // between all threads that render tiles of the same image.
+    struct RenderContext;
+    class RenderTile;
+
+    void renderTiles(
+      const RenderContext& ctx,
+      Image* image,
+      int source_x, int source_y);
+
+    void renderArea(
+      const RenderContext& ctx,
+      Image* image,
+      int source_x, int source_y);
+
+    void renderScaledArea(
+      const RenderContext& ctx,
+      Image* image,
+      int source_x, int source_y);
+
     void renderLayer(
+      const RenderContext& ctx,
       const Layer* layer,
       Image* image,
       int source_x, int source_y,
-      FrameNumber frame, int zoom,
-      void (*zoomed_func)(Image*, const Image*, const Palette*, int, int, int, int, int),
+      FrameNumber frame,
       bool render_background,
       bool render_transparent,
-      int blend_mode);
+      int blend_mode,
+      int opacity);
+
+    bool prepareCachedFrame(
+      const RenderContext& ctx,
+      const gfx::Rect& visible);
+
+    void renderCachedArea(
+      const RenderContext& ctx,
+      Image* image,
+      int source_x, int source_y);
+
+    void updateCachePlanes(
+      const RenderContext& ctx,
+      const gfx::Rect& bounds);
 
     const Document* m_document;
     const Sprite* m_sprite;
     const Layer* m_currentLayer;
     FrameNumber m_currentFrame;
+    RenderCache* m_cache;
   };
 
 } // namespace app
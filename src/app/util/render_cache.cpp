@@ -0,0 +1,169 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/render_cache.h"
+
+#include "app/document.h"
+#include "doc/document_event.h"
+#include "raster/image.h"
+
+namespace app {
+
+bool RenderCache::Key::operator==(const Key& o) const
+{
+  return (sprite == o.sprite &&
+          layer == o.layer &&
+          pixelFormat == o.pixelFormat &&
+          width == o.width &&
+          height == o.height &&
+          checkedBg == o.checkedBg &&
+          bgType == o.bgType &&
+          bgColor1 == o.bgColor1 &&
+          bgColor2 == o.bgColor2);
+}
+
+RenderCache::RenderCache(Document* document)
+  : m_document(document)
+  , m_valid(false)
+  , m_activeVisible(false)
+{
+  m_document->addObserver(this);
+}
+
+RenderCache::~RenderCache()
+{
+  m_document->removeObserver(this);
+
+  for (Planes* planes : m_planes)
+    delete planes;
+}
+
+void RenderCache::invalidate()
+{
+  // The planes are kept to reuse their images, they will be
+  // re-blended completely when the cache is used again.
+  m_valid = false;
+}
+
+void RenderCache::invalidateRegion(const gfx::Region& rgn)
+{
+  if (m_valid) {
+    for (Planes* planes : m_planes)
+      planes->dirty.createUnion(planes->dirty, rgn);
+  }
+}
+
+RenderCache::Planes* RenderCache::getPlanes(FrameNumber frame, int paletteModifications)
+{
+  std::vector<Planes*>::iterator it = m_planes.begin();
+  while (it != m_planes.end() && (*it)->frame != frame)
+    ++it;
+
+  Planes* planes;
+  if (it != m_planes.end()) {
+    planes = *it;
+    m_planes.erase(it);
+
+    if (planes->paletteModifications != paletteModifications)
+      resetPlanes(planes);
+  }
+  else {
+    // Reuse the images of the least recently used frame.
+    if (!m_planes.empty() && !fitPlanes(m_planes.size()+1)) {
+      planes = m_planes.back();
+      m_planes.pop_back();
+    }
+    else
+      planes = new Planes;
+
+    planes->frame = frame;
+    resetPlanes(planes);
+  }
+
+  planes->paletteModifications = paletteModifications;
+  m_planes.insert(m_planes.begin(), planes);
+  return planes;
+}
+
+void RenderCache::resetPlanes(Planes* planes)
+{
+  gfx::Rect bounds(0, 0, m_key.width, m_key.height);
+
+  if (!planes->below || planes->below->bounds() != bounds)
+    planes->below.reset(Image::create(IMAGE_RGB, bounds.w, bounds.h));
+
+  if (m_aboveLayers.empty())
+    planes->above.reset(NULL);
+  else if (!planes->above || planes->above->bounds() != bounds)
+    planes->above.reset(Image::create(IMAGE_RGB, bounds.w, bounds.h));
+
+  planes->aboveExact = true;
+  planes->dirty = gfx::Region(bounds);
+}
+
+void RenderCache::resetAllPlanes()
+{
+  // Discard planes that don't fit anymore (e.g. the sprite is bigger).
+  while (m_planes.size() > 1 && !fitPlanes(m_planes.size())) {
+    delete m_planes.back();
+    m_planes.pop_back();
+  }
+
+  for (Planes* planes : m_planes)
+    resetPlanes(planes);
+}
+
+bool RenderCache::fitPlanes(size_t n) const
+{
+  size_t size = size_t(m_key.width) * m_key.height * 4 * (m_aboveLayers.empty() ? 1: 2);
+  return (n <= size_t(MaxFrames) && n*size <= MaxSize);
+}
+
+void RenderCache::onGeneralUpdate(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onAddLayer(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onAddFrame(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onAddCel(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onAfterRemoveLayer(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onRemoveFrame(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onRemoveCel(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onSpriteSizeChanged(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onSpriteTransparentColorChanged(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onLayerRestacked(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onLayerMergedDown(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onCelMoved(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onCelCopied(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onCelFrameChanged(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onCelPositionChanged(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onCelOpacityChanged(doc::DocumentEvent& ev) { invalidate(); }
+void RenderCache::onImagePixelsModified(doc::DocumentEvent& ev) { invalidate(); }
+
+void RenderCache::onSpritePixelsModified(doc::DocumentEvent& ev)
+{
+  // The active layer isn't in the planes, so we can keep them as
+  // they are (e.g. this is the case of each step of a brush stroke).
+  if (m_valid && ev.layer() && ev.layer() == m_key.layer)
+    return;
+
+  invalidateRegion(ev.region());
+}
+
+} // namespace app
@@ -0,0 +1,166 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef APP_UTIL_RENDER_CACHE_H_INCLUDED
+#define APP_UTIL_RENDER_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/unique_ptr.h"
+#include "doc/document_observer.h"
+#include "gfx/region.h"
+#include "raster/color.h"
+#include "raster/frame_number.h"
+#include "raster/pixel_format.h"
+
+#include <vector>
+
+namespace raster {
+  class Image;
+  class Layer;
+  class Sprite;
+}
+
+namespace app {
+  class Document;
+
+  using namespace raster;
+
+  // Pre-composited planes of the layers below and above the active
+  // layer of one editor. The planes are kept at sprite resolution
+  // (they are zoomed when they are blitted), so RenderEngine only has
+  // to blend the active layer between them on each repaint.
+  //
+  // Planes of the last rendered frames are kept (so going back and
+  // forth between frames doesn't re-blend them), and the images of
+  // the least recently used frame are reused for a new frame.
+  //
+  // The cache listens the document: pixel notifications re-blend the
+  // modified region of the planes (unless they come from the active
+  // layer, which isn't included in the planes), and any other change
+  // re-blends the planes completely.
+  class RenderCache : public doc::DocumentObserver {
+  public:
+    RenderCache(Document* document);
+    ~RenderCache();
+
+    // Maximum memory used by the planes of all frames (planes of
+    // one frame are kept even if they use more memory).
+    static const size_t MaxSize = 64*1024*1024;
+    enum { MaxFrames = 16 };
+
+    // Re-blends all cached planes the next time they are rendered.
+    void invalidate();
+
+    // Re-blends the given region (in sprite coordinates) of the planes
+    // the next time it's rendered.
+    void invalidateRegion(const gfx::Region& rgn);
+
+    // doc::DocumentObserver impl
+    void onGeneralUpdate(doc::DocumentEvent& ev) override;
+    void onAddLayer(doc::DocumentEvent& ev) override;
+    void onAddFrame(doc::DocumentEvent& ev) override;
+    void onAddCel(doc::DocumentEvent& ev) override;
+    void onAfterRemoveLayer(doc::DocumentEvent& ev) override;
+    void onRemoveFrame(doc::DocumentEvent& ev) override;
+    void onRemoveCel(doc::DocumentEvent& ev) override;
+    void onSpriteSizeChanged(doc::DocumentEvent& ev) override;
+    void onSpriteTransparentColorChanged(doc::DocumentEvent& ev) override;
+    void onLayerRestacked(doc::DocumentEvent& ev) override;
+    void onLayerMergedDown(doc::DocumentEvent& ev) override;
+    void onCelMoved(doc::DocumentEvent& ev) override;
+    void onCelCopied(doc::DocumentEvent& ev) override;
+    void onCelFrameChanged(doc::DocumentEvent& ev) override;
+    void onCelPositionChanged(doc::DocumentEvent& ev) override;
+    void onCelOpacityChanged(doc::DocumentEvent& ev) override;
+    void onImagePixelsModified(doc::DocumentEvent& ev) override;
+    void onSpritePixelsModified(doc::DocumentEvent& ev) override;
+
+  private:
+    friend class RenderEngine;
+
+    // Everything (except the frame) that makes the cached planes
+    // different from one render to other.
+    struct Key {
+      const Sprite* sprite;
+      const Layer* layer;
+      PixelFormat pixelFormat;
+      int width, height;
+      bool checkedBg;
+      int bgType;
+      color_t bgColor1, bgColor2;
+
+      bool operator==(const Key& o) const;
+      bool operator!=(const Key& o) const { return !operator==(o); }
+    };
+
+    // Planes of one frame.
+    struct Planes {
+      FrameNumber frame;
+      int paletteModifications;
+
+      base::UniquePtr<Image> below;
+      base::UniquePtr<Image> above;
+
+      // True if "above" can be merged in one step giving the same
+      // result as blending each layer above (i.e. all their pixels
+      // are opaque or fully transparent). Integer blending isn't
+      // associative, so in other case layers above are blended one
+      // by one.
+      bool aboveExact;
+
+      // Region (in sprite coordinates) of the planes that must be
+      // re-blended before using them. Planes are filled lazily, only
+      // the portions that are visible are blended.
+      gfx::Region dirty;
+
+      Planes() : paletteModifications(0), aboveExact(false) { }
+    };
+
+    // Returns the planes for the given frame (moving them to the
+    // front of m_planes), reusing the planes of other frame if needed.
+    Planes* getPlanes(FrameNumber frame, int paletteModifications);
+
+    // Prepares the images of the planes for the current key, and
+    // marks them to be re-blended completely.
+    void resetPlanes(Planes* planes);
+    void resetAllPlanes();
+
+    // Returns true if "n" frames of planes can be cached.
+    bool fitPlanes(size_t n) const;
+
+    Document* m_document;
+    bool m_valid;
+    Key m_key;
+
+    // Visible image layers (in render order) below and above the
+    // active layer.
+    std::vector<const Layer*> m_belowLayers;
+    std::vector<const Layer*> m_aboveLayers;
+    bool m_activeVisible;
+
+    // Planes of the last rendered frames, the most recently used
+    // first.
+    std::vector<Planes*> m_planes;
+
+    DISABLE_COPYING(RenderCache);
+  };
+
+} // namespace app
+
+#endif
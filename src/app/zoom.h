@@ -0,0 +1,92 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef APP_ZOOM_H_INCLUDED
+#define APP_ZOOM_H_INCLUDED
+#pragma once
+
+namespace app {
+
+  // A zoom level expressed as a rational number (num/den), e.g. 3/1
+  // is 300% and 1/4 is 25%. Coordinates are converted between sprite
+  // and zoomed space rounding to the pixel on the left/top (floor),
+  // so they work for negative coordinates too.
+  class Zoom {
+  public:
+    Zoom(int num = 1, int den = 1) : m_num(num), m_den(den) {
+      ASSERT(m_num > 0);
+      ASSERT(m_den > 0);
+      int a = m_num, b = m_den;
+      while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+      }
+      m_num /= a;
+      m_den /= a;
+    }
+
+    // Creates a 2^shift zoom (the old zoom levels of the editor).
+    static Zoom fromShift(int shift) {
+      return Zoom(1 << shift, 1);
+    }
+
+    int num() const { return m_num; }
+    int den() const { return m_den; }
+    double scale() const { return double(m_num) / double(m_den); }
+
+    // Returns the "n" of the 2^n zoom levels (n >= 0), or -1 if this
+    // zoom cannot be represented as a shift.
+    int shift() const {
+      if (m_den != 1 || (m_num & (m_num-1)) != 0)
+        return -1;
+      int n = 0;
+      while ((1 << n) < m_num)
+        ++n;
+      return n;
+    }
+
+    // Sprite coordinate -> zoomed coordinate.
+    int apply(int x) const { return floor_div(x * m_num, m_den); }
+
+    // Zoomed coordinate -> sprite coordinate.
+    int remove(int x) const { return floor_div(x * m_den, m_num); }
+
+    bool operator==(const Zoom& other) const {
+      return (m_num == other.m_num && m_den == other.m_den);
+    }
+
+    bool operator!=(const Zoom& other) const {
+      return !operator==(other);
+    }
+
+  private:
+    static int floor_div(int a, int b) {
+      int q = a / b;
+      if ((a % b) != 0 && (a < 0))
+        --q;
+      return q;
+    }
+
+    int m_num;
+    int m_den;
+  };
+
+} // namespace app
+
+#endif
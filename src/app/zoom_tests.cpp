@@ -0,0 +1,65 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "app/zoom.h"
+
+using namespace app;
+
+namespace app {
+
+  inline std::ostream& operator<<(std::ostream& os, const Zoom& zoom) {
+    return os << zoom.num() << "/" << zoom.den();
+  }
+
+}
+
+TEST(Zoom, Normalize)
+{
+  EXPECT_EQ(Zoom(3, 2), Zoom(6, 4));
+  EXPECT_EQ(1, Zoom(4, 4).num());
+  EXPECT_EQ(1, Zoom(4, 4).den());
+}
+
+TEST(Zoom, Shift)
+{
+  EXPECT_EQ(0, Zoom(1, 1).shift());
+  EXPECT_EQ(3, Zoom(8, 1).shift());
+  EXPECT_EQ(3, Zoom::fromShift(3).shift());
+  EXPECT_EQ(-1, Zoom(3, 1).shift());
+  EXPECT_EQ(-1, Zoom(1, 2).shift());
+}
+
+TEST(Zoom, ApplyAndRemove)
+{
+  Zoom z(3, 2);
+  EXPECT_EQ(0, z.apply(0));
+  EXPECT_EQ(1, z.apply(1));
+  EXPECT_EQ(3, z.apply(2));
+  EXPECT_EQ(-2, z.apply(-1));
+  EXPECT_EQ(2, z.remove(3));
+  EXPECT_EQ(1, z.remove(2));
+  EXPECT_EQ(-1, z.remove(-1));
+
+  Zoom half(1, 2);
+  EXPECT_EQ(5, half.apply(10));
+  EXPECT_EQ(5, half.apply(11));
+  EXPECT_EQ(-6, half.apply(-11));
+  EXPECT_EQ(20, half.remove(10));
+}
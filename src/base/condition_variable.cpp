@@ -0,0 +1,49 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/condition_variable.h"
+
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
+
+#ifdef WIN32
+  #include "base/condition_variable_win32.h"
+#else
+  #include "base/condition_variable_pthread.h"
+#endif
+
+namespace base {
+
+condition_variable::condition_variable()
+  : m_impl(new condition_variable_impl)
+{
+}
+
+condition_variable::~condition_variable()
+{
+  delete m_impl;
+}
+
+void condition_variable::notify_one()
+{
+  m_impl->notify_one();
+}
+
+void condition_variable::notify_all()
+{
+  m_impl->notify_all();
+}
+
+void condition_variable::wait(scoped_lock& lock)
+{
+  m_impl->wait(lock.get_mutex());
+}
+
+} // namespace base
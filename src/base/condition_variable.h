@@ -0,0 +1,45 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_CONDITION_VARIABLE_H_INCLUDED
+#define BASE_CONDITION_VARIABLE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+namespace base {                // Based on C++0x threads lib
+
+  class scoped_lock;
+
+  class condition_variable {
+  public:
+    condition_variable();
+    ~condition_variable();
+
+    void notify_one();
+    void notify_all();
+
+    // Unlocks the mutex of "lock" and waits until the condition is
+    // notified (or a spurious wakeup), then the mutex is locked
+    // again.
+    void wait(scoped_lock& lock);
+
+    template<typename Predicate>
+    void wait(scoped_lock& lock, Predicate pred) {
+      while (!pred())
+        wait(lock);
+    }
+
+  private:
+    class condition_variable_impl;
+    condition_variable_impl* m_impl;
+
+    DISABLE_COPYING(condition_variable);
+  };
+
+} // namespace base
+
+#endif
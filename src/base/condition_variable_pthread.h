@@ -0,0 +1,42 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_CONDITION_VARIABLE_PTHREAD_H_INCLUDED
+#define BASE_CONDITION_VARIABLE_PTHREAD_H_INCLUDED
+#pragma once
+
+#include <pthread.h>
+
+class base::condition_variable::condition_variable_impl
+{
+public:
+
+  condition_variable_impl() {
+    pthread_cond_init(&m_handle, NULL);
+  }
+
+  ~condition_variable_impl() {
+    pthread_cond_destroy(&m_handle);
+  }
+
+  void notify_one() {
+    pthread_cond_signal(&m_handle);
+  }
+
+  void notify_all() {
+    pthread_cond_broadcast(&m_handle);
+  }
+
+  void wait(base::mutex& m) {
+    pthread_cond_wait(&m_handle, (pthread_mutex_t*)m.native_handle());
+  }
+
+private:
+  pthread_cond_t m_handle;
+
+};
+
+#endif
@@ -0,0 +1,67 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_CONDITION_VARIABLE_WIN32_H_INCLUDED
+#define BASE_CONDITION_VARIABLE_WIN32_H_INCLUDED
+#pragma once
+
+#include <windows.h>
+
+#include <deque>
+
+// Windows XP doesn't have condition variables, each waiting thread
+// waits its own event (so a notification cannot be lost or taken by
+// a thread that started to wait later).
+class base::condition_variable::condition_variable_impl
+{
+public:
+
+  condition_variable_impl() {
+    InitializeCriticalSection(&m_handle);
+  }
+
+  ~condition_variable_impl() {
+    DeleteCriticalSection(&m_handle);
+  }
+
+  void notify_one() {
+    EnterCriticalSection(&m_handle);
+    if (!m_waiters.empty()) {
+      SetEvent(m_waiters.front());
+      m_waiters.pop_front();
+    }
+    LeaveCriticalSection(&m_handle);
+  }
+
+  void notify_all() {
+    EnterCriticalSection(&m_handle);
+    for (std::deque<HANDLE>::iterator it = m_waiters.begin(); it != m_waiters.end(); ++it)
+      SetEvent(*it);
+    m_waiters.clear();
+    LeaveCriticalSection(&m_handle);
+  }
+
+  void wait(base::mutex& m) {
+    HANDLE event = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    // The event is queued before "m" is unlocked, so notifications
+    // made after that will signal it.
+    EnterCriticalSection(&m_handle);
+    m_waiters.push_back(event);
+    LeaveCriticalSection(&m_handle);
+
+    m.unlock();
+    WaitForSingleObject(event, INFINITE);
+    CloseHandle(event);
+    m.lock();
+  }
+
+private:
+  CRITICAL_SECTION m_handle;
+  std::deque<HANDLE> m_waiters;
+};
+
+#endif
@@ -43,4 +43,9 @@ void mutex::unlock()
   return m_impl->unlock();
 }
 
+mutex::native_handle_type mutex::native_handle()
+{
+  return m_impl->native_handle();
+}
+
 } // namespace base
@@ -14,6 +14,8 @@ namespace base {
 
   class mutex {
   public:
+    typedef void* native_handle_type;
+
     mutex();
     ~mutex();
 
@@ -21,6 +23,8 @@ namespace base {
     bool try_lock();
     void unlock();
 
+    native_handle_type native_handle();
+
   private:
     class mutex_impl;
     mutex_impl* m_impl;
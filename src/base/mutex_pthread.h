@@ -35,6 +35,10 @@ public:
     pthread_mutex_unlock(&m_handle);
   }
 
+  void* native_handle() {
+    return &m_handle;
+  }
+
 private:
   pthread_mutex_t m_handle;
 
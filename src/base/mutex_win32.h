@@ -38,6 +38,10 @@ public:
     LeaveCriticalSection(&m_handle);
   }
 
+  void* native_handle() {
+    return &m_handle;
+  }
+
 private:
   CRITICAL_SECTION m_handle;
 };
@@ -8,7 +8,11 @@
 #define BASE_SHARED_PTR_H_INCLUDED
 #pragma once
 
-// This class counts references for a SharedPtr.
+#include <atomic>
+
+// This class counts references for a SharedPtr. The counter is
+// atomic, so copies of the same SharedPtr can be created and
+// destroyed from different threads.
 class SharedPtrRefCounterBase
 {
 public:
@@ -22,8 +26,7 @@ public:
 
   void release()
   {
-    --m_count;
-    if (m_count == 0)
+    if (--m_count == 0)
       delete this;
   }
 
@@ -33,7 +36,7 @@ public:
   }
 
 private:
-  long m_count;         // Number of references.
+  std::atomic<long> m_count; // Number of references.
 };
 
 // Default deleter used by shared pointer (it calls "delete"
@@ -7,6 +7,9 @@
 #include <gtest/gtest.h>
 
 #include "base/shared_ptr.h"
+#include "base/thread.h"
+
+#include <vector>
 
 TEST(SharedPtr, IntPtr)
 {
@@ -139,6 +142,33 @@ TEST(SharedPtr, ResetBugDoesntSetPtrToNull)
   EXPECT_EQ(5, *a);
 }
 
+struct CopyPtrs {
+  SharedPtr<int> ptr;
+  CopyPtrs(const SharedPtr<int>& ptr) : ptr(ptr) { }
+  void operator()() const {
+    for (int i=0; i<100000; ++i) {
+      SharedPtr<int> copy(ptr);
+      SharedPtr<int> other;
+      other = copy;
+    }
+  }
+};
+
+TEST(SharedPtr, CopiesFromSeveralThreads)
+{
+  SharedPtr<int> a(new int(5));
+  {
+    std::vector<base::thread*> threads;
+    for (int i=0; i<4; ++i)
+      threads.push_back(new base::thread(CopyPtrs(a)));
+    for (size_t i=0; i<threads.size(); ++i) {
+      threads[i]->join();
+      delete threads[i];
+    }
+  }
+  EXPECT_EQ(1, a.use_count());
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -65,10 +65,13 @@ void base::thread::join()
   if (joinable()) {
 #ifdef WIN32
     ::WaitForSingleObject(m_native_handle, INFINITE);
+    detach();
 #else
+    // A joined thread cannot be detached (its ID could be reused by
+    // a new thread), so we just forget the handle.
     ::pthread_join((pthread_t)m_native_handle, NULL);
+    m_native_handle = (native_handle_type)0;
 #endif
-    detach();
   }
 }
 
@@ -77,10 +80,10 @@ void base::thread::detach()
   if (joinable()) {
 #ifdef WIN32
     ::CloseHandle(m_native_handle);
-    m_native_handle = (native_handle_type)0;
 #else
     ::pthread_detach((pthread_t)m_native_handle);
 #endif
+    m_native_handle = (native_handle_type)0;
   }
 }
 
@@ -89,6 +92,20 @@ base::thread::native_handle_type base::thread::native_handle()
   return m_native_handle;
 }
 
+// static
+int base::thread::hardware_concurrency()
+{
+  int n;
+#ifdef WIN32
+  SYSTEM_INFO info;
+  ::GetSystemInfo(&info);
+  n = (int)info.dwNumberOfProcessors;
+#else
+  n = (int)::sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return (n > 0 ? n: 1);
+}
+
 void base::thread::launch_thread(func_wrapper* f)
 {
   m_native_handle = (native_handle_type)0;
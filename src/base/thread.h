@@ -43,6 +43,9 @@ namespace base {                // Based on C++0x threads lib
 
     native_handle_type native_handle();
 
+    // Returns the number of processors (at least 1).
+    static int hardware_concurrency();
+
     class details {
     public:
       static void thread_proxy(void* data);
@@ -0,0 +1,172 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/thread_pool.h"
+
+#include "base/condition_variable.h"
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
+#include "base/thread.h"
+
+#include <exception>
+#include <vector>
+
+namespace base {
+
+class thread_pool::impl {
+public:
+  impl(int nworkers)
+    : m_nworkers(nworkers)
+    , m_job(NULL)
+    , m_next(0)
+    , m_n(0)
+    , m_active(0)
+    , m_busy(false)
+    , m_stop(false) {
+  }
+
+  ~impl() {
+    {
+      scoped_lock lock(m_mutex);
+      m_stop = true;
+      m_work.notify_all();
+    }
+
+    for (size_t i=0; i<m_threads.size(); ++i) {
+      m_threads[i]->join();
+      delete m_threads[i];
+    }
+  }
+
+  // Calls from a task are rejected because the pool is busy until
+  // all tasks of the current job are finished.
+  bool run(job& job, int n) {
+    {
+      scoped_lock lock(m_mutex);
+      if (m_busy)
+        return false;
+
+      // Workers are created the first time that they are needed.
+      if (m_threads.empty()) {
+        for (int i=0; i<m_nworkers; ++i)
+          m_threads.push_back(new thread(&impl::worker_proxy, this));
+      }
+
+      m_busy = true;
+      m_job = &job;
+      m_next = 0;
+      m_n = n;
+      m_exception = std::exception_ptr();
+      m_work.notify_all();
+    }
+
+    std::exception_ptr exception;
+    {
+      scoped_lock lock(m_mutex);
+      ++m_active;
+      runTasks();
+      --m_active;
+
+      // Wait the workers that are still running a task.
+      m_done.wait(lock, [this]{ return m_active == 0; });
+
+      exception = m_exception;
+      m_exception = std::exception_ptr();
+      m_job = NULL;
+      m_busy = false;
+    }
+
+    if (exception)
+      std::rethrow_exception(exception);
+    return true;
+  }
+
+private:
+  // Runs tasks of the current job until there is no more indexes.
+  // "m_mutex" is locked when it's called and when it returns.
+  void runTasks() {
+    job* job = m_job;
+
+    while (m_next < m_n) {
+      int i = m_next++;
+      m_mutex.unlock();
+      try {
+        (*job)(i);
+        m_mutex.lock();
+      }
+      catch (...) {
+        m_mutex.lock();
+        if (!m_exception)
+          m_exception = std::current_exception();
+        m_next = m_n;
+      }
+    }
+  }
+
+  static void worker_proxy(impl* self) {
+    self->workerLoop();
+  }
+
+  void workerLoop() {
+    scoped_lock lock(m_mutex);
+    while (true) {
+      m_work.wait(lock, [this]{ return m_stop || (m_job && m_next < m_n); });
+      if (m_stop)
+        break;
+
+      ++m_active;
+      runTasks();
+      if (--m_active == 0)
+        m_done.notify_all();
+    }
+  }
+
+  int m_nworkers;
+  std::vector<thread*> m_threads;
+  mutex m_mutex;
+  condition_variable m_work;        // New job to run or stop
+  condition_variable m_done;        // All tasks finished
+  job* m_job;
+  int m_next;
+  int m_n;
+  int m_active;                     // Threads running tasks
+  bool m_busy;
+  bool m_stop;
+  std::exception_ptr m_exception;
+};
+
+// Worker threads aren't created until the pool is used.
+static thread_pool shared_pool;
+
+// static
+thread_pool& thread_pool::shared()
+{
+  return shared_pool;
+}
+
+thread_pool::thread_pool(int size)
+  : m_impl(NULL)
+  , m_size(size > 0 ? size: thread::hardware_concurrency())
+{
+  if (m_size > 1)
+    m_impl = new impl(m_size-1);
+}
+
+thread_pool::~thread_pool()
+{
+  delete m_impl;
+}
+
+bool thread_pool::run(job& job, int n)
+{
+  return m_impl->run(job, n);
+}
+
+} // namespace base
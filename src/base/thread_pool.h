@@ -0,0 +1,83 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_THREAD_POOL_H_INCLUDED
+#define BASE_THREAD_POOL_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+namespace base {
+
+  // Distributes independent tasks (identified by an index) between
+  // several threads. The worker threads are created the first time
+  // they are needed and sleep between for_each_index() calls.
+  class thread_pool {
+  public:
+    // Creates a pool of "size" threads (including the calling
+    // thread). Zero means one thread per processor.
+    explicit thread_pool(int size = 0);
+    ~thread_pool();
+
+    int size() const { return m_size; }
+
+    // Pool with one thread per processor used by all modules, so
+    // there are never more threads than processors running tasks.
+    static thread_pool& shared();
+
+    // Calls f(i) for each i in [0, n) from the calling thread and
+    // the worker threads, and waits until all calls are done. "f"
+    // must be safe to be called concurrently. If some call throws an
+    // exception, the first one is re-thrown in the calling thread
+    // (indexes that weren't started yet are skipped).
+    //
+    // If the pool is already running other for_each_index() (e.g. a
+    // nested call from "f", or a call from other thread) all calls
+    // are made serially in the calling thread.
+    template<typename Func>
+    void for_each_index(int n, const Func& f) {
+      if (n <= 0)
+        return;
+
+      if (n > 1 && m_size > 1) {
+        job_impl<Func> job(f);
+        if (run(job, n))
+          return;
+      }
+
+      for (int i=0; i<n; ++i)
+        f(i);
+    }
+
+  private:
+    class job {
+    public:
+      virtual ~job() { }
+      virtual void operator()(int i) = 0;
+    };
+
+    template<typename Func>
+    class job_impl : public job {
+    public:
+      job_impl(const Func& f) : m_f(f) { }
+      void operator()(int i) override { m_f(i); }
+    private:
+      const Func& m_f;
+    };
+
+    // Returns false if the pool is busy.
+    bool run(job& job, int n);
+
+    class impl;
+    impl* m_impl;
+    int m_size;
+
+    DISABLE_COPYING(thread_pool);
+  };
+
+} // namespace base
+
+#endif
@@ -0,0 +1,136 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/thread.h"
+#include "base/thread_pool.h"
+
+#include <stdexcept>
+#include <vector>
+
+using namespace base;
+
+struct Square {
+  std::vector<int>* v;
+  Square(std::vector<int>& v) : v(&v) { }
+  void operator()(int i) const {
+    (*v)[i] = i*i;
+  }
+};
+
+TEST(ThreadPool, AllIndexes)
+{
+  for (int size=1; size<=8; ++size) {
+    thread_pool pool(size);
+    EXPECT_EQ(size, pool.size());
+
+    std::vector<int> v(1000, -1);
+    pool.for_each_index((int)v.size(), Square(v));
+
+    for (int i=0; i<(int)v.size(); ++i)
+      EXPECT_EQ(i*i, v[i]);
+  }
+}
+
+TEST(ThreadPool, DefaultSize)
+{
+  thread_pool pool;
+  EXPECT_GE(pool.size(), 1);
+}
+
+TEST(ThreadPool, SharedPool)
+{
+  EXPECT_EQ(&thread_pool::shared(), &thread_pool::shared());
+  EXPECT_GE(thread_pool::shared().size(), 1);
+
+  std::vector<int> v(1000, -1);
+  thread_pool::shared().for_each_index((int)v.size(), Square(v));
+  for (int i=0; i<(int)v.size(); ++i)
+    EXPECT_EQ(i*i, v[i]);
+}
+
+TEST(ThreadPool, NoTasks)
+{
+  thread_pool pool(4);
+  std::vector<int> v;
+  pool.for_each_index(0, Square(v));
+}
+
+struct Fail {
+  void operator()(int i) const {
+    if (i == 5)
+      throw std::runtime_error("fail");
+  }
+};
+
+TEST(ThreadPool, RethrowException)
+{
+  thread_pool pool(4);
+  EXPECT_THROW(pool.for_each_index(100, Fail()), std::runtime_error);
+}
+
+TEST(ThreadPool, ReuseWorkers)
+{
+  thread_pool pool(4);
+  for (int j=0; j<100; ++j) {
+    std::vector<int> v(j, -1);
+    pool.for_each_index((int)v.size(), Square(v));
+    for (int i=0; i<(int)v.size(); ++i)
+      EXPECT_EQ(i*i, v[i]);
+  }
+}
+
+struct Nested {
+  thread_pool* pool;
+  std::vector<std::vector<int> >* v;
+  Nested(thread_pool& pool, std::vector<std::vector<int> >& v) : pool(&pool), v(&v) { }
+  void operator()(int i) const {
+    // Runs serially in this thread (the pool is busy)
+    pool->for_each_index((int)(*v)[i].size(), Square((*v)[i]));
+  }
+};
+
+TEST(ThreadPool, NestedCalls)
+{
+  thread_pool pool(4);
+  std::vector<std::vector<int> > v(16, std::vector<int>(100, -1));
+  pool.for_each_index((int)v.size(), Nested(pool, v));
+
+  for (size_t j=0; j<v.size(); ++j)
+    for (int i=0; i<(int)v[j].size(); ++i)
+      EXPECT_EQ(i*i, v[j][i]);
+}
+
+struct RunSquares {
+  thread_pool* pool;
+  std::vector<int>* v;
+  RunSquares(thread_pool& pool, std::vector<int>& v) : pool(&pool), v(&v) { }
+  void operator()() const {
+    for (int j=0; j<50; ++j)
+      pool->for_each_index((int)v->size(), Square(*v));
+  }
+};
+
+TEST(ThreadPool, CallsFromSeveralThreads)
+{
+  thread_pool pool(4);
+  std::vector<int> v1(1000, -1), v2(1000, -1);
+  base::thread t(RunSquares(pool, v1));
+  RunSquares(pool, v2)();
+  t.join();
+
+  for (int i=0; i<1000; ++i) {
+    EXPECT_EQ(i*i, v1[i]);
+    EXPECT_EQ(i*i, v2[i]);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
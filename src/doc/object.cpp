@@ -10,9 +10,13 @@
 
 #include "doc/object.h"
 
+#include <atomic>
+
 namespace doc {
 
-static ObjectId newId = 0;
+// Objects can be created from several threads (e.g. documents of
+// the files of a sequence are loaded in parallel).
+static std::atomic<ObjectId> newId(0);
 
 Object::Object()
   : m_id(++newId)
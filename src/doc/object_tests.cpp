@@ -0,0 +1,62 @@
+// Aseprite Document Library
+// Copyright (c) 2014 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/thread.h"
+#include "doc/object.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace doc;
+
+TEST(Object, DifferentIds)
+{
+  Object a, b;
+  EXPECT_NE(NullId, a.id());
+  EXPECT_NE(NullId, b.id());
+  EXPECT_NE(a.id(), b.id());
+}
+
+struct CreateObjects {
+  std::vector<ObjectId>* ids;
+  CreateObjects(std::vector<ObjectId>& ids) : ids(&ids) { }
+  void operator()() const {
+    for (size_t i=0; i<ids->size(); ++i) {
+      Object object;
+      (*ids)[i] = object.id();
+    }
+  }
+};
+
+TEST(Object, UniqueIdsFromSeveralThreads)
+{
+  std::vector<std::vector<ObjectId> > ids(4, std::vector<ObjectId>(10000));
+  std::vector<base::thread*> threads;
+  for (size_t i=0; i<ids.size(); ++i)
+    threads.push_back(new base::thread(CreateObjects(ids[i])));
+  for (size_t i=0; i<threads.size(); ++i) {
+    threads[i]->join();
+    delete threads[i];
+  }
+
+  std::vector<ObjectId> all;
+  for (size_t i=0; i<ids.size(); ++i)
+    all.insert(all.end(), ids[i].begin(), ids[i].end());
+  std::sort(all.begin(), all.end());
+  EXPECT_TRUE(std::adjacent_find(all.begin(), all.end()) == all.end());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
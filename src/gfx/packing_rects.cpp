@@ -10,30 +10,94 @@
 
 #include "gfx/packing_rects.h"
 
-#include "gfx/region.h"
 #include "gfx/size.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
 namespace gfx {
 
+// Returns true if both rectangles share some area.
+static bool overlap(const Rect& a, const Rect& b)
+{
+  return (a.x < b.x+b.w && b.x < a.x+a.w &&
+          a.y < b.y+b.h && b.y < a.y+a.h);
+}
+
+// Calculates the score to place a rectangle of the given size in the
+// given free rectangle (lower is better).
+static void score_rect(const Rect& freeRect, int w, int h,
+                       PackingRects::Heuristic heuristic,
+                       int& score1, int& score2)
+{
+  int leftoverH = std::abs(freeRect.w - w);
+  int leftoverV = std::abs(freeRect.h - h);
+  int shortSide = std::min(leftoverH, leftoverV);
+  int longSide = std::max(leftoverH, leftoverV);
+
+  switch (heuristic) {
+
+    case PackingRects::BottomLeft:
+      score1 = freeRect.y;
+      score2 = freeRect.x;
+      break;
+
+    case PackingRects::BestShortSideFit:
+      score1 = shortSide;
+      score2 = longSide;
+      break;
+
+    case PackingRects::BestAreaFit:
+      score1 = freeRect.w*freeRect.h - w*h;
+      score2 = shortSide;
+      break;
+  }
+}
+
+PackingRects::PackingRects()
+  : m_allowRotation(false)
+{
+}
+
 void PackingRects::add(const Size& sz)
 {
   m_rects.push_back(Rect(sz));
+  m_rotated.push_back(false);
 }
 
 void PackingRects::add(const Rect& rc)
 {
   m_rects.push_back(rc);
+  m_rotated.push_back(false);
 }
 
 Size PackingRects::bestFit()
 {
+  static const Heuristic heuristics[] = {
+    BottomLeft, BestShortSideFit, BestAreaFit
+  };
+
   Size size(0, 0);
 
   // Calculate the amount of pixels that we need, the texture cannot
-  // be smaller than that.
+  // be smaller than that. Also the texture must contain the biggest
+  // rectangle.
   int neededArea = 0;
-  for (const auto& rc : m_rects) {
+  int minShortSide = 0;
+  int minLongSide = 0;
+  int minW = 0;
+  int minH = 0;
+  for (size_t i=0; i<m_rects.size(); ++i) {
+    Rect rc = m_rects[i];
+    if (m_rotated[i])
+      std::swap(rc.w, rc.h);
+
     neededArea += rc.w * rc.h;
+    minW = std::max(minW, rc.w);
+    minH = std::max(minH, rc.h);
+    minShortSide = std::max(minShortSide, std::min(rc.w, rc.h));
+    minLongSide = std::max(minLongSide, std::max(rc.w, rc.h));
   }
 
   int w = 1;
@@ -41,8 +105,17 @@ Size PackingRects::bestFit()
   int z = 0;
   bool fit = false;
   while (true) {
-    if (w*h >= neededArea) {
-      fit = pack(Size(w, h));
+    bool bigEnough =
+      (m_allowRotation ?
+       std::min(w, h) >= minShortSide && std::max(w, h) >= minLongSide:
+       w >= minW && h >= minH);
+
+    if (w*h >= neededArea && bigEnough) {
+      for (int i=0; i<int(sizeof(heuristics)/sizeof(heuristics[0])); ++i) {
+        fit = pack(Size(w, h), heuristics[i]);
+        if (fit)
+          break;
+      }
       if (fit) {
         size = Size(w, h);
         break;
@@ -58,41 +131,156 @@ Size PackingRects::bestFit()
   return size;
 }
 
-static bool by_area(const Rect* a, const Rect* b) {
-  return a->w*a->h > b->w*b->h;
-}
+namespace {
+
+  // Sorts rectangles by area (bigger first).
+  class ByArea {
+  public:
+    ByArea(const PackingRects::Rects& rects) : m_rects(rects) { }
+
+    bool operator()(int a, int b) const {
+      return (m_rects[a].w*m_rects[a].h > m_rects[b].w*m_rects[b].h);
+    }
 
-bool PackingRects::pack(const Size& size)
+  private:
+    const PackingRects::Rects& m_rects;
+  };
+
+} // anonymous namespace
+
+bool PackingRects::pack(const Size& size, Heuristic heuristic)
 {
   m_bounds = Rect(size);
 
-  // We cannot sort m_rects because we want to 
-  std::vector<Rect*> rectPtrs(m_rects.size());
-  int i = 0;
-  for (auto& rc : m_rects)
-    rectPtrs[i++] = &rc;
-  std::sort(rectPtrs.begin(), rectPtrs.end(), by_area);
-
-  gfx::Region rgn(m_bounds);
-  for (auto rcPtr : rectPtrs) {
-    gfx::Rect& rc = *rcPtr;
-
-    for (int v=0; v<=m_bounds.h-rc.h; ++v) {
-      for (int u=0; u<=m_bounds.w-rc.w; ++u) {
-        gfx::Rect possible(u, v, rc.w, rc.h);
-        Region::Overlap overlap = rgn.contains(possible);
-        if (overlap == Region::In) {
-          rc = possible;
-          rgn.createSubtraction(rgn, gfx::Region(rc));
-          goto next_rc;
+  // Restore the original size of rotated rectangles
+  for (size_t i=0; i<m_rects.size(); ++i) {
+    if (m_rotated[i]) {
+      std::swap(m_rects[i].w, m_rects[i].h);
+      m_rotated[i] = false;
+    }
+  }
+
+  // We cannot sort m_rects because we want to keep the same order
+  // of the given rectangles.
+  std::vector<int> order(m_rects.size());
+  for (size_t i=0; i<order.size(); ++i)
+    order[i] = int(i);
+  std::stable_sort(order.begin(), order.end(), ByArea(m_rects));
+
+  m_freeRects.clear();
+  m_freeRects.push_back(m_bounds);
+
+  for (size_t k=0; k<order.size(); ++k) {
+    int i = order[k];
+    Rect& rc = m_rects[i];
+
+    // Empty rectangles don't need space
+    if (rc.w <= 0 || rc.h <= 0) {
+      rc.x = rc.y = 0;
+      continue;
+    }
+
+    Rect best;
+    bool bestRotated = false;
+    int bestScore1 = INT_MAX;
+    int bestScore2 = INT_MAX;
+
+    for (size_t j=0; j<m_freeRects.size(); ++j) {
+      const Rect& freeRect = m_freeRects[j];
+      int score1, score2;
+
+      if (freeRect.w >= rc.w && freeRect.h >= rc.h) {
+        score_rect(freeRect, rc.w, rc.h, heuristic, score1, score2);
+        if (score1 < bestScore1 || (score1 == bestScore1 && score2 < bestScore2)) {
+          best = Rect(freeRect.x, freeRect.y, rc.w, rc.h);
+          bestRotated = false;
+          bestScore1 = score1;
+          bestScore2 = score2;
+        }
+      }
+
+      if (m_allowRotation && freeRect.w >= rc.h && freeRect.h >= rc.w) {
+        score_rect(freeRect, rc.h, rc.w, heuristic, score1, score2);
+        if (score1 < bestScore1 || (score1 == bestScore1 && score2 < bestScore2)) {
+          best = Rect(freeRect.x, freeRect.y, rc.h, rc.w);
+          bestRotated = true;
+          bestScore1 = score1;
+          bestScore2 = score2;
         }
       }
     }
-    return false; // There is not enough room for "rc"
-  next_rc:;
+
+    // There is not enough room for "rc"
+    if (bestScore1 == INT_MAX)
+      return false;
+
+    rc = best;
+    m_rotated[i] = bestRotated;
+    placeRect(rc);
   }
 
   return true;
 }
 
+// Removes the area of the given used rectangle from the list of free
+// rectangles.
+void PackingRects::placeRect(const Rect& usedRect)
+{
+  Rects newFreeRects;
+
+  size_t n = 0;
+  for (size_t i=0; i<m_freeRects.size(); ++i) {
+    if (overlap(m_freeRects[i], usedRect))
+      splitFreeRect(m_freeRects[i], usedRect, newFreeRects);
+    else
+      m_freeRects[n++] = m_freeRects[i];
+  }
+  m_freeRects.resize(n);
+
+  // Add only maximal rectangles (a new free rectangle cannot contain
+  // an old one, because old ones were maximal before).
+  for (size_t i=0; i<newFreeRects.size(); ++i) {
+    const Rect& rc = newFreeRects[i];
+    bool redundant = false;
+
+    for (size_t j=0; j<n && !redundant; ++j)
+      redundant = m_freeRects[j].contains(rc);
+
+    for (size_t j=0; j<newFreeRects.size() && !redundant; ++j) {
+      if (j != i &&
+          newFreeRects[j].contains(rc) &&
+          (newFreeRects[j] != rc || j < i))
+        redundant = true;
+    }
+
+    if (!redundant)
+      m_freeRects.push_back(rc);
+  }
+}
+
+// Adds to "newFreeRects" the parts of "freeRect" around "usedRect".
+void PackingRects::splitFreeRect(const Rect& freeRect, const Rect& usedRect, Rects& newFreeRects)
+{
+  int freeX2 = freeRect.x + freeRect.w;
+  int freeY2 = freeRect.y + freeRect.h;
+  int usedX2 = usedRect.x + usedRect.w;
+  int usedY2 = usedRect.y + usedRect.h;
+
+  // Above
+  if (usedRect.y > freeRect.y)
+    newFreeRects.push_back(Rect(freeRect.x, freeRect.y, freeRect.w, usedRect.y - freeRect.y));
+
+  // Below
+  if (usedY2 < freeY2)
+    newFreeRects.push_back(Rect(freeRect.x, usedY2, freeRect.w, freeY2 - usedY2));
+
+  // Left
+  if (usedRect.x > freeRect.x)
+    newFreeRects.push_back(Rect(freeRect.x, freeRect.y, usedRect.x - freeRect.x, freeRect.h));
+
+  // Right
+  if (usedX2 < freeX2)
+    newFreeRects.push_back(Rect(usedX2, freeRect.y, freeX2 - usedX2, freeRect.h));
+}
+
 } // namespace gfx
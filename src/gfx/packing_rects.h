@@ -14,12 +14,29 @@
 
 namespace gfx {
 
-  // TODO add support for rotations
+  // Packs rectangles in a texture using the "maximal rectangles"
+  // algorithm (the free space is kept as a list of all the maximal
+  // free rectangles, and each rectangle is placed in the corner of
+  // one of them).
   class PackingRects {
   public:
+    // Rule to choose the free rectangle where each rectangle is
+    // placed.
+    enum Heuristic {
+      // The top-most position (and then left-most).
+      BottomLeft,
+      // The free rectangle where the shortest leftover side is
+      // minimal.
+      BestShortSideFit,
+      // The smallest free rectangle.
+      BestAreaFit,
+    };
+
     typedef std::vector<Rect> Rects;
     typedef Rects::const_iterator const_iterator;
 
+    PackingRects();
+
     // Iterate over all given rectangles (in the same order they where
     // given in addSize() calls).
     const_iterator begin() const { return m_rects.begin(); }
@@ -28,24 +45,39 @@ namespace gfx {
     size_t size() const { return m_rects.size(); }
     const Rect& operator[](int i) const { return m_rects[i]; }
 
+    // Returns true if the given rectangle was rotated 90 degrees to
+    // pack it (its width/height in operator[] are swapped).
+    bool isRotated(int i) const { return m_rotated[i]; }
+
     // Adds a new rectangle.
     void add(const Size& sz);
     void add(const Rect& rc);
 
-    // Returns the best size for the texture.
+    // Allows to rotate rectangles 90 degrees to pack them (false by
+    // default).
+    void setAllowRotation(bool state) { m_allowRotation = state; }
+
+    // Returns the best size for the texture (power of two sizes are
+    // tried from the smallest one, with all heuristics).
     Size bestFit();
 
     // Rearrange all given rectangles to best fit a texture size.
     // Returns true if all rectangles were correctly arranged or false
     // if there is not enough space.
-    bool pack(const Size& size);
+    bool pack(const Size& size, Heuristic heuristic = BottomLeft);
 
     // Returns the bounds of the packed area.
     const Rect& bounds() const { return m_bounds; }
 
   private:
+    void placeRect(const Rect& rc);
+    void splitFreeRect(const Rect& freeRect, const Rect& usedRect, Rects& newFreeRects);
+
     Rect m_bounds;
     Rects m_rects;
+    std::vector<bool> m_rotated;
+    bool m_allowRotation;
+    Rects m_freeRects;
   };
 
 } // namespace gfx
@@ -7,6 +7,7 @@
 #include <gtest/gtest.h>
 
 #include "gfx/packing_rects.h"
+#include "gfx/point.h"
 #include "gfx/rect_io.h"
 #include "gfx/size.h"
 
@@ -89,6 +90,88 @@ TEST(PackingRects, KeepSameRectsOrder)
   EXPECT_EQ(Rect(0, 0, 30, 30), pr[2]);
 }
 
+TEST(PackingRects, Heuristics)
+{
+  // A 40x10 free area at the right and a 10x60 one at the bottom.
+  PackingRects pr;
+  pr.add(Size(60, 40));
+  pr.add(Size(10, 10));
+
+  EXPECT_TRUE(pr.pack(Size(100, 50), PackingRects::BottomLeft));
+  EXPECT_EQ(Rect(0, 0, 60, 40), pr[0]);
+  EXPECT_EQ(Rect(60, 0, 10, 10), pr[1]);
+
+  EXPECT_TRUE(pr.pack(Size(100, 50), PackingRects::BestShortSideFit));
+  EXPECT_EQ(Rect(0, 0, 60, 40), pr[0]);
+  EXPECT_EQ(Rect(0, 40, 10, 10), pr[1]);
+
+  EXPECT_TRUE(pr.pack(Size(100, 50), PackingRects::BestAreaFit));
+  EXPECT_EQ(Rect(0, 0, 60, 40), pr[0]);
+  EXPECT_EQ(Rect(0, 40, 10, 10), pr[1]);
+}
+
+TEST(PackingRects, Rotation)
+{
+  PackingRects pr;
+  pr.add(Size(64, 32));
+  pr.add(Size(32, 64));
+  EXPECT_FALSE(pr.pack(Size(64, 64)));
+
+  pr.setAllowRotation(true);
+  EXPECT_TRUE(pr.pack(Size(64, 64)));
+  EXPECT_EQ(Rect(0, 0, 64, 32), pr[0]);
+  EXPECT_EQ(Rect(0, 32, 64, 32), pr[1]);
+  EXPECT_FALSE(pr.isRotated(0));
+  EXPECT_TRUE(pr.isRotated(1));
+
+  // Rotated rectangles recover their original size in each pack()
+  pr.setAllowRotation(false);
+  EXPECT_TRUE(pr.pack(Size(96, 64)));
+  EXPECT_EQ(Rect(0, 0, 64, 32), pr[0]);
+  EXPECT_EQ(Rect(64, 0, 32, 64), pr[1]);
+  EXPECT_FALSE(pr.isRotated(1));
+}
+
+TEST(PackingRects, EmptyRects)
+{
+  PackingRects pr;
+  pr.add(Size(16, 16));
+  pr.add(Size(0, 0));
+  pr.add(Size(16, 16));
+  EXPECT_TRUE(pr.pack(Size(32, 16)));
+  EXPECT_EQ(Rect(0, 0, 16, 16), pr[0]);
+  EXPECT_TRUE(pr[1].isEmpty());
+  EXPECT_EQ(Rect(16, 0, 16, 16), pr[2]);
+}
+
+// Trimmed frames of a sprite sheet: several hundred rectangles of
+// different sizes. Checks that the packed sheet is valid.
+TEST(PackingRects, ManyTrimmedFrames)
+{
+  PackingRects pr;
+  unsigned int seed = 1;
+  int area = 0;
+  for (int i=0; i<500; ++i) {
+    seed = seed*1103515245 + 12345;
+    int w = 4 + int((seed >> 16) % 60);
+    seed = seed*1103515245 + 12345;
+    int h = 4 + int((seed >> 16) % 60);
+    pr.add(Size(w, h));
+    area += w*h;
+  }
+
+  Size size = pr.bestFit();
+  EXPECT_EQ(size, pr.bounds().getSize());
+  EXPECT_GE(size.w*size.h, area);
+  EXPECT_LE(size.w*size.h, 2*area);
+
+  for (int i=0; i<int(pr.size()); ++i) {
+    ASSERT_TRUE(pr.bounds().contains(pr[i]));
+    for (int j=i+1; j<int(pr.size()); ++j)
+      ASSERT_TRUE(pr[i].createIntersect(pr[j]).isEmpty()) << pr[i] << " " << pr[j];
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -23,10 +23,185 @@
 #include "raster/algorithm/shrink_bounds.h"
 
 #include "raster/image.h"
+#include "raster/image_traits.h"
 
 namespace raster {
 namespace algorithm {
 
+namespace {
+
+// Compares rows of pixels with a reference pixel. Transparent
+// RGB/grayscale pixels are equal to any other transparent pixel, so
+// each pixel is masked before the comparison.
+template<typename ImageTraits>
+class RowScanner {
+public:
+  typedef typename ImageTraits::pixel_t pixel_t;
+
+  // Pixels compared together (32 bytes). The inner loop of each
+  // chunk doesn't have branches, so the compiler can use SIMD
+  // instructions for it.
+  enum { chunk_pixels = 32 / sizeof(pixel_t) };
+
+  RowScanner(pixel_t mask, pixel_t ref) : m_mask(mask), m_ref(ref) { }
+
+  bool match(pixel_t pixel) const {
+    return (pixel & m_mask) == m_ref;
+  }
+
+  // Returns the first pixel in [x1, x2) that is different from the
+  // reference pixel, or x2 if there is no one.
+  int findFirst(const pixel_t* row, int x1, int x2) const {
+    int x = x1;
+    for (; x+chunk_pixels <= x2; x += chunk_pixels) {
+      if (!matchChunk(row+x))
+        break;
+    }
+    for (; x<x2; ++x) {
+      if (!match(row[x]))
+        return x;
+    }
+    return x2;
+  }
+
+  // Returns the last pixel in [x1, x2) that is different from the
+  // reference pixel, or x1-1 if there is no one.
+  int findLast(const pixel_t* row, int x1, int x2) const {
+    int x = x2;
+    for (; x-chunk_pixels >= x1; x -= chunk_pixels) {
+      if (!matchChunk(row+x-chunk_pixels))
+        break;
+    }
+    for (--x; x>=x1; --x) {
+      if (!match(row[x]))
+        return x;
+    }
+    return x1-1;
+  }
+
+private:
+  bool matchChunk(const pixel_t* p) const {
+    pixel_t diff = 0;
+    for (int i=0; i<chunk_pixels; ++i)
+      diff |= (p[i] & m_mask) ^ m_ref;
+    return (diff == 0);
+  }
+
+  pixel_t m_mask;
+  pixel_t m_ref;
+};
+
+// Mask and value that a pixel must have to be equal to "refpixel".
+// Returns false if no pixel can be equal to "refpixel".
+template<typename ImageTraits>
+bool get_ref_mask(color_t refpixel,
+                  typename ImageTraits::pixel_t& mask,
+                  typename ImageTraits::pixel_t& ref)
+{
+  if (refpixel > ImageTraits::max_value)
+    return false;
+
+  mask = ImageTraits::max_value;
+  ref = refpixel;
+  return true;
+}
+
+template<>
+bool get_ref_mask<RgbTraits>(color_t refpixel, uint32_t& mask, uint32_t& ref)
+{
+  if (rgba_geta(refpixel) == 0) {
+    mask = rgba_a_mask;
+    ref = 0;
+  }
+  else {
+    mask = RgbTraits::max_value;
+    ref = refpixel;
+  }
+  return true;
+}
+
+template<>
+bool get_ref_mask<GrayscaleTraits>(color_t refpixel, uint16_t& mask, uint16_t& ref)
+{
+  if (graya_geta(refpixel) == 0) {
+    mask = graya_a_mask;
+    ref = 0;
+  }
+  else {
+    if (refpixel > GrayscaleTraits::max_value)
+      return false;
+
+    mask = GrayscaleTraits::max_value;
+    ref = refpixel;
+  }
+  return true;
+}
+
+// Scans the image row by row: first from the top and the bottom to
+// find the first and last rows with different pixels, and then the
+// rows between them only where the left/right sides can still grow.
+template<typename ImageTraits>
+bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+
+  pixel_t mask, ref;
+  if (!get_ref_mask<ImageTraits>(refpixel, mask, ref)) {
+    bounds = image->bounds();
+    return (!bounds.isEmpty());
+  }
+
+  RowScanner<ImageTraits> scanner(mask, ref);
+  const int w = image->width();
+  const int h = image->height();
+  int left = w;
+  int right = -1;
+  int top, bottom, x;
+
+  // Shrink top side
+  for (top=0; top<h; ++top) {
+    const pixel_t* row = (const pixel_t*)image->getPixelAddress(0, top);
+    x = scanner.findFirst(row, 0, w);
+    if (x < w) {
+      left = x;
+      right = scanner.findLast(row, x, w);
+      break;
+    }
+  }
+
+  // The whole image is equal to the reference pixel (same result as
+  // the generic version).
+  if (top == h) {
+    bounds = gfx::Rect(w, 0, 0, h);
+    return false;
+  }
+
+  // Shrink bottom side
+  for (bottom=h-1; bottom>top; --bottom) {
+    const pixel_t* row = (const pixel_t*)image->getPixelAddress(0, bottom);
+    x = scanner.findFirst(row, 0, w);
+    if (x < w) {
+      left = MIN(left, x);
+      right = MAX(right, scanner.findLast(row, x, w));
+      break;
+    }
+  }
+
+  // Shrink left and right sides
+  for (int y=top+1; y<bottom && (left > 0 || right < w-1); ++y) {
+    const pixel_t* row = (const pixel_t*)image->getPixelAddress(0, y);
+    if (left > 0)
+      left = scanner.findFirst(row, 0, left);
+    if (right < w-1)
+      right = MAX(right, scanner.findLast(row, right+1, w));
+  }
+
+  bounds = gfx::Rect(left, top, right-left+1, bottom-top+1);
+  return true;
+}
+
+} // anonymous namespace
+
 static bool is_same_pixel(PixelFormat pixelFormat, color_t pixel1, color_t pixel2)
 {
   switch (pixelFormat) {
@@ -42,7 +217,7 @@ static bool is_same_pixel(PixelFormat pixelFormat, color_t pixel1, color_t pixel
   return pixel1 == pixel2;
 }
 
-bool shrink_bounds(Image *image, gfx::Rect& bounds, color_t refpixel)
+static bool shrink_bounds_generic(const Image* image, gfx::Rect& bounds, color_t refpixel)
 {
   bool shrink;
   int u, v;
@@ -110,5 +285,15 @@ bool shrink_bounds(Image *image, gfx::Rect& bounds, color_t refpixel)
   return (!bounds.isEmpty());
 }
 
+bool shrink_bounds(Image* image, gfx::Rect& bounds, color_t refpixel)
+{
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       return shrink_bounds_templ<RgbTraits>(image, bounds, refpixel);
+    case IMAGE_GRAYSCALE: return shrink_bounds_templ<GrayscaleTraits>(image, bounds, refpixel);
+    case IMAGE_INDEXED:   return shrink_bounds_templ<IndexedTraits>(image, bounds, refpixel);
+  }
+  return shrink_bounds_generic(image, bounds, refpixel);
+}
+
 } // namespace algorithm
 } // namespace raster
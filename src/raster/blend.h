@@ -48,6 +48,18 @@ namespace raster {
   int rgba_blend_blue_tint(int back, int front, int opacity);
   int rgba_blend_blackandwhite(int back, int front, int opacity);
 
+  // Same result as rgba_blend_normal(), but fully opaque and fully
+  // transparent pixels (the common case in pixel-art) are resolved
+  // inline without doing the whole blending.
+  inline int rgba_blend_normal_fast(int back, int front, int opacity) {
+    if ((front & 0xff000000) == 0xff000000 && opacity == 255)
+      return front;
+    else if ((front & 0xff000000) == 0)
+      return ((back & 0xff000000) == 0 ? front: back);
+    else
+      return rgba_blend_normal(back, front, opacity);
+  }
+
   int graya_blend_normal(int back, int front, int opacity);
   int graya_blend_copy(int back, int front, int opacity);
   int graya_blend_forpath(int back, int front, int opacity);
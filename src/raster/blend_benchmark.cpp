@@ -0,0 +1,131 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Compares the implementations of the row functions of blend_rows.h
+// blending and zooming 4K canvases. It's compiled with the
+// ENABLE_BENCHMARKS option.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/chrono.h"
+#include "raster/blend.h"
+#include "raster/blend_rows.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace raster;
+
+static const int width = 3840;
+static const int height = 2160;
+static const int times = 10;
+
+static const char* impl_name(BlendRowsImpl impl)
+{
+  switch (impl) {
+    case BLEND_ROWS_SCALAR: return "scalar";
+    case BLEND_ROWS_SSE2: return "sse2";
+    case BLEND_ROWS_AVX2: return "avx2";
+  }
+  return "";
+}
+
+static void fill_random(std::vector<color_t>& pixels, uint32_t seed)
+{
+  for (size_t i=0; i<pixels.size(); ++i) {
+    seed = seed*1103515245 + 12345;
+    pixels[i] = (seed >> 8) & 0xffffff;
+
+    // Mix of transparent, opaque and semi-transparent pixels
+    seed = seed*1103515245 + 12345;
+    int a = (seed >> 16) & 0xff;
+    pixels[i] |= (a < 64 ? 0: (a < 192 ? 255: a)) << 24;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  const BlendRowsImpl impls[] = { BLEND_ROWS_SCALAR, BLEND_ROWS_SSE2, BLEND_ROWS_AVX2 };
+  const int nimpls = sizeof(impls) / sizeof(impls[0]);
+  const int modes[] = { BLEND_MODE_NORMAL, BLEND_MODE_COPY, BLEND_MODE_MERGE };
+  const char* mode_names[] = { "normal", "copy", "merge" };
+  const int nmodes = sizeof(modes) / sizeof(modes[0]);
+  const int opacity = 200;
+
+  std::vector<color_t> back(width*height);
+  std::vector<color_t> front(width*height);
+  std::vector<color_t> dst(width*height);
+  std::vector<color_t> expected(width*height);
+  fill_random(back, 1);
+  fill_random(front, 2);
+
+  std::printf("Canvas: %dx%d, %d times\n", width, height, times);
+
+  for (int m=0; m<nmodes; ++m) {
+    for (int i=0; i<nimpls; ++i) {
+      if (!set_blend_rows_impl(impls[i]))
+        continue;
+
+      base::Chrono chrono;
+      for (int t=0; t<times; ++t)
+        for (int y=0; y<height; ++y)
+          rgba_blend_row(modes[m], &dst[y*width], &back[y*width], &front[y*width],
+                         width, opacity, 0);
+      double secs = chrono.elapsed();
+
+      bool exact = true;
+      if (impls[i] == BLEND_ROWS_SCALAR)
+        expected = dst;
+      else
+        exact = (dst == expected);
+
+      std::printf("blend %-6s %-6s %8.2f ms/canvas%s\n",
+                  mode_names[m], impl_name(impls[i]), 1000.0*secs/times,
+                  (exact ? "": " (different results)"));
+    }
+  }
+
+  // Zoom the first quarter of the canvas to the whole canvas
+  for (int box=2; box<=4; box*=2) {
+    for (int i=0; i<nimpls; ++i) {
+      if (!set_blend_rows_impl(impls[i]))
+        continue;
+
+      base::Chrono chrono;
+      for (int t=0; t<times; ++t)
+        for (int y=0; y<height; ++y)
+          rgba_zoom_row(&dst[y*width], &front[(y/box)*width], width/box, box);
+      double secs = chrono.elapsed();
+
+      bool exact = true;
+      if (impls[i] == BLEND_ROWS_SCALAR)
+        expected = dst;
+      else
+        exact = (dst == expected);
+
+      std::printf("zoom x%d       %-6s %8.2f ms/canvas%s\n",
+                  box, impl_name(impls[i]), 1000.0*secs/times,
+                  (exact ? "": " (different results)"));
+    }
+  }
+
+  return 0;
+}
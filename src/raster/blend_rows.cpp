@@ -0,0 +1,600 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "raster/blend_rows.h"
+
+#include "raster/blend.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define RASTER_BLEND_ROWS_SSE2
+  #include <emmintrin.h>
+
+  // AVX2 functions are compiled with the "target" attribute (GCC and
+  // Clang) so the rest of the program doesn't require AVX2. They are
+  // called only if the CPU supports AVX2.
+  #if defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1800)
+    #define RASTER_BLEND_ROWS_AVX2
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+      #include <intrin.h>
+      #define AVX2_FUNC
+    #else
+      #define AVX2_FUNC __attribute__((target("avx2")))
+    #endif
+  #endif
+#endif
+
+namespace raster {
+
+// Colors of rgba_blend_red_tint() and rgba_blend_blue_tint()
+static const color_t red_tint = rgba(255, 0, 0, 128);
+static const color_t blue_tint = rgba(0, 0, 255, 128);
+
+//////////////////////////////////////////////////////////////////////
+// Scalar
+
+static void blend_row_scalar(int blend_mode, color_t* dst,
+                             const color_t* back, const color_t* front, int n,
+                             int opacity, color_t mask)
+{
+  BLEND_COLOR blender = rgba_blenders[blend_mode];
+
+  if (blender == rgba_blend_normal) {
+    for (int x=0; x<n; ++x)
+      dst[x] = (front[x] != mask ? rgba_blend_normal_fast(back[x], front[x], opacity): back[x]);
+  }
+  else {
+    for (int x=0; x<n; ++x)
+      dst[x] = (front[x] != mask ? (*blender)(back[x], front[x], opacity): back[x]);
+  }
+}
+
+static void zoom_row_scalar(color_t* dst, const color_t* src, int n, int box)
+{
+  for (int x=0; x<n; ++x, dst+=box)
+    std::fill(dst, dst+box, src[x]);
+}
+
+#ifdef RASTER_BLEND_ROWS_SSE2
+
+//////////////////////////////////////////////////////////////////////
+// SSE2 (4 pixels per iteration)
+//
+// Each channel of 4 pixels is processed in 32-bit lanes. The division
+// by the destination alpha of rgba_blend_normal() is done with floats:
+// the numerator and denominator are exact, and the quotient is always
+// an integer or at least 1/255 away from one, so truncating the
+// rounded quotient gives the same result as the integer division.
+
+// INT_MULT() of values in [0,255]
+static inline __m128i sse2_int_mult(__m128i a, __m128i b)
+{
+  __m128i t = _mm_add_epi32(_mm_mullo_epi16(a, b), _mm_set1_epi32(0x80));
+  return _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(t, 8), t), 8);
+}
+
+// INT_MULT() of a value in [-255,255] and other in [0,255]
+static inline __m128i sse2_int_mult_signed(__m128i a, __m128i b)
+{
+  __m128i t = _mm_add_epi32(_mm_madd_epi16(a, b), _mm_set1_epi32(0x80));
+  return _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(t, 8), t), 8);
+}
+
+static inline __m128i sse2_select(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i sse2_channel(__m128i c, int shift)
+{
+  return _mm_and_si128(_mm_srli_epi32(c, shift), _mm_set1_epi32(0xff));
+}
+
+static inline __m128i sse2_rgba(__m128i r, __m128i g, __m128i b, __m128i a)
+{
+  __m128i ff = _mm_set1_epi32(0xff);
+  return _mm_or_si128(
+    _mm_or_si128(_mm_and_si128(r, ff),
+                 _mm_slli_epi32(_mm_and_si128(g, ff), 8)),
+    _mm_or_si128(_mm_slli_epi32(_mm_and_si128(b, ff), 16),
+                 _mm_slli_epi32(a, 24)));
+}
+
+static inline __m128i sse2_blend_normal(__m128i back, __m128i front, __m128i opacity)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i B_a = _mm_srli_epi32(back, 24);
+  __m128i F_a = sse2_int_mult(_mm_srli_epi32(front, 24), opacity);
+  __m128i D_a = _mm_sub_epi32(_mm_add_epi32(B_a, F_a), sse2_int_mult(B_a, F_a));
+  __m128 D_af = _mm_cvtepi32_ps(D_a);
+  __m128i D[3];
+
+  for (int i=0; i<3; ++i) {
+    __m128i B_c = sse2_channel(back, i*8);
+    __m128i F_c = sse2_channel(front, i*8);
+    __m128 q = _mm_div_ps(_mm_cvtepi32_ps(_mm_madd_epi16(_mm_sub_epi32(F_c, B_c), F_a)), D_af);
+    D[i] = _mm_add_epi32(B_c, _mm_cvttps_epi32(q));
+  }
+
+  __m128i blended = sse2_rgba(D[0], D[1], D[2], D_a);
+  __m128i transparentBack =
+    _mm_or_si128(_mm_and_si128(front, _mm_set1_epi32(0xffffff)),
+                 _mm_slli_epi32(F_a, 24));
+
+  return sse2_select(_mm_cmpeq_epi32(B_a, zero), transparentBack,
+                     sse2_select(_mm_cmpeq_epi32(_mm_srli_epi32(front, 24), zero),
+                                 back, blended));
+}
+
+static inline __m128i sse2_blend_merge(__m128i back, __m128i front, __m128i opacity)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i B_a = _mm_srli_epi32(back, 24);
+  __m128i F_a = _mm_srli_epi32(front, 24);
+  __m128i D_a = _mm_add_epi32(B_a, sse2_int_mult_signed(_mm_sub_epi32(F_a, B_a), opacity));
+  __m128i D[3];
+
+  for (int i=0; i<3; ++i) {
+    __m128i B_c = sse2_channel(back, i*8);
+    __m128i F_c = sse2_channel(front, i*8);
+    D[i] = _mm_add_epi32(B_c, sse2_int_mult_signed(_mm_sub_epi32(F_c, B_c), opacity));
+  }
+
+  __m128i rgb = _mm_and_si128(sse2_rgba(D[0], D[1], D[2], zero), _mm_set1_epi32(0xffffff));
+  rgb = sse2_select(_mm_cmpeq_epi32(F_a, zero), _mm_and_si128(back, _mm_set1_epi32(0xffffff)), rgb);
+  rgb = sse2_select(_mm_cmpeq_epi32(B_a, zero), _mm_and_si128(front, _mm_set1_epi32(0xffffff)), rgb);
+  rgb = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(D_a, _mm_set1_epi32(0xff)), zero), rgb);
+
+  return _mm_or_si128(rgb, _mm_slli_epi32(D_a, 24));
+}
+
+// DIV_ONE_UN8() of blend.cpp (unsigned 32-bit values)
+static inline __m128i sse2_div_one_un8(__m128i x)
+{
+  __m128i t = _mm_add_epi32(x, _mm_set1_epi32(0x80));
+  return _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(t, 8), t), 8);
+}
+
+// blend_overlay() of blend.cpp with a constant source channel/alpha
+// (s/as). The products are computed with 32-bit wrap-around as the
+// unsigned arithmetic of the original function.
+static inline __m128i sse2_blend_overlay(__m128i d, __m128i ad, int s, int as)
+{
+  __m128i r1 = _mm_madd_epi16(d, _mm_set1_epi32(2*s));
+  __m128i r2 = _mm_sub_epi32(_mm_madd_epi16(ad, _mm_set1_epi32(as)),
+                             _mm_madd_epi16(_mm_sub_epi32(ad, d),
+                                            _mm_set1_epi32((2*(as-s)) & 0xffff)));
+  return sse2_div_one_un8(sse2_select(_mm_cmplt_epi32(_mm_add_epi32(d, d), ad), r1, r2));
+}
+
+static inline __m128i sse2_blend_color_tint(__m128i back, __m128i front, __m128i opacity,
+                                            color_t color)
+{
+  int F_a = rgba_geta(color);
+  __m128i B_a = _mm_srli_epi32(front, 24);
+  __m128i D[3];
+
+  for (int i=0; i<3; ++i)
+    D[i] = sse2_blend_overlay(sse2_channel(front, i*8), B_a, (color >> (i*8)) & 0xff, F_a);
+
+  // (B_a*(~B_a) + F_a*(~F_a)) / 255 is negative, it's truncated to
+  // zero as the integer division.
+  __m128i num = _mm_add_epi32(_mm_madd_epi16(B_a, _mm_add_epi32(B_a, _mm_set1_epi32(1))),
+                              _mm_set1_epi32(F_a*(F_a+1)));
+  __m128i D_a = _mm_sub_epi32(_mm_setzero_si128(),
+                              _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(num),
+                                                          _mm_set1_ps(255.0f))));
+  D_a = _mm_add_epi32(D_a, sse2_int_mult_signed(D_a, B_a));
+  D_a = _mm_and_si128(D_a, _mm_set1_epi32(0xff));
+
+  return sse2_blend_normal(back, sse2_rgba(D[0], D[1], D[2], D_a), opacity);
+}
+
+static inline __m128i sse2_blend_blackandwhite(__m128i back, __m128i front)
+{
+  __m128i B_a = _mm_srli_epi32(back, 24);
+  __m128i v = _mm_add_epi32(
+    _mm_add_epi32(_mm_madd_epi16(sse2_channel(back, 0), _mm_set1_epi32(30)),
+                  _mm_madd_epi16(sse2_channel(back, 8), _mm_set1_epi32(59))),
+    _mm_madd_epi16(sse2_channel(back, 16), _mm_set1_epi32(11)));
+
+  // (v/100 < 128) is white, black otherwise
+  __m128i white = _mm_cmplt_epi32(v, _mm_set1_epi32(12800));
+  __m128i d = _mm_or_si128(_mm_and_si128(white, _mm_set1_epi32(0xffffff)),
+                           _mm_set1_epi32(0xff000000));
+
+  return sse2_select(_mm_cmpeq_epi32(B_a, _mm_setzero_si128()), front, d);
+}
+
+// Returns the number of blended pixels
+static int blend_row_sse2(int blend_mode, color_t* dst,
+                          const color_t* back, const color_t* front, int n,
+                          int opacity, color_t mask)
+{
+  __m128i opacityv = _mm_set1_epi32(opacity);
+  __m128i maskv = _mm_set1_epi32(mask);
+  int x = 0;
+
+  for (; x+4<=n; x+=4) {
+    __m128i b = _mm_loadu_si128((const __m128i*)(back+x));
+    __m128i f = _mm_loadu_si128((const __m128i*)(front+x));
+    __m128i d;
+
+    switch (blend_mode) {
+      case BLEND_MODE_NORMAL: d = sse2_blend_normal(b, f, opacityv); break;
+      case BLEND_MODE_MERGE: d = sse2_blend_merge(b, f, opacityv); break;
+      case BLEND_MODE_RED_TINT: d = sse2_blend_color_tint(b, f, opacityv, red_tint); break;
+      case BLEND_MODE_BLUE_TINT: d = sse2_blend_color_tint(b, f, opacityv, blue_tint); break;
+      case BLEND_MODE_BLACKANDWHITE: d = sse2_blend_blackandwhite(b, f); break;
+      default: d = f; break;
+    }
+
+    _mm_storeu_si128((__m128i*)(dst+x), sse2_select(_mm_cmpeq_epi32(f, maskv), b, d));
+  }
+
+  return x;
+}
+
+// Returns the number of zoomed pixels of "src"
+static int zoom_row_sse2(color_t* dst, const color_t* src, int n, int box)
+{
+  int x = 0;
+
+  if (box == 2) {
+    for (; x+4<=n; x+=4, dst+=8) {
+      __m128i c = _mm_loadu_si128((const __m128i*)(src+x));
+      _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi32(c, c));
+      _mm_storeu_si128((__m128i*)(dst+4), _mm_unpackhi_epi32(c, c));
+    }
+  }
+  else if (box == 4) {
+    for (; x+4<=n; x+=4, dst+=16) {
+      __m128i c = _mm_loadu_si128((const __m128i*)(src+x));
+      _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi32(c, 0x00));
+      _mm_storeu_si128((__m128i*)(dst+4), _mm_shuffle_epi32(c, 0x55));
+      _mm_storeu_si128((__m128i*)(dst+8), _mm_shuffle_epi32(c, 0xaa));
+      _mm_storeu_si128((__m128i*)(dst+12), _mm_shuffle_epi32(c, 0xff));
+    }
+  }
+  else if ((box % 4) == 0) {
+    for (; x<n; ++x) {
+      __m128i c = _mm_set1_epi32(src[x]);
+      for (int u=0; u<box; u+=4, dst+=4)
+        _mm_storeu_si128((__m128i*)dst, c);
+    }
+  }
+
+  return x;
+}
+
+#endif // RASTER_BLEND_ROWS_SSE2
+
+#ifdef RASTER_BLEND_ROWS_AVX2
+
+//////////////////////////////////////////////////////////////////////
+// AVX2 (8 pixels per iteration, same operations of the SSE2 version)
+
+AVX2_FUNC static inline __m256i avx2_int_mult(__m256i a, __m256i b)
+{
+  __m256i t = _mm256_add_epi32(_mm256_mullo_epi16(a, b), _mm256_set1_epi32(0x80));
+  return _mm256_srli_epi32(_mm256_add_epi32(_mm256_srli_epi32(t, 8), t), 8);
+}
+
+AVX2_FUNC static inline __m256i avx2_int_mult_signed(__m256i a, __m256i b)
+{
+  __m256i t = _mm256_add_epi32(_mm256_madd_epi16(a, b), _mm256_set1_epi32(0x80));
+  return _mm256_srai_epi32(_mm256_add_epi32(_mm256_srai_epi32(t, 8), t), 8);
+}
+
+AVX2_FUNC static inline __m256i avx2_select(__m256i mask, __m256i a, __m256i b)
+{
+  return _mm256_or_si256(_mm256_and_si256(mask, a), _mm256_andnot_si256(mask, b));
+}
+
+AVX2_FUNC static inline __m256i avx2_channel(__m256i c, int shift)
+{
+  return _mm256_and_si256(_mm256_srli_epi32(c, shift), _mm256_set1_epi32(0xff));
+}
+
+AVX2_FUNC static inline __m256i avx2_rgba(__m256i r, __m256i g, __m256i b, __m256i a)
+{
+  __m256i ff = _mm256_set1_epi32(0xff);
+  return _mm256_or_si256(
+    _mm256_or_si256(_mm256_and_si256(r, ff),
+                    _mm256_slli_epi32(_mm256_and_si256(g, ff), 8)),
+    _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(b, ff), 16),
+                    _mm256_slli_epi32(a, 24)));
+}
+
+AVX2_FUNC static inline __m256i avx2_blend_normal(__m256i back, __m256i front, __m256i opacity)
+{
+  __m256i zero = _mm256_setzero_si256();
+  __m256i B_a = _mm256_srli_epi32(back, 24);
+  __m256i F_a = avx2_int_mult(_mm256_srli_epi32(front, 24), opacity);
+  __m256i D_a = _mm256_sub_epi32(_mm256_add_epi32(B_a, F_a), avx2_int_mult(B_a, F_a));
+  __m256 D_af = _mm256_cvtepi32_ps(D_a);
+  __m256i D[3];
+
+  for (int i=0; i<3; ++i) {
+    __m256i B_c = avx2_channel(back, i*8);
+    __m256i F_c = avx2_channel(front, i*8);
+    __m256 q = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(_mm256_sub_epi32(F_c, B_c), F_a)), D_af);
+    D[i] = _mm256_add_epi32(B_c, _mm256_cvttps_epi32(q));
+  }
+
+  __m256i blended = avx2_rgba(D[0], D[1], D[2], D_a);
+  __m256i transparentBack =
+    _mm256_or_si256(_mm256_and_si256(front, _mm256_set1_epi32(0xffffff)),
+                    _mm256_slli_epi32(F_a, 24));
+
+  return avx2_select(_mm256_cmpeq_epi32(B_a, zero), transparentBack,
+                     avx2_select(_mm256_cmpeq_epi32(_mm256_srli_epi32(front, 24), zero),
+                                 back, blended));
+}
+
+AVX2_FUNC static inline __m256i avx2_blend_merge(__m256i back, __m256i front, __m256i opacity)
+{
+  __m256i zero = _mm256_setzero_si256();
+  __m256i B_a = _mm256_srli_epi32(back, 24);
+  __m256i F_a = _mm256_srli_epi32(front, 24);
+  __m256i D_a = _mm256_add_epi32(B_a, avx2_int_mult_signed(_mm256_sub_epi32(F_a, B_a), opacity));
+  __m256i D[3];
+
+  for (int i=0; i<3; ++i) {
+    __m256i B_c = avx2_channel(back, i*8);
+    __m256i F_c = avx2_channel(front, i*8);
+    D[i] = _mm256_add_epi32(B_c, avx2_int_mult_signed(_mm256_sub_epi32(F_c, B_c), opacity));
+  }
+
+  __m256i rgbMask = _mm256_set1_epi32(0xffffff);
+  __m256i rgb = _mm256_and_si256(avx2_rgba(D[0], D[1], D[2], zero), rgbMask);
+  rgb = avx2_select(_mm256_cmpeq_epi32(F_a, zero), _mm256_and_si256(back, rgbMask), rgb);
+  rgb = avx2_select(_mm256_cmpeq_epi32(B_a, zero), _mm256_and_si256(front, rgbMask), rgb);
+  rgb = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(D_a, _mm256_set1_epi32(0xff)), zero), rgb);
+
+  return _mm256_or_si256(rgb, _mm256_slli_epi32(D_a, 24));
+}
+
+AVX2_FUNC static inline __m256i avx2_div_one_un8(__m256i x)
+{
+  __m256i t = _mm256_add_epi32(x, _mm256_set1_epi32(0x80));
+  return _mm256_srli_epi32(_mm256_add_epi32(_mm256_srli_epi32(t, 8), t), 8);
+}
+
+AVX2_FUNC static inline __m256i avx2_blend_overlay(__m256i d, __m256i ad, int s, int as)
+{
+  __m256i r1 = _mm256_madd_epi16(d, _mm256_set1_epi32(2*s));
+  __m256i r2 = _mm256_sub_epi32(_mm256_madd_epi16(ad, _mm256_set1_epi32(as)),
+                                _mm256_madd_epi16(_mm256_sub_epi32(ad, d),
+                                                  _mm256_set1_epi32((2*(as-s)) & 0xffff)));
+  return avx2_div_one_un8(avx2_select(_mm256_cmpgt_epi32(ad, _mm256_add_epi32(d, d)), r1, r2));
+}
+
+AVX2_FUNC static inline __m256i avx2_blend_color_tint(__m256i back, __m256i front, __m256i opacity,
+                                                      color_t color)
+{
+  int F_a = rgba_geta(color);
+  __m256i B_a = _mm256_srli_epi32(front, 24);
+  __m256i D[3];
+
+  for (int i=0; i<3; ++i)
+    D[i] = avx2_blend_overlay(avx2_channel(front, i*8), B_a, (color >> (i*8)) & 0xff, F_a);
+
+  __m256i num = _mm256_add_epi32(_mm256_madd_epi16(B_a, _mm256_add_epi32(B_a, _mm256_set1_epi32(1))),
+                                 _mm256_set1_epi32(F_a*(F_a+1)));
+  __m256i D_a = _mm256_sub_epi32(_mm256_setzero_si256(),
+                                 _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(num),
+                                                                   _mm256_set1_ps(255.0f))));
+  D_a = _mm256_add_epi32(D_a, avx2_int_mult_signed(D_a, B_a));
+  D_a = _mm256_and_si256(D_a, _mm256_set1_epi32(0xff));
+
+  return avx2_blend_normal(back, avx2_rgba(D[0], D[1], D[2], D_a), opacity);
+}
+
+AVX2_FUNC static inline __m256i avx2_blend_blackandwhite(__m256i back, __m256i front)
+{
+  __m256i B_a = _mm256_srli_epi32(back, 24);
+  __m256i v = _mm256_add_epi32(
+    _mm256_add_epi32(_mm256_madd_epi16(avx2_channel(back, 0), _mm256_set1_epi32(30)),
+                     _mm256_madd_epi16(avx2_channel(back, 8), _mm256_set1_epi32(59))),
+    _mm256_madd_epi16(avx2_channel(back, 16), _mm256_set1_epi32(11)));
+
+  __m256i white = _mm256_cmpgt_epi32(_mm256_set1_epi32(12800), v);
+  __m256i d = _mm256_or_si256(_mm256_and_si256(white, _mm256_set1_epi32(0xffffff)),
+                              _mm256_set1_epi32(0xff000000));
+
+  return avx2_select(_mm256_cmpeq_epi32(B_a, _mm256_setzero_si256()), front, d);
+}
+
+AVX2_FUNC static int blend_row_avx2(int blend_mode, color_t* dst,
+                                    const color_t* back, const color_t* front, int n,
+                                    int opacity, color_t mask)
+{
+  __m256i opacityv = _mm256_set1_epi32(opacity);
+  __m256i maskv = _mm256_set1_epi32(mask);
+  int x = 0;
+
+  for (; x+8<=n; x+=8) {
+    __m256i b = _mm256_loadu_si256((const __m256i*)(back+x));
+    __m256i f = _mm256_loadu_si256((const __m256i*)(front+x));
+    __m256i d;
+
+    switch (blend_mode) {
+      case BLEND_MODE_NORMAL: d = avx2_blend_normal(b, f, opacityv); break;
+      case BLEND_MODE_MERGE: d = avx2_blend_merge(b, f, opacityv); break;
+      case BLEND_MODE_RED_TINT: d = avx2_blend_color_tint(b, f, opacityv, red_tint); break;
+      case BLEND_MODE_BLUE_TINT: d = avx2_blend_color_tint(b, f, opacityv, blue_tint); break;
+      case BLEND_MODE_BLACKANDWHITE: d = avx2_blend_blackandwhite(b, f); break;
+      default: d = f; break;
+    }
+
+    _mm256_storeu_si256((__m256i*)(dst+x), avx2_select(_mm256_cmpeq_epi32(f, maskv), b, d));
+  }
+
+  return x;
+}
+
+AVX2_FUNC static int zoom_row_avx2(color_t* dst, const color_t* src, int n, int box)
+{
+  int x = 0;
+
+  if (box == 2) {
+    __m256i lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    __m256i hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    for (; x+8<=n; x+=8, dst+=16) {
+      __m256i c = _mm256_loadu_si256((const __m256i*)(src+x));
+      _mm256_storeu_si256((__m256i*)dst, _mm256_permutevar8x32_epi32(c, lo));
+      _mm256_storeu_si256((__m256i*)(dst+8), _mm256_permutevar8x32_epi32(c, hi));
+    }
+  }
+  else if (box == 4) {
+    __m256i idx = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    __m256i two = _mm256_set1_epi32(2);
+    for (; x+8<=n; x+=8, dst+=32) {
+      __m256i c = _mm256_loadu_si256((const __m256i*)(src+x));
+      __m256i i = idx;
+      for (int j=0; j<4; ++j, i=_mm256_add_epi32(i, two))
+        _mm256_storeu_si256((__m256i*)(dst+j*8), _mm256_permutevar8x32_epi32(c, i));
+    }
+  }
+  else if ((box % 8) == 0) {
+    for (; x<n; ++x) {
+      __m256i c = _mm256_set1_epi32(src[x]);
+      for (int u=0; u<box; u+=8, dst+=8)
+        _mm256_storeu_si256((__m256i*)dst, c);
+    }
+  }
+
+  return x;
+}
+
+static bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+
+  // The OS must save the AVX registers (OSXSAVE and XCR0 bits).
+  __cpuid(info, 1);
+  if ((info[2] & (1<<27)) == 0 || (info[2] & (1<<28)) == 0 ||
+      (_xgetbv(0) & 6) != 6)
+    return false;
+
+  __cpuidex(info, 7, 0);
+  return ((info[1] & (1<<5)) != 0);
+#else
+  __builtin_cpu_init();
+  return (__builtin_cpu_supports("avx2") ? true: false);
+#endif
+}
+
+#endif // RASTER_BLEND_ROWS_AVX2
+
+//////////////////////////////////////////////////////////////////////
+// Dispatch
+
+static bool is_supported(BlendRowsImpl impl)
+{
+  switch (impl) {
+    case BLEND_ROWS_SCALAR:
+      return true;
+#ifdef RASTER_BLEND_ROWS_SSE2
+    case BLEND_ROWS_SSE2:
+      return true;
+#endif
+#ifdef RASTER_BLEND_ROWS_AVX2
+    case BLEND_ROWS_AVX2:
+      return cpu_has_avx2();
+#endif
+    default:
+      return false;
+  }
+}
+
+static BlendRowsImpl best_impl()
+{
+  if (is_supported(BLEND_ROWS_AVX2))
+    return BLEND_ROWS_AVX2;
+  else if (is_supported(BLEND_ROWS_SSE2))
+    return BLEND_ROWS_SSE2;
+  else
+    return BLEND_ROWS_SCALAR;
+}
+
+static BlendRowsImpl current_impl = best_impl();
+
+BlendRowsImpl get_blend_rows_impl()
+{
+  return current_impl;
+}
+
+bool set_blend_rows_impl(BlendRowsImpl impl)
+{
+  if (!is_supported(impl))
+    return false;
+
+  current_impl = impl;
+  return true;
+}
+
+void rgba_blend_row(int blend_mode, color_t* dst,
+                    const color_t* back, const color_t* front, int n,
+                    int opacity, color_t mask)
+{
+  int x = 0;
+
+  if (blend_mode >= 0 && blend_mode < BLEND_MODE_MAX) {
+#ifdef RASTER_BLEND_ROWS_AVX2
+    if (current_impl == BLEND_ROWS_AVX2)
+      x = blend_row_avx2(blend_mode, dst, back, front, n, opacity, mask);
+#endif
+#ifdef RASTER_BLEND_ROWS_SSE2
+    // SSE2 is used for all pixels, or for the last ones left by AVX2.
+    if (current_impl != BLEND_ROWS_SCALAR)
+      x += blend_row_sse2(blend_mode, dst+x, back+x, front+x, n-x, opacity, mask);
+#endif
+  }
+
+  blend_row_scalar(blend_mode, dst+x, back+x, front+x, n-x, opacity, mask);
+}
+
+void rgba_zoom_row(color_t* dst, const color_t* src, int n, int box)
+{
+  int x = 0;
+
+#ifdef RASTER_BLEND_ROWS_AVX2
+  if (current_impl == BLEND_ROWS_AVX2)
+    x = zoom_row_avx2(dst, src, n, box);
+#endif
+#ifdef RASTER_BLEND_ROWS_SSE2
+  if (current_impl != BLEND_ROWS_SCALAR)
+    x += zoom_row_sse2(dst+x*box, src+x, n-x, box);
+#endif
+
+  zoom_row_scalar(dst+x*box, src+x, n-x, box);
+}
+
+} // namespace raster
@@ -0,0 +1,57 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef RASTER_BLEND_ROWS_H_INCLUDED
+#define RASTER_BLEND_ROWS_H_INCLUDED
+#pragma once
+
+#include "raster/color.h"
+
+namespace raster {
+
+  // Implementations of the row functions. The fastest one supported
+  // by the CPU is selected at runtime.
+  enum BlendRowsImpl {
+    BLEND_ROWS_SCALAR,
+    BLEND_ROWS_SSE2,
+    BLEND_ROWS_AVX2,
+  };
+
+  BlendRowsImpl get_blend_rows_impl();
+
+  // Changes the implementation used by the row functions (to compare
+  // them in tests and benchmarks). Returns false if the CPU doesn't
+  // support the given implementation.
+  bool set_blend_rows_impl(BlendRowsImpl impl);
+
+  // Blends "n" pixels of "front" over "back" with the given
+  // BLEND_MODE_*, and puts the result in "dst" ("dst" can be
+  // "back"). "front" pixels equal to "mask" leave the "back" pixel
+  // unchanged. The result is the same as calling rgba_blenders[] for
+  // each pixel; all modes are vectorized.
+  void rgba_blend_row(int blend_mode, color_t* dst,
+                      const color_t* back, const color_t* front, int n,
+                      int opacity, color_t mask);
+
+  // Puts each pixel of "src" "box" times in "dst" (nearest-neighbor
+  // zoom of a row), "dst" must have room for n*box pixels.
+  void rgba_zoom_row(color_t* dst, const color_t* src, int n, int box);
+
+} // namespace raster
+
+#endif
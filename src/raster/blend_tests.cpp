@@ -0,0 +1,140 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "raster/blend.h"
+#include "raster/blend_rows.h"
+#include "raster/color.h"
+
+#include <vector>
+
+using namespace raster;
+
+TEST(Blend, NormalFastIsBitExact)
+{
+  const int values[] = { 0, 1, 64, 127, 128, 200, 254, 255 };
+  const int n = sizeof(values) / sizeof(values[0]);
+
+  for (int ba=0; ba<n; ++ba)
+    for (int fa=0; fa<n; ++fa)
+      for (int op=0; op<n; ++op)
+        for (int c=0; c<n; ++c) {
+          int back = rgba(values[c], values[n-1-c], 32, values[ba]);
+          int front = rgba(values[n-1-c], 16, values[c], values[fa]);
+
+          EXPECT_EQ(rgba_blend_normal(back, front, values[op]),
+                    rgba_blend_normal_fast(back, front, values[op]));
+        }
+}
+
+// Pixels with random components, and common alpha values
+static std::vector<color_t> random_pixels(int n, uint32_t seed)
+{
+  const int alphas[] = { 0, 1, 127, 128, 254, 255 };
+  std::vector<color_t> pixels(n);
+
+  for (int i=0; i<n; ++i) {
+    seed = seed*1103515245 + 12345;
+    pixels[i] = (seed >> 8) & 0xffffff;
+
+    seed = seed*1103515245 + 12345;
+    int a = (seed >> 16) & 0xff;
+    pixels[i] |= (a < 128 ? alphas[a % 6]: a) << 24;
+  }
+
+  return pixels;
+}
+
+TEST(Blend, RowsAreBitExact)
+{
+  const int modes[] = { BLEND_MODE_NORMAL, BLEND_MODE_COPY, BLEND_MODE_MERGE,
+                        BLEND_MODE_RED_TINT, BLEND_MODE_BLUE_TINT,
+                        BLEND_MODE_BLACKANDWHITE };
+  const int opacities[] = { 0, 1, 127, 128, 200, 255 };
+  const BlendRowsImpl impls[] = { BLEND_ROWS_SCALAR, BLEND_ROWS_SSE2, BLEND_ROWS_AVX2 };
+  const int n = 4099;
+  BlendRowsImpl oldImpl = get_blend_rows_impl();
+
+  std::vector<color_t> back = random_pixels(n, 1);
+  std::vector<color_t> front = random_pixels(n, 2);
+  color_t mask = front[10];
+
+  for (int i=0; i<int(sizeof(impls)/sizeof(impls[0])); ++i) {
+    if (!set_blend_rows_impl(impls[i]))
+      continue;
+
+    for (int m=0; m<int(sizeof(modes)/sizeof(modes[0])); ++m) {
+      for (int o=0; o<int(sizeof(opacities)/sizeof(opacities[0])); ++o) {
+        std::vector<color_t> dst(n);
+        rgba_blend_row(modes[m], &dst[0], &back[0], &front[0], n, opacities[o], mask);
+
+        for (int x=0; x<n; ++x) {
+          color_t expected =
+            (front[x] != mask ? rgba_blenders[modes[m]](back[x], front[x], opacities[o]):
+                                back[x]);
+          ASSERT_EQ(expected, dst[x])
+            << "impl=" << impls[i] << " mode=" << modes[m] << " opacity=" << opacities[o]
+            << " back=" << back[x] << " front=" << front[x];
+        }
+
+        // Blend in place
+        std::vector<color_t> inplace = back;
+        rgba_blend_row(modes[m], &inplace[0], &inplace[0], &front[0], n, opacities[o], mask);
+        EXPECT_EQ(dst, inplace);
+      }
+    }
+  }
+
+  set_blend_rows_impl(oldImpl);
+}
+
+TEST(Blend, ZoomRows)
+{
+  const BlendRowsImpl impls[] = { BLEND_ROWS_SCALAR, BLEND_ROWS_SSE2, BLEND_ROWS_AVX2 };
+  BlendRowsImpl oldImpl = get_blend_rows_impl();
+  std::vector<color_t> src = random_pixels(37, 3);
+
+  for (int i=0; i<int(sizeof(impls)/sizeof(impls[0])); ++i) {
+    if (!set_blend_rows_impl(impls[i]))
+      continue;
+
+    for (int box=1; box<=16; ++box) {
+      for (int n=0; n<=int(src.size()); ++n) {
+        std::vector<color_t> dst(n*box+1, 0);
+        rgba_zoom_row(&dst[0], &src[0], n, box);
+
+        for (int x=0; x<n*box; ++x)
+          ASSERT_EQ(src[x/box], dst[x]) << "impl=" << impls[i] << " box=" << box << " n=" << n;
+        EXPECT_EQ(0u, dst[n*box]);
+      }
+    }
+  }
+
+  set_blend_rows_impl(oldImpl);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -43,6 +43,7 @@ namespace quantization {
 
     ColorHistogram()
       : m_histogram(RElements*GElements*BElements, 0)
+      , m_highPrecisionTable(HighPrecisionTableSize, -1)
       , m_useHighPrecision(true)
     {
     }
@@ -69,21 +70,29 @@ namespace quantization {
       // Accurate colors are used only for less than 256 colors.  If the
       // image has more than 256 colors the m_histogram is used
       // instead.
-      if (m_useHighPrecision) {
-        std::vector<uint32_t>::iterator it =
-          std::find(m_highPrecision.begin(), m_highPrecision.end(), color);
-
-        // The color is not in the high-precision table
-        if (it == m_highPrecision.end()) {
-          if (m_highPrecision.size() < 256) {
-            m_highPrecision.push_back(color);
-          }
-          else {
-            // In this case we reach the limit for the high-precision histogram.
-            m_useHighPrecision = false;
-          }
-        }
+      if (m_useHighPrecision)
+        addHighPrecisionColor(color);
+    }
+
+    // Adds all the samples of "other" histogram to this one. The
+    // result is the same as if all the samples of "other" were added
+    // after the samples of this histogram (so histograms of
+    // different sets of images can be created in parallel, and then
+    // merged in order).
+    void merge(const ColorHistogram& other)
+    {
+      for (size_t i=0; i<m_histogram.size(); ++i) {
+        if (m_histogram[i] < std::numeric_limits<size_t>::max()-other.m_histogram[i])
+          m_histogram[i] += other.m_histogram[i];
+        else
+          m_histogram[i] = std::numeric_limits<size_t>::max();
       }
+
+      if (!other.m_useHighPrecision)
+        m_useHighPrecision = false;
+
+      for (size_t i=0; i<other.m_highPrecision.size() && m_useHighPrecision; ++i)
+        addHighPrecisionColor(other.m_highPrecision[i]);
     }
 
     // Creates a set of entries for the given palette in the given range
@@ -113,6 +122,37 @@ namespace quantization {
     }
 
   private:
+    // Size of the hash table for high-precision colors (it has more
+    // than twice the slots of the maximum number of colors).
+    enum {
+      HighPrecisionTableBits = 9,
+      HighPrecisionTableSize = 1 << HighPrecisionTableBits
+    };
+
+    void addHighPrecisionColor(uint32_t color)
+    {
+      // Open addressing hash table with the indexes of the colors in
+      // m_highPrecision (-1 for empty slots).
+      size_t slot = (color * 2654435761u) >> (32-HighPrecisionTableBits);
+      for (;;) {
+        int index = m_highPrecisionTable[slot];
+        if (index < 0)
+          break;
+        else if (m_highPrecision[index] == color)
+          return;               // The color is already in the high-precision table
+        slot = (slot+1) & (HighPrecisionTableSize-1);
+      }
+
+      if (m_highPrecision.size() < 256) {
+        m_highPrecisionTable[slot] = (int)m_highPrecision.size();
+        m_highPrecision.push_back(color);
+      }
+      else {
+        // In this case we reach the limit for the high-precision histogram.
+        m_useHighPrecision = false;
+      }
+    }
+
     // Converts input color in a index for the histogram. It reduces
     // each 8-bit component to the resolution given in the template
     // parameters.
@@ -135,6 +175,9 @@ namespace quantization {
     // source images contains less than 256 colors.
     std::vector<uint32_t> m_highPrecision;
 
+    // Hash table to find colors in m_highPrecision.
+    std::vector<int> m_highPrecisionTable;
+
     // True if we can use m_highPrecision still (it means that the
     // number of different samples is less than 256 colors still).
     bool m_useHighPrecision;
@@ -34,31 +34,10 @@ Dirty::Dirty(PixelFormat format, int x1, int y1, int x2, int y2)
   : m_format(format)
   , m_x1(x1), m_y1(y1)
   , m_x2(x2), m_y2(y2)
+  , m_dataSize(0)
 {
 }
 
-Dirty::Dirty(const Dirty& src)
-  : m_format(src.m_format)
-  , m_x1(src.m_x1), m_y1(src.m_y1)
-  , m_x2(src.m_x2), m_y2(src.m_y2)
-{
-  m_rows.resize(src.m_rows.size());
-
-  for (size_t v=0; v<m_rows.size(); ++v) {
-    const Row& srcRow = src.getRow(v);
-    Row* row = new Row(srcRow.y);
-
-    row->cols.resize(srcRow.cols.size());
-
-    for (size_t u=0; u<row->cols.size(); ++u) {
-      Col* col = new Col(*srcRow.cols[u]);
-      row->cols[u] = col;
-    }
-
-    m_rows[v] = row;
-  }
-}
-
 template<typename ImageTraits>
 inline bool shrink_row(const Image* image, const Image* image_diff, int& x1, int y, int& x2)
 {
@@ -84,9 +63,15 @@ Dirty::Dirty(Image* image, Image* image_diff, const gfx::Rect& bounds)
   : m_format(image->pixelFormat())
   , m_x1(bounds.x), m_y1(bounds.y)
   , m_x2(bounds.x2()-1), m_y2(bounds.y2()-1)
+  , m_dataSize(0)
 {
   int y, x1, x2;
 
+  if (m_y2 >= m_y1) {
+    m_rows.reserve(m_y2-m_y1+1);
+    m_cols.reserve(m_y2-m_y1+1);
+  }
+
   for (y=m_y1; y<=m_y2; y++) {
     x1 = m_x1;
     x2 = m_x2;
@@ -112,84 +97,63 @@ Dirty::Dirty(Image* image, Image* image_diff, const gfx::Rect& bounds)
     if (!res)
       continue;
 
-    Col* col = new Col(x1, x2-x1+1);
-    col->data.resize(getLineSize(col->w));
-
-    Row* row = new Row(y);
-    row->cols.push_back(col);
-
-    m_rows.push_back(row);
+    addRow(y);
+    addCol(x1, x2-x1+1);
   }
-}
-
-Dirty::~Dirty()
-{
-  RowsList::iterator row_it = m_rows.begin();
-  RowsList::iterator row_end = m_rows.end();
 
-  for (; row_it != row_end; ++row_it) {
-    ColsList::iterator col_it = (*row_it)->cols.begin();
-    ColsList::iterator col_end = (*row_it)->cols.end();
-
-    for (; col_it != col_end; ++col_it)
-      delete *col_it;
-
-    delete *row_it;
-  }
+  allocateData();
 }
 
 int Dirty::getMemSize() const
 {
   int size = 4+1+2*4+2;         // DWORD+BYTE+WORD[4]+WORD
+  size += 4*m_rows.size();      // y, cols (WORD[2])
+  size += 4*m_cols.size();      // x, w (WORD[2])
+  size += m_dataSize;
+  return size;
+}
 
-  RowsList::const_iterator row_it = m_rows.begin();
-  RowsList::const_iterator row_end = m_rows.end();
-  for (; row_it != row_end; ++row_it) {
-    size += 4;                  // y, cols (WORD[2])
+void Dirty::addRow(int y)
+{
+  m_rows.push_back(Row(y, m_cols.size()));
+}
 
-    ColsList::const_iterator col_it = (*row_it)->cols.begin();
-    ColsList::const_iterator col_end = (*row_it)->cols.end();
-    for (; col_it != col_end; ++col_it) {
-      size += 4;                // x, w (WORD[2])
-      size += getLineSize((*col_it)->w);
-    }
-  }
+void Dirty::addCol(int x, int w)
+{
+  ASSERT(!m_rows.empty());
 
-  return size;
+  m_cols.push_back(Col(x, w, m_dataSize));
+  m_rows.back().colsCount++;
+  m_dataSize += getLineSize(w);
+}
+
+void Dirty::allocateData()
+{
+  m_data.resize(m_dataSize);
 }
 
 void Dirty::saveImagePixels(Image* image)
 {
-  RowsList::iterator row_it = m_rows.begin();
-  RowsList::iterator row_end = m_rows.end();
-  for (; row_it != row_end; ++row_it) {
-    Row* row = *row_it;
-
-    ColsList::iterator col_it = (*row_it)->cols.begin();
-    ColsList::iterator col_end = (*row_it)->cols.end();
-    for (; col_it != col_end; ++col_it) {
-      Col* col = *col_it;
-
-      uint8_t* address = (uint8_t*)image->getPixelAddress(col->x, row->y);
-      std::copy(address, address+getLineSize(col->w), col->data.begin());
+  ASSERT(m_data.size() == m_dataSize);
+
+  for (RowsList::const_iterator row=m_rows.begin(), end=m_rows.end(); row!=end; ++row) {
+    for (int u=0; u<row->colsCount; ++u) {
+      const Col& col = m_cols[row->firstCol+u];
+      const uint8_t* address = (const uint8_t*)image->getPixelAddress(col.x, row->y);
+      std::copy(address, address+getLineSize(col.w), &m_data[col.offset]);
     }
   }
 }
 
 void Dirty::swapImagePixels(Image* image)
 {
-  RowsList::iterator row_it = m_rows.begin();
-  RowsList::iterator row_end = m_rows.end();
-  for (; row_it != row_end; ++row_it) {
-    Row* row = *row_it;
-
-    ColsList::iterator col_it = (*row_it)->cols.begin();
-    ColsList::iterator col_end = (*row_it)->cols.end();
-    for (; col_it != col_end; ++col_it) {
-      Col* col = *col_it;
-
-      uint8_t* address = (uint8_t*)image->getPixelAddress(col->x, row->y);
-      std::swap_ranges(address, address+getLineSize(col->w), col->data.begin());
+  ASSERT(m_data.size() == m_dataSize);
+
+  for (RowsList::const_iterator row=m_rows.begin(), end=m_rows.end(); row!=end; ++row) {
+    for (int u=0; u<row->colsCount; ++u) {
+      const Col& col = m_cols[row->firstCol+u];
+      uint8_t* address = (uint8_t*)image->getPixelAddress(col.x, row->y);
+      std::swap_ranges(address, address+getLineSize(col.w), &m_data[col.offset]);
     }
   }
 }
@@ -33,33 +33,32 @@ namespace raster {
   class Image;
   class Mask;
 
+  // Differences between two images. The rows and columns are stored
+  // in two contiguous arrays of descriptors, and the pixels of all
+  // columns in one buffer (each column references its pixels with an
+  // offset), so a Dirty is created with only a few allocations.
   class Dirty {
   public:
-    struct Col;
-    struct Row;
-
-    typedef std::vector<Col*> ColsList;
-    typedef std::vector<Row*> RowsList;
-
     struct Col {
       int x, w;
-      std::vector<uint8_t> data;
+      size_t offset;            // Offset of the pixels in data()
 
-      Col(int x, int w) : x(x), w(w) { }
+      Col(int x, int w, size_t offset) : x(x), w(w), offset(offset) { }
     };
 
     struct Row {
       int y;
-      ColsList cols;
+      int firstCol;             // Index of the first column in getCol()
+      int colsCount;
 
-      Row(int y) : y(y) { }
+      Row(int y, int firstCol) : y(y), firstCol(firstCol), colsCount(0) { }
     };
 
-public:
+    typedef std::vector<Col> ColsList;
+    typedef std::vector<Row> RowsList;
+
     Dirty(PixelFormat format, int x1, int y1, int x2, int y2);
-    Dirty(const Dirty& src);
     Dirty(Image* image1, Image* image2, const gfx::Rect& bounds);
-    ~Dirty();
 
     int getMemSize() const;
 
@@ -70,12 +69,26 @@ public:
     int y2() const { return m_y2; }
 
     int getRowsCount() const { return m_rows.size(); }
-    const Row& getRow(int i) const { return *m_rows[i]; }
+    const Row& getRow(int i) const { return m_rows[i]; }
+
+    int getColsCount() const { return m_cols.size(); }
+    const Col& getCol(int i) const { return m_cols[i]; }
 
     inline int getLineSize(int width) const {
       return calculate_rowstride_bytes(m_format, width);
     }
 
+    // Adds a new row, and a new column to the last added row. The
+    // pixels of the new columns are available after allocateData().
+    void addRow(int y);
+    void addCol(int x, int w);
+    void allocateData();
+
+    // Pixels of all columns.
+    uint8_t* data() { return m_data.empty() ? NULL: &m_data[0]; }
+    const uint8_t* data() const { return m_data.empty() ? NULL: &m_data[0]; }
+    size_t dataSize() const { return m_dataSize; }
+
     void saveImagePixels(Image* image);
     void swapImagePixels(Image* image);
 
@@ -85,16 +98,13 @@ public:
     // Disable copying through operator=
     Dirty& operator=(const Dirty&);
 
-    //private: // TODO these fields are public because Undo creates
-  public:    // a Dirty instance from a deserialization process,
-    // remember to "privatize" these members when the
-    // new Undo implementation is finished.
-
     PixelFormat m_format;
     int m_x1, m_y1;
     int m_x2, m_y2;
     RowsList m_rows;
-
+    ColsList m_cols;
+    std::vector<uint8_t> m_data;
+    size_t m_dataSize;
   };
 
 } // namespace raster
@@ -42,12 +42,33 @@ using namespace base::serialization::little_endian;
 //      WORD[2]         y, columns
 //      for each column
 //       WORD[2]        x, w
-//       for each pixel ("w" times)
-//         BYTE[4]      for RGB images, or
-//         BYTE[2]      for Grayscale images, or
-//         BYTE         for Indexed images
+//    for each column of each row
+//      for each pixel ("w" times)
+//        BYTE[4]       for RGB images, or
+//        BYTE[2]       for Grayscale images, or
+//        BYTE          for Indexed images
+//
+// The layout (without the pixels) is saved by write_dirty_layout().
 
 void write_dirty(std::ostream& os, Dirty* dirty)
+{
+  write_dirty_layout(os, dirty);
+
+  if (dirty->dataSize() > 0)
+    os.write((const char*)dirty->data(), dirty->dataSize());
+}
+
+Dirty* read_dirty(std::istream& is)
+{
+  base::UniquePtr<Dirty> dirty(read_dirty_layout(is));
+
+  if (dirty->dataSize() > 0)
+    is.read((char*)dirty->data(), dirty->dataSize());
+
+  return dirty.release();
+}
+
+void write_dirty_layout(std::ostream& os, const Dirty* dirty)
 {
   write8(os, dirty->pixelFormat());
   write16(os, dirty->x1());
@@ -60,19 +81,18 @@ void write_dirty(std::ostream& os, Dirty* dirty)
     const Dirty::Row& row = dirty->getRow(v);
 
     write16(os, row.y);
-    write16(os, row.cols.size());
+    write16(os, row.colsCount);
 
-    for (size_t u=0; u<row.cols.size(); u++) {
-      write16(os, row.cols[u]->x);
-      write16(os, row.cols[u]->w);
+    for (int u=0; u<row.colsCount; u++) {
+      const Dirty::Col& col = dirty->getCol(row.firstCol+u);
 
-      size_t size = dirty->getLineSize(row.cols[u]->w);
-      os.write((char*)&row.cols[u]->data[0], size);
+      write16(os, col.x);
+      write16(os, col.w);
     }
   }
 }
 
-Dirty* read_dirty(std::istream& is)
+Dirty* read_dirty_layout(std::istream& is)
 {
   int u, v, x, y, w;
   int pixelFormat = read8(is);
@@ -83,36 +103,21 @@ Dirty* read_dirty(std::istream& is)
   base::UniquePtr<Dirty> dirty(new Dirty(static_cast<PixelFormat>(pixelFormat), x1, y1, x2, y2));
 
   int noRows = read16(is);
-  if (noRows > 0) {
-    dirty->m_rows.resize(noRows);
-
-    for (v=0; v<dirty->getRowsCount(); v++) {
-      y = read16(is);
-
-      base::UniquePtr<Dirty::Row> row(new Dirty::Row(y));
-
-      int noCols = read16(is);
-      row->cols.resize(noCols);
-
-      for (u=0; u<noCols; u++) {
-        x = read16(is);
-        w = read16(is);
-
-        base::UniquePtr<Dirty::Col> col(new Dirty::Col(x, w));
-
-        int size = dirty->getLineSize(col->w);
-        ASSERT(size > 0);
-
-        col->data.resize(size);
-        is.read((char*)&col->data[0], size);
+  for (v=0; v<noRows; v++) {
+    y = read16(is);
+    dirty->addRow(y);
 
-        row->cols[u] = col.release();
-      }
+    int noCols = read16(is);
+    for (u=0; u<noCols; u++) {
+      x = read16(is);
+      w = read16(is);
+      ASSERT(dirty->getLineSize(w) > 0);
 
-      dirty->m_rows[v] = row.release();
+      dirty->addCol(x, w);
     }
   }
 
+  dirty->allocateData();
   return dirty.release();
 }
 
@@ -29,6 +29,12 @@ namespace raster {
   void write_dirty(std::ostream& os, Dirty* dirty);
   Dirty* read_dirty(std::istream& is);
 
+  // Only the rows and columns of the Dirty, without its pixels. The
+  // pixels can be stored separately from Dirty::data(), and restored
+  // in the Dirty::data() of the one returned by read_dirty_layout().
+  void write_dirty_layout(std::ostream& os, const Dirty* dirty);
+  Dirty* read_dirty_layout(std::istream& is);
+
 } // namespace raster
 
 #endif
@@ -0,0 +1,137 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/unique_ptr.h"
+#include "gfx/rect.h"
+#include "raster/dirty.h"
+#include "raster/dirty_io.h"
+#include "raster/image.h"
+#include "raster/primitives.h"
+
+#include <sstream>
+
+using namespace raster;
+
+static void expect_equal_images(const Image* a, const Image* b)
+{
+  ASSERT_EQ(a->width(), b->width());
+  ASSERT_EQ(a->height(), b->height());
+  for (int y=0; y<a->height(); ++y)
+    for (int x=0; x<a->width(); ++x)
+      ASSERT_EQ(get_pixel(a, x, y), get_pixel(b, x, y)) << x << "," << y;
+}
+
+TEST(Dirty, Layout)
+{
+  base::UniquePtr<Image> a(Image::create(IMAGE_INDEXED, 8, 4));
+  base::UniquePtr<Image> b(Image::create(IMAGE_INDEXED, 8, 4));
+  clear_image(a, 0);
+  clear_image(b, 0);
+  put_pixel(b, 2, 0, 1);
+  put_pixel(b, 5, 0, 1);
+  put_pixel(b, 7, 3, 1);
+
+  Dirty dirty(a, b, a->bounds());
+  ASSERT_EQ(2, dirty.getRowsCount());
+  ASSERT_EQ(2, dirty.getColsCount());
+
+  EXPECT_EQ(0, dirty.getRow(0).y);
+  EXPECT_EQ(0, dirty.getRow(0).firstCol);
+  EXPECT_EQ(1, dirty.getRow(0).colsCount);
+  EXPECT_EQ(2, dirty.getCol(0).x);
+  EXPECT_EQ(4, dirty.getCol(0).w);
+  EXPECT_EQ(0u, dirty.getCol(0).offset);
+
+  EXPECT_EQ(3, dirty.getRow(1).y);
+  EXPECT_EQ(1, dirty.getRow(1).firstCol);
+  EXPECT_EQ(7, dirty.getCol(1).x);
+  EXPECT_EQ(1, dirty.getCol(1).w);
+  EXPECT_EQ(4u, dirty.getCol(1).offset);
+
+  EXPECT_EQ(5u, dirty.dataSize());
+}
+
+TEST(Dirty, SwapPixels)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED };
+
+  for (int i=0; i<3; ++i) {
+    PixelFormat format = formats[i];
+    base::UniquePtr<Image> a(Image::create(format, 32, 32));
+    base::UniquePtr<Image> b(Image::create(format, 32, 32));
+    clear_image(a, 0);
+    clear_image(b, 0);
+    for (int y=4; y<20; y+=2)
+      for (int x=y; x<y+5; ++x)
+        put_pixel(b, x, y, 1 + ((x+y) & 0x7f));
+
+    base::UniquePtr<Image> original(Image::createCopy(a));
+
+    // Save the pixels of "a" and put the pixels of "b" in "a"
+    Dirty dirty(a, b, gfx::Rect(2, 2, 28, 28));
+    dirty.saveImagePixels(a);
+    copy_image(a, b, 0, 0);
+
+    // Serialize and swap the saved pixels (undo)
+    std::stringstream stream;
+    write_dirty(stream, &dirty);
+    base::UniquePtr<Dirty> dirty2(read_dirty(stream));
+    ASSERT_EQ(dirty.dataSize(), dirty2->dataSize());
+
+    dirty2->swapImagePixels(a);
+    expect_equal_images(original, a);
+
+    // Swap them again (redo)
+    dirty2->swapImagePixels(a);
+    expect_equal_images(b, a);
+  }
+}
+
+TEST(Dirty, LayoutWithoutPixels)
+{
+  base::UniquePtr<Image> a(Image::create(IMAGE_RGB, 16, 16));
+  base::UniquePtr<Image> b(Image::create(IMAGE_RGB, 16, 16));
+  clear_image(a, rgba(0, 0, 0, 255));
+  clear_image(b, rgba(0, 0, 0, 255));
+  fill_rect(b, 3, 3, 9, 12, rgba(255, 0, 0, 255));
+
+  Dirty dirty(a, b, a->bounds());
+  dirty.saveImagePixels(b);
+
+  std::stringstream stream;
+  write_dirty_layout(stream, &dirty);
+  base::UniquePtr<Dirty> dirty2(read_dirty_layout(stream));
+  ASSERT_EQ(dirty.getRowsCount(), dirty2->getRowsCount());
+  ASSERT_EQ(dirty.dataSize(), dirty2->dataSize());
+
+  std::copy(dirty.data(), dirty.data()+dirty.dataSize(), dirty2->data());
+  dirty2->swapImagePixels(a);
+  expect_equal_images(b, a);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -29,12 +29,18 @@
 #include "raster/palette.h"
 #include "raster/primitives.h"
 #include "raster/rgbmap.h"
+#include "raster/sparse_image_impl.h"
 
 namespace raster {
 
+// Images can be created from several threads.
+static std::atomic<uint32_t> image_serial(0);
+
 Image::Image(PixelFormat format, int width, int height)
   : Object(OBJECT_IMAGE)
   , m_format(format)
+  , m_serial(++image_serial)
+  , m_version(0)
 {
   m_width = width;
   m_height = height;
@@ -60,10 +66,23 @@ int Image::getRowStrideSize(int pixels_per_row) const
   return calculate_rowstride_bytes(pixelFormat(), pixels_per_row);
 }
 
+// Images with more pixels than this are stored in a SparseImageImpl
+// (unless an external buffer is specified).
+static const int sparse_image_min_pixels = 2048*2048;
+
 // static
 Image* Image::create(PixelFormat format, int width, int height,
                      const ImageBufferPtr& buffer)
 {
+  if (!buffer && width*height > sparse_image_min_pixels) {
+    switch (format) {
+      case IMAGE_RGB:       return new SparseImageImpl<RgbTraits>(width, height);
+      case IMAGE_GRAYSCALE: return new SparseImageImpl<GrayscaleTraits>(width, height);
+      case IMAGE_INDEXED:   return new SparseImageImpl<IndexedTraits>(width, height);
+      case IMAGE_BITMAP:    return new SparseImageImpl<BitmapTraits>(width, height);
+    }
+  }
+
   switch (format) {
     case IMAGE_RGB:       return new ImageImpl<RgbTraits>(width, height, buffer);
     case IMAGE_GRAYSCALE: return new ImageImpl<GrayscaleTraits>(width, height, buffer);
@@ -77,6 +96,10 @@ Image* Image::create(PixelFormat format, int width, int height,
 Image* Image::createCopy(const Image* image, const ImageBufferPtr& buffer)
 {
   ASSERT(image);
+
+  if (!buffer)
+    return image->createSharedCopy();
+
   return crop_image(image, 0, 0, image->width(), image->height(),
     image->maskColor(), buffer);
 }
@@ -28,6 +28,8 @@
 #include "raster/object.h"
 #include "raster/pixel_format.h"
 
+#include <atomic>
+
 namespace raster {
 
   template<typename ImageTraits> class ImageBits;
@@ -45,6 +47,9 @@ namespace raster {
 
     static Image* create(PixelFormat format, int width, int height,
                          const ImageBufferPtr& buffer = ImageBufferPtr());
+    // Creates a copy of the given image. If no buffer is specified,
+    // the copy shares the pixels with the original image until one
+    // of them is modified (copy-on-write).
     static Image* createCopy(const Image* image,
                              const ImageBufferPtr& buffer = ImageBufferPtr());
 
@@ -58,12 +63,22 @@ namespace raster {
     color_t maskColor() const { return m_maskColor; }
     void setMaskColor(color_t c) { m_maskColor = c; }
 
+    // Unique number of this image instance (it isn't copied by
+    // createCopy()), and a counter incremented each time the image
+    // is prepared to be modified (see unshare()). Both together
+    // identify the pixels of the image, so they can be used to know if
+    // the image was modified.
+    uint32_t serial() const { return m_serial; }
+    uint32_t version() const { return m_version; }
+
     int getMemSize() const override;
     int getRowStrideSize() const;
     int getRowStrideSize(int pixels_per_row) const;
 
     template<typename ImageTraits>
     ImageBits<ImageTraits> lockBits(LockType lockType, const gfx::Rect& bounds) {
+      if (lockType != ReadLock)
+        unshare(bounds);
       return ImageBits<ImageTraits>(this, bounds);
     }
 
@@ -77,10 +92,28 @@ namespace raster {
       // Do nothing
     }
 
+    // Prepares the given area to be modified: makes a private copy of
+    // the pixels if they are shared with other images (see
+    // createCopy()), and allocates the rows of sparse images. It's
+    // called automatically by all functions that can modify the
+    // image (non-const getPixelAddress(), lockBits() to write,
+    // putPixel(), etc.).
+    void unshare(const gfx::Rect& bounds) {
+      ++m_version;
+      onUnshare(bounds);
+    }
+
     // Warning: These functions doesn't have (and shouldn't have)
     // bounds checks. Use the primitives defined in raster/primitives.h
     // in case that you need bounds check.
+    //
+    // The returned address is valid for the whole row "y" (rows are
+    // always contiguous in memory, but two rows aren't).
     virtual uint8_t* getPixelAddress(int x, int y) const = 0;
+    uint8_t* getPixelAddress(int x, int y) {
+      unshare(gfx::Rect(x, y, 1, 1));
+      return static_cast<const Image*>(this)->getPixelAddress(x, y);
+    }
     virtual color_t getPixel(int x, int y) const = 0;
     virtual void putPixel(int x, int y, color_t color) = 0;
     virtual void clear(color_t color) = 0;
@@ -93,11 +126,21 @@ namespace raster {
   protected:
     Image(PixelFormat format, int width, int height);
 
+    virtual void onUnshare(const gfx::Rect& bounds) = 0;
+
+    // For modifications that don't call unshare().
+    void incrementVersion() { ++m_version; }
+
+    // Creates a copy of this image that shares its pixels.
+    virtual Image* createSharedCopy() const = 0;
+
   private:
     PixelFormat m_format;
     int m_width;
     int m_height;
     color_t m_maskColor;  // Skipped color in merge process.
+    uint32_t m_serial;
+    std::atomic<uint32_t> m_version;
   };
 
 } // namespace raster
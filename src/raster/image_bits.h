@@ -129,6 +129,15 @@ namespace raster {
       : m_bits(image->lockBits<ImageTraits>(Image::ReadLock, bounds)) {
     }
 
+    // Locks a non-const image to modify it.
+    explicit LockImageBits(Image* image)
+      : m_bits(image->lockBits<ImageTraits>(Image::ReadWriteLock, image->bounds())) {
+    }
+
+    LockImageBits(Image* image, const gfx::Rect& bounds)
+      : m_bits(image->lockBits<ImageTraits>(Image::ReadWriteLock, bounds)) {
+    }
+
     LockImageBits(Image* image, Image::LockType lockType)
       : m_bits(image->lockBits<ImageTraits>(lockType, image->bounds())) {
     }
@@ -30,7 +30,7 @@ namespace raster {
 
   template<class Traits>
   class ImageImpl : public Image {
-  private:
+  protected:
     typedef typename Traits::address_t address_t;
     typedef typename Traits::const_address_t const_address_t;
 
@@ -38,6 +38,22 @@ namespace raster {
     address_t m_bits;
     address_t* m_rows;
 
+    // True if m_buffer was allocated by this image (or other
+    // ImageImpl that shares it with us), false if it's an external
+    // buffer given in the constructor (which is never shared).
+    bool m_ownBuffer;
+
+    // Constructor for derived classes with their own storage, they
+    // must fill the given table of rows.
+    ImageImpl(int width, int height, address_t* rows)
+      : Image(static_cast<PixelFormat>(Traits::pixel_format), width, height)
+      , m_bits(NULL)
+      , m_rows(rows)
+      , m_ownBuffer(false)
+    {
+    }
+
+  private:
     inline address_t getBitsAddress() {
       return m_bits;
     }
@@ -56,6 +72,27 @@ namespace raster {
       return m_rows[y];
     }
 
+    size_t getRequiredSize() const {
+      return sizeof(address_t) * height()
+        + Traits::getRowStrideBytes(width()) * height();
+    }
+
+    // Points m_rows/m_bits to the current m_buffer.
+    void setupRows() {
+      size_t for_rows = sizeof(address_t) * height();
+      size_t rowstride_bytes = Traits::getRowStrideBytes(width());
+
+      m_rows = (address_t*)m_buffer->buffer();
+      m_bits = (address_t)(m_buffer->buffer() + for_rows);
+
+      address_t addr = m_bits;
+      for (int y=0; y<height(); ++y) {
+        m_rows[y] = addr;
+        addr = (address_t)(((uint8_t*)addr) + rowstride_bytes);
+      }
+    }
+
+
   public:
     inline address_t address(int x, int y) const {
       return (address_t)(m_rows[y] + x / (Traits::pixels_per_byte == 0 ? 1 : Traits::pixels_per_byte));
@@ -65,26 +102,62 @@ namespace raster {
               const ImageBufferPtr& buffer)
       : Image(static_cast<PixelFormat>(Traits::pixel_format), width, height)
       , m_buffer(buffer)
+      , m_ownBuffer(!buffer)
     {
-      size_t for_rows = sizeof(address_t) * height;
-      size_t rowstride_bytes = Traits::getRowStrideBytes(width);
-      size_t required_size = for_rows + rowstride_bytes*height;
+      size_t required_size = getRequiredSize();
 
       if (!m_buffer)
         m_buffer.reset(new ImageBuffer(required_size));
       else
         m_buffer->resizeIfNecessary(required_size);
 
-      m_rows = (address_t*)m_buffer->buffer();
-      m_bits = (address_t)(m_buffer->buffer() + for_rows);
+      setupRows();
+    }
 
-      address_t addr = m_bits;
-      for (int y=0; y<height; ++y) {
-        m_rows[y] = addr;
-        addr = (address_t)(((uint8_t*)addr) + rowstride_bytes);
+    // Creates a copy of "src" sharing its pixels (only when they are
+    // in a buffer owned by "src").
+    explicit ImageImpl(const ImageImpl& src)
+      : Image(static_cast<PixelFormat>(Traits::pixel_format), src.width(), src.height())
+      , m_ownBuffer(true)
+    {
+      setMaskColor(src.maskColor());
+
+      if (src.m_ownBuffer) {
+        m_buffer = src.m_buffer;
+        m_bits = src.m_bits;
+        m_rows = src.m_rows;
+      }
+      else {
+        m_buffer.reset(new ImageBuffer(getRequiredSize()));
+        setupRows();
+
+        for (int y=0; y<height(); ++y)
+          memcpy(m_rows[y], src.m_rows[y], Traits::getRowStrideBytes(width()));
       }
     }
 
+    void onUnshare(const gfx::Rect& bounds) override {
+      if (!m_ownBuffer || m_buffer.unique())
+        return;
+
+      // Keep a reference to the old buffer until its pixels are
+      // copied, other images could release it in the meantime.
+      ImageBufferPtr old_buffer = m_buffer;
+      address_t* old_rows = m_rows;
+
+      m_buffer.reset(new ImageBuffer(getRequiredSize()));
+      setupRows();
+
+      for (int y=0; y<height(); ++y)
+        memcpy(m_rows[y], old_rows[y], Traits::getRowStrideBytes(width()));
+    }
+
+    using Image::getPixelAddress;
+
+    Image* createSharedCopy() const override {
+      return new ImageImpl(*this);
+    }
+
     uint8_t* getPixelAddress(int x, int y) const override {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
@@ -103,6 +176,7 @@ namespace raster {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
 
+      unshare(gfx::Rect(x, y, 1, 1));
       *address(x, y) = color;
     }
 
@@ -154,6 +228,8 @@ namespace raster {
       if (yend >= dst->height())
         yend = dst->height()-1;
 
+      dst->unshare(gfx::Rect(xbeg, ybeg, xend-xbeg+1, yend-ybeg+1));
+
       // Copy process
 
       bytes = Traits::getRowStrideBytes(xend - xbeg + 1);
@@ -210,6 +286,8 @@ namespace raster {
       if (yend >= dst->height())
         yend = dst->height()-1;
 
+      dst->unshare(gfx::Rect(xbeg, ybeg, xend-xbeg+1, yend-ybeg+1));
+
       // Merge process
 
       for (ydst=ybeg; ydst<=yend; ++ydst, ++ysrc) {
@@ -250,11 +328,13 @@ namespace raster {
 
   template<>
   inline void ImageImpl<IndexedTraits>::clear(color_t color) {
+    unshare(bounds());
     memset(m_bits, color, width()*height());
   }
 
   template<>
   inline void ImageImpl<BitmapTraits>::clear(color_t color) {
+    unshare(bounds());
     memset(m_bits, (color ? 0xff: 0x00),
            BitmapTraits::getRowStrideBytes(width()) * height());
   }
@@ -273,6 +353,8 @@ namespace raster {
     ASSERT(x >= 0 && x < width());
     ASSERT(y >= 0 && y < height());
 
+    unshare(gfx::Rect(x, y, 1, 1));
+
     div_t d = div(x, 8);
     if (color)
       (*(m_rows[y] + d.quot)) |= (1 << d.rem);
@@ -285,8 +367,10 @@ namespace raster {
     address_t addr;
     int x, y;
 
+    unshare(gfx::Rect(x1, y1, x2-x1+1, y2-y1+1));
+
     for (y=y1; y<=y2; ++y) {
-      addr = (address_t)getPixelAddress(x1, y);
+      addr = address(x1, y);
       for (x=x1; x<=x2; ++x) {
         *addr = rgba_blend_normal(*addr, color, opacity);
         ++addr;
@@ -332,6 +416,8 @@ namespace raster {
     if (yend >= dst->height())
       yend = dst->height()-1;
 
+    dst->unshare(gfx::Rect(xbeg, ybeg, xend-xbeg+1, yend-ybeg+1));
+
     // merge process
 
     // direct copy
@@ -403,6 +489,8 @@ namespace raster {
     if (yend >= dst->height())
       yend = dst->height()-1;
 
+    dst->unshare(gfx::Rect(xbeg, ybeg, xend-xbeg+1, yend-ybeg+1));
+
     // copy process
 
     int w = xend - xbeg + 1;
@@ -455,6 +543,8 @@ namespace raster {
     if (yend >= dst->height())
       yend = dst->height()-1;
 
+    dst->unshare(gfx::Rect(xbeg, ybeg, xend-xbeg+1, yend-ybeg+1));
+
     // merge process
 
     int w = xend - xbeg + 1;
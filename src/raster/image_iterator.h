@@ -116,7 +116,7 @@ namespace raster {
         ++m_y;
 
         if (m_y < m_image->height())
-          m_ptr = (pointer)m_image->getPixelAddress(m_x, m_y);
+          m_ptr = (pointer)static_cast<const Image*>(m_image)->getPixelAddress(m_x, m_y);
       }
 
       return *this;
@@ -353,7 +353,7 @@ namespace raster {
         ++m_y;
 
         if (m_y < m_image->height())
-          m_ptr = (pointer)m_image->getPixelAddress(m_x, m_y);
+          m_ptr = (pointer)static_cast<const Image*>(m_image)->getPixelAddress(m_x, m_y);
         else
           ++m_ptr;
       }
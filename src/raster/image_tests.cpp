@@ -23,9 +23,11 @@
 #include <gtest/gtest.h>
 
 #include "base/unique_ptr.h"
+#include "gfx/region.h"
 #include "raster/image.h"
 #include "raster/image_bits.h"
 #include "raster/primitives.h"
+#include "raster/primitives_fast.h"
 
 using namespace base;
 using namespace raster;
@@ -191,6 +193,96 @@ TYPED_TEST(ImageAllTypes, DrawHLine)
   }
 }
 
+TYPED_TEST(ImageAllTypes, CopyOnWrite)
+{
+  typedef TypeParam ImageTraits;
+
+  UniquePtr<Image> a(Image::create(ImageTraits::pixel_format, 9, 5));
+  clear_image(a, 0);
+  put_pixel(a, 1, 1, 1);
+
+  UniquePtr<Image> b(Image::createCopy(a));
+  UniquePtr<Image> c(Image::createCopy(b));
+
+  // Pixels are shared until one image is modified
+  EXPECT_EQ(((const Image*)a.get())->getPixelAddress(0, 0),
+            ((const Image*)b.get())->getPixelAddress(0, 0));
+  EXPECT_EQ(((const Image*)a.get())->getPixelAddress(0, 0),
+            ((const Image*)c.get())->getPixelAddress(0, 0));
+  EXPECT_EQ(0, count_diff_between_images(a, c));
+
+  put_pixel(b, 2, 2, 1);
+  EXPECT_EQ(1, get_pixel(b, 2, 2));
+  EXPECT_EQ(1, get_pixel(b, 1, 1));
+  EXPECT_EQ(0, get_pixel(a, 2, 2));
+  EXPECT_EQ(0, get_pixel(c, 2, 2));
+
+  {
+    LockImageBits<ImageTraits> bits(c.get(), Image::WriteLock);
+    typename LockImageBits<ImageTraits>::iterator it = bits.begin(), end = bits.end();
+    for (; it != end; ++it)
+      *it = 1;
+  }
+  EXPECT_EQ(1, get_pixel(c, 0, 0));
+  EXPECT_EQ(0, get_pixel(a, 0, 0));
+  EXPECT_EQ(0, get_pixel(b, 0, 0));
+
+  // "a" isn't shared anymore
+  a->clear(1);
+  EXPECT_EQ(0, count_diff_between_images(a, c));
+  EXPECT_EQ(0, get_pixel(b, 0, 0));
+}
+
+TYPED_TEST(ImageAllTypes, CopyOnWriteWithPutPixelFast)
+{
+  typedef TypeParam ImageTraits;
+
+  UniquePtr<Image> a(Image::create(ImageTraits::pixel_format, 9, 5));
+  clear_image(a, 0);
+
+  UniquePtr<Image> b(Image::createCopy(a));
+  put_pixel_fast<ImageTraits>(b, 1, 1, 1);
+
+  EXPECT_EQ(1, get_pixel_fast<ImageTraits>(b, 1, 1));
+  EXPECT_EQ(0, get_pixel_fast<ImageTraits>(a, 1, 1));
+}
+
+TYPED_TEST(ImageAllTypes, CopyRegion)
+{
+  typedef TypeParam ImageTraits;
+
+  UniquePtr<Image> a(Image::create(ImageTraits::pixel_format, 12, 8));
+  UniquePtr<Image> b(Image::create(ImageTraits::pixel_format, 12, 8));
+  clear_image(a, 0);
+  clear_image(b, 1);
+
+  gfx::Region rgn(gfx::Rect(1, 1, 3, 2));
+  rgn.createUnion(rgn, gfx::Region(gfx::Rect(9, 5, 10, 10))); // Clipped
+  copy_image(a, b, rgn);
+
+  for (int y=0; y<a->height(); ++y)
+    for (int x=0; x<a->width(); ++x)
+      EXPECT_EQ(rgn.contains(gfx::Point(x, y)) ? 1: 0, get_pixel(a, x, y));
+
+  // Copying shared pixels doesn't unshare the image
+  UniquePtr<Image> c(Image::createCopy(b));
+  copy_image(c, b, gfx::Region(c->bounds()));
+  EXPECT_EQ(((const Image*)b.get())->getPixelAddress(0, 0),
+            ((const Image*)c.get())->getPixelAddress(0, 0));
+}
+
+TEST(Image, CopyOfExternalBufferIsNotShared)
+{
+  ImageBufferPtr buffer(new ImageBuffer(1));
+  UniquePtr<Image> a(Image::create(IMAGE_RGB, 4, 4, buffer));
+  clear_image(a, rgba(0, 0, 0, 255));
+
+  UniquePtr<Image> b(Image::createCopy(a));
+  EXPECT_NE(((const Image*)a.get())->getPixelAddress(0, 0),
+            ((const Image*)b.get())->getPixelAddress(0, 0));
+  EXPECT_EQ(0, count_diff_between_images(a, b));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,181 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "raster/palette_index.h"
+
+#include "raster/palette.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace raster {
+
+// Weight of each component (green, red, blue) in the color distance,
+// the same ones used by Palette::findBestfit().
+static const int component_weight[3] = { 59*59, 30*30, 11*11 };
+
+namespace {
+
+  class NodeAxisPredicate {
+  public:
+    NodeAxisPredicate(int axis) : m_axis(axis) { }
+
+    template<typename Node>
+    bool operator()(const Node& a, const Node& b) const {
+      if (a.c[m_axis] != b.c[m_axis])
+        return a.c[m_axis] < b.c[m_axis];
+      else
+        return a.index < b.index;
+    }
+
+  private:
+    int m_axis;
+  };
+
+} // anonymous namespace
+
+PaletteIndex::PaletteIndex()
+{
+}
+
+void PaletteIndex::build(const Palette* palette, int mask_index)
+{
+  m_nodes.clear();
+  m_nodes.reserve(palette->size());
+
+  for (int i=0; i<palette->size(); ++i) {
+    if (i == mask_index)
+      continue;
+
+    color_t color = palette->getEntry(i);
+    Node node;
+    node.c[0] = rgba_getg(color);
+    node.c[1] = rgba_getr(color);
+    node.c[2] = rgba_getb(color);
+    node.index = i;
+    node.axis = 0;
+    m_nodes.push_back(node);
+  }
+
+  buildTree(0, (int)m_nodes.size());
+}
+
+void PaletteIndex::buildTree(int begin, int end)
+{
+  if (end - begin <= 1)
+    return;
+
+  // Split by the component with the widest (weighted) range.
+  int axis = 0;
+  int widest = -1;
+  for (int k=0; k<3; ++k) {
+    int lo = INT_MAX, hi = INT_MIN;
+    for (int i=begin; i<end; ++i) {
+      lo = MIN(lo, m_nodes[i].c[k]);
+      hi = MAX(hi, m_nodes[i].c[k]);
+    }
+    int range = component_weight[k] * (hi - lo) * (hi - lo);
+    if (range > widest) {
+      widest = range;
+      axis = k;
+    }
+  }
+
+  int mid = (begin + end) / 2;
+  std::nth_element(m_nodes.begin()+begin,
+                   m_nodes.begin()+mid,
+                   m_nodes.begin()+end, NodeAxisPredicate(axis));
+  m_nodes[mid].axis = axis;
+
+  buildTree(begin, mid);
+  buildTree(mid+1, end);
+}
+
+// static
+int PaletteIndex::bestfitDistance(int r, int g, int b, color_t entry)
+{
+  int dg = (g>>3) - (rgba_getg(entry)>>3);
+  int dr = (r>>3) - (rgba_getr(entry)>>3);
+  int db = (b>>3) - (rgba_getb(entry)>>3);
+  return (component_weight[0] * dg * dg +
+          component_weight[1] * dr * dr +
+          component_weight[2] * db * db);
+}
+
+int PaletteIndex::findNearest(int r, int g, int b, int shift) const
+{
+  ASSERT(r >= 0 && r <= 255);
+  ASSERT(g >= 0 && g <= 255);
+  ASSERT(b >= 0 && b <= 255);
+
+  Query q;
+  q.c[0] = g >> shift;
+  q.c[1] = r >> shift;
+  q.c[2] = b >> shift;
+  q.shift = shift;
+  q.best = 0;                   // Palette::findBestfit() returns 0 if there are no candidates
+  q.bestDist = INT_MAX;
+
+  searchTree(0, (int)m_nodes.size(), q);
+  return q.best;
+}
+
+void PaletteIndex::searchTree(int begin, int end, Query& q) const
+{
+  if (begin >= end)
+    return;
+
+  int mid = (begin + end) / 2;
+  const Node& node = m_nodes[mid];
+
+  int dist = 0;
+  for (int k=0; k<3; ++k) {
+    int d = q.c[k] - (node.c[k] >> q.shift);
+    dist += component_weight[k] * d * d;
+  }
+
+  // On ties the lowest index wins (as in the linear search).
+  if (dist < q.bestDist ||
+      (dist == q.bestDist && node.index < q.best)) {
+    q.best = node.index;
+    q.bestDist = dist;
+  }
+
+  // Left subtree has components <= node's one in the split axis,
+  // and right subtree >=, so the distance to the split plane is a
+  // lower bound for the whole far subtree.
+  int d = q.c[node.axis] - (node.c[node.axis] >> q.shift);
+  int planeDist = component_weight[node.axis] * d * d;
+
+  if (d < 0) {
+    searchTree(begin, mid, q);
+    if (planeDist <= q.bestDist)
+      searchTree(mid+1, end, q);
+  }
+  else {
+    searchTree(mid+1, end, q);
+    if (planeDist <= q.bestDist)
+      searchTree(begin, mid, q);
+  }
+}
+
+} // namespace raster
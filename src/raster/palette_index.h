@@ -0,0 +1,83 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef RASTER_PALETTE_INDEX_H_INCLUDED
+#define RASTER_PALETTE_INDEX_H_INCLUDED
+#pragma once
+
+#include "raster/color.h"
+
+#include <vector>
+
+namespace raster {
+
+  class Palette;
+
+  // Spatial index (a k-d tree) of the entries of a palette to find
+  // the nearest color without comparing all the entries. It uses the
+  // same color distance as Palette::findBestfit(). The index is a
+  // snapshot: it must be built again when the palette is modified.
+  // Once it's built, it can be queried from several threads.
+  class PaletteIndex {
+  public:
+    PaletteIndex();
+
+    void build(const Palette* palette, int mask_index);
+
+    // Returns the same entry as Palette::findBestfit() (channels are
+    // compared with 5 bits of precision).
+    int findBestfit(int r, int g, int b) const {
+      return findNearest(r, g, b, 3);
+    }
+
+    // Returns the nearest entry comparing all the 8 bits of each
+    // channel.
+    int findExactBestfit(int r, int g, int b) const {
+      return findNearest(r, g, b, 0);
+    }
+
+    // Distance between a color and a palette entry as it's compared
+    // by findBestfit().
+    static int bestfitDistance(int r, int g, int b, color_t entry);
+
+  private:
+    struct Node {
+      int c[3];                 // Components in distance order (g, r, b)
+      int index;                // Palette entry
+      int axis;                 // Component used to split the subtree
+    };
+
+    struct Query {
+      int c[3];                 // Components of the color to search
+      int shift;                // Bits to discard from each component
+      int best;                 // Best entry found
+      int bestDist;             // Distance to the best entry
+    };
+
+    int findNearest(int r, int g, int b, int shift) const;
+    void buildTree(int begin, int end);
+    void searchTree(int begin, int end, Query& q) const;
+
+    // Balanced tree stored in-place: the root of the subtree
+    // [begin,end) is the element at the middle.
+    std::vector<Node> m_nodes;
+  };
+
+} // namespace raster
+
+#endif
@@ -0,0 +1,126 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "raster/palette.h"
+#include "raster/palette_index.h"
+
+#include <climits>
+#include <cstdlib>
+
+using namespace raster;
+
+static void fill_random_palette(Palette& pal)
+{
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, rgba(std::rand() % 256, std::rand() % 256, std::rand() % 256, 255));
+}
+
+static int exact_bestfit(const Palette& pal, int r, int g, int b, int mask_index)
+{
+  int best = 0, lowest = INT_MAX;
+  for (int i=0; i<pal.size(); ++i) {
+    if (i == mask_index)
+      continue;
+    color_t c = pal.getEntry(i);
+    int dr = rgba_getr(c) - r;
+    int dg = rgba_getg(c) - g;
+    int db = rgba_getb(c) - b;
+    int d = dg*dg*59*59 + dr*dr*30*30 + db*db*11*11;
+    if (d < lowest) {
+      lowest = d;
+      best = i;
+    }
+  }
+  return best;
+}
+
+TEST(PaletteIndex, SameAsFindBestfit)
+{
+  std::srand(1);
+
+  int sizes[] = { 1, 2, 16, 255, 256 };
+  for (int s=0; s<int(sizeof(sizes)/sizeof(sizes[0])); ++s) {
+    Palette pal(FrameNumber(0), sizes[s]);
+    fill_random_palette(pal);
+
+    for (int mask=-1; mask<2; ++mask) {
+      PaletteIndex index;
+      index.build(&pal, mask);
+
+      for (int r=0; r<256; r+=5)
+        for (int g=0; g<256; g+=3)
+          for (int b=0; b<256; b+=7)
+            ASSERT_EQ(pal.findBestfit(r, g, b, mask),
+                      index.findBestfit(r, g, b));
+    }
+  }
+}
+
+TEST(PaletteIndex, RepeatedEntries)
+{
+  // Lots of ties, the lowest index must win.
+  Palette pal(FrameNumber(0), 256);
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, rgba((i%4)*80, (i%3)*120, 0, 255));
+
+  PaletteIndex index;
+  index.build(&pal, 0);
+
+  for (int r=0; r<256; r+=3)
+    for (int g=0; g<256; g+=3)
+      for (int b=0; b<256; b+=17)
+        ASSERT_EQ(pal.findBestfit(r, g, b, 0),
+                  index.findBestfit(r, g, b));
+}
+
+TEST(PaletteIndex, ExactBestfit)
+{
+  std::srand(2);
+
+  Palette pal(FrameNumber(0), 256);
+  fill_random_palette(pal);
+  // Two colors that are equal with 5 bits of precision.
+  pal.setEntry(1, rgba(64, 64, 64, 255));
+  pal.setEntry(2, rgba(70, 70, 70, 255));
+
+  PaletteIndex index;
+  index.build(&pal, 0);
+
+  EXPECT_EQ(1, index.findBestfit(70, 70, 70));
+  EXPECT_EQ(2, index.findExactBestfit(70, 70, 70));
+
+  for (int i=0; i<20000; ++i) {
+    int r = std::rand() % 256;
+    int g = std::rand() % 256;
+    int b = std::rand() % 256;
+    ASSERT_EQ(exact_bestfit(pal, r, g, b, 0),
+              index.findExactBestfit(r, g, b));
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -22,6 +22,7 @@
 
 #include "raster/primitives.h"
 
+#include "gfx/region.h"
 #include "raster/algo.h"
 #include "raster/blend.h"
 #include "raster/brush.h"
@@ -30,6 +31,7 @@
 #include "raster/palette.h"
 #include "raster/rgbmap.h"
 
+#include <cstring>
 #include <stdexcept>
 
 namespace raster {
@@ -82,6 +84,39 @@ void copy_image(Image* dst, const Image* src, int x, int y)
   dst->copy(src, x, y);
 }
 
+// Copies the pixels of "src" inside the given region to the same
+// position in "dst". Both images must have the same pixel format.
+void copy_image(Image* dst, const Image* src, const gfx::Region& rgn)
+{
+  ASSERT(dst->pixelFormat() == src->pixelFormat());
+
+  const gfx::Rect bounds = dst->bounds().createIntersect(src->bounds());
+
+  for (gfx::Region::const_iterator it=rgn.begin(), end=rgn.end(); it!=end; ++it) {
+    const gfx::Rect rc = (*it).createIntersect(bounds);
+    if (rc.isEmpty())
+      continue;
+
+    int bytes = dst->getRowStrideSize(rc.w);
+
+    for (int y=rc.y; y<rc.y+rc.h; ++y) {
+      const uint8_t* src_address = src->getPixelAddress(rc.x, y);
+
+      // Rows shared by both images (copy-on-write) are already equal.
+      if (src_address == static_cast<const Image*>(dst)->getPixelAddress(rc.x, y))
+        continue;
+
+      // Bitmap rows don't start in a byte boundary.
+      if (dst->pixelFormat() == IMAGE_BITMAP) {
+        for (int x=rc.x; x<rc.x+rc.w; ++x)
+          dst->putPixel(x, y, src->getPixel(x, y));
+      }
+      else
+        memcpy(dst->getPixelAddress(rc.x, y), src_address, bytes);
+    }
+  }
+}
+
 void composite_image(Image* dst, const Image* src, int x, int y, int opacity, int blend_mode)
 {
   dst->merge(src, x, y, opacity, blend_mode);
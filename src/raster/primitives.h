@@ -23,6 +23,10 @@
 #include "raster/color.h"
 #include "raster/image_buffer.h"
 
+namespace gfx {
+  class Region;
+}
+
 namespace raster {
   class Brush;
   class Image;
@@ -35,6 +39,7 @@ namespace raster {
   void clear_image(Image* image, color_t bg);
 
   void copy_image(Image* dst, const Image* src, int x, int y);
+  void copy_image(Image* dst, const Image* src, const gfx::Region& rgn);
   void composite_image(Image* dst, const Image* src, int x, int y, int opacity, int blend_mode);
 
   Image* crop_image(const Image* image, int x, int y, int w, int h, color_t bg, const ImageBufferPtr& buffer = ImageBufferPtr());
@@ -31,7 +31,7 @@ namespace raster {
     ASSERT(x >= 0 && x < image->width());
     ASSERT(y >= 0 && y < image->height());
 
-    return *(((ImageImpl<Traits>*)image)->address(x, y));
+    return *((typename Traits::const_address_t)image->getPixelAddress(x, y));
   }
 
   template<class Traits>
@@ -39,7 +39,9 @@ namespace raster {
     ASSERT(x >= 0 && x < image->width());
     ASSERT(y >= 0 && y < image->height());
 
-    *(((ImageImpl<Traits>*)image)->address(x, y)) = color;
+    // getPixelAddress() unshares the pixels (copy-on-write and sparse
+    // images)
+    *((typename Traits::address_t)image->getPixelAddress(x, y)) = color;
   }
 
   //////////////////////////////////////////////////////////////////////
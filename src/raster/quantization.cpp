@@ -22,6 +22,7 @@
 
 #include "raster/quantization.h"
 
+#include "base/thread_pool.h"
 #include "gfx/hsv.h"
 #include "gfx/rgb.h"
 #include "raster/blend.h"
@@ -43,14 +44,97 @@ namespace quantization {
 
 using namespace gfx;
 
+// Images are converted in horizontal bands of this height, each
+// band can be converted by a different thread.
+static const int convert_band_height = 64;
+
+static void convert_band(
+  const Image* image,
+  Image* new_image,
+  const gfx::Rect& band,
+  DitheringMethod ditheringMethod,
+  const RgbMap* rgbmap,
+  const Palette* palette,
+  bool is_background);
+
 // Converts a RGB image to indexed with ordered dithering method.
-static Image* ordered_dithering(
+static void ordered_dithering(
   const Image* src_image,
   Image* dst_image,
+  const gfx::Rect& band,
   int offsetx, int offsety,
   const RgbMap* rgbmap,
   const Palette* palette);
 
+namespace {
+
+  // Converts the bands of several images (it's called from
+  // different threads).
+  class ConvertBands {
+  public:
+    struct Band {
+      int image;
+      int y;
+    };
+
+    ConvertBands(const std::vector<const Image*>& src,
+                 const std::vector<Image*>& dst,
+                 const std::vector<bool>& is_background,
+                 const std::vector<Band>& bands,
+                 DitheringMethod ditheringMethod,
+                 const RgbMap* rgbmap,
+                 const Palette* palette)
+      : m_src(src), m_dst(dst), m_isBackground(is_background)
+      , m_bands(bands), m_ditheringMethod(ditheringMethod)
+      , m_rgbmap(rgbmap), m_palette(palette) {
+    }
+
+    void operator()(int i) const {
+      const Band& band = m_bands[i];
+      const Image* src = m_src[band.image];
+
+      convert_band(src, m_dst[band.image],
+                   gfx::Rect(0, band.y, src->width(),
+                             MIN(convert_band_height, src->height() - band.y)),
+                   m_ditheringMethod, m_rgbmap, m_palette,
+                   m_isBackground[band.image]);
+    }
+
+  private:
+    const std::vector<const Image*>& m_src;
+    const std::vector<Image*>& m_dst;
+    const std::vector<bool>& m_isBackground;
+    const std::vector<Band>& m_bands;
+    DitheringMethod m_ditheringMethod;
+    const RgbMap* m_rgbmap;
+    const Palette* m_palette;
+  };
+
+  // Feeds each optimizer with a consecutive group of images.
+  class FeedOptimizers {
+  public:
+    FeedOptimizers(const std::vector<Image*>& images,
+                   std::vector<PaletteOptimizer>& optimizers)
+      : m_images(images), m_optimizers(optimizers) {
+    }
+
+    void operator()(int group) const {
+      int n = (int)m_images.size();
+      int groups = (int)m_optimizers.size();
+      int begin = group * n / groups;
+      int end = (group+1) * n / groups;
+
+      for (int i=begin; i<end; ++i)
+        m_optimizers[group].feedWithImage(m_images[i]);
+    }
+
+  private:
+    const std::vector<Image*>& m_images;
+    std::vector<PaletteOptimizer>& m_optimizers;
+  };
+
+} // anonymous namespace
+
 Palette* create_palette_from_rgb(
   const Sprite* sprite,
   FrameNumber frameNumber,
@@ -97,14 +181,74 @@ Image* convert_pixel_format(
   const Palette* palette,
   bool is_background)
 {
-  if (!new_image)
-    new_image = Image::create(pixelFormat, image->width(), image->height());
+  std::vector<const Image*> src(1, image);
+  std::vector<Image*> dst(1, new_image);
+  std::vector<bool> isBackground(1, is_background);
+
+  convert_images_pixel_format(src, dst, isBackground, pixelFormat,
+                              ditheringMethod, rgbmap, palette);
+  return dst[0];
+}
+
+void convert_images_pixel_format(
+  const std::vector<const Image*>& src,
+  std::vector<Image*>& dst,
+  const std::vector<bool>& is_background,
+  PixelFormat pixelFormat,
+  DitheringMethod ditheringMethod,
+  const RgbMap* rgbmap,
+  const Palette* palette)
+{
+  ASSERT(src.size() == is_background.size());
+  dst.resize(src.size(), NULL);
+
+  std::vector<ConvertBands::Band> bands;
+
+  for (int i=0; i<(int)src.size(); ++i) {
+    const Image* image = src[i];
+    if (!dst[i])
+      dst[i] = Image::create(pixelFormat, image->width(), image->height());
+
+    // RGB -> RGB and Grayscale -> Grayscale (Indexed -> Indexed is
+    // remapped with the rgbmap).
+    if (image->pixelFormat() == dst[i]->pixelFormat() &&
+        image->pixelFormat() != IMAGE_INDEXED) {
+      dst[i]->copy(image, 0, 0);
+      continue;
+    }
 
+    // Destination pixels are unshared here, so bands can be written
+    // from different threads without modifying the image structure.
+    dst[i]->unshare(dst[i]->bounds());
+
+    ConvertBands::Band band;
+    band.image = i;
+    for (band.y=0; band.y<image->height(); band.y+=convert_band_height)
+      bands.push_back(band);
+  }
+
+  base::thread_pool::shared().for_each_index((int)bands.size(),
+    ConvertBands(src, dst, is_background, bands,
+                 ditheringMethod, rgbmap, palette));
+}
+
+// Converts the pixels inside the given band of "image" to the pixel
+// format of "new_image".
+static void convert_band(
+  const Image* image,
+  Image* new_image,
+  const gfx::Rect& band,
+  DitheringMethod ditheringMethod,
+  const RgbMap* rgbmap,
+  const Palette* palette,
+  bool is_background)
+{
   // RGB -> Indexed with ordered dithering
   if (image->pixelFormat() == IMAGE_RGB &&
-      pixelFormat == IMAGE_INDEXED &&
+      new_image->pixelFormat() == IMAGE_INDEXED &&
       ditheringMethod == DITHERING_ORDERED) {
-    return ordered_dithering(image, new_image, 0, 0, rgbmap, palette);
+    ordered_dithering(image, new_image, band, 0, 0, rgbmap, palette);
+    return;
   }
 
   color_t c;
@@ -113,19 +257,14 @@ Image* convert_pixel_format(
   switch (image->pixelFormat()) {
 
     case IMAGE_RGB: {
-      const LockImageBits<RgbTraits> srcBits(image);
+      const LockImageBits<RgbTraits> srcBits(image, band);
       LockImageBits<RgbTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
 
       switch (new_image->pixelFormat()) {
 
-        // RGB -> RGB
-        case IMAGE_RGB:
-          new_image->copy(image, 0, 0);
-          break;
-
         // RGB -> Grayscale
         case IMAGE_GRAYSCALE: {
-          LockImageBits<GrayscaleTraits> dstBits(new_image, Image::WriteLock);
+          LockImageBits<GrayscaleTraits> dstBits(new_image, Image::WriteLock, band);
           LockImageBits<GrayscaleTraits>::iterator dst_it = dstBits.begin();
 #ifdef _DEBUG
           LockImageBits<GrayscaleTraits>::iterator dst_end = dstBits.end();
@@ -147,24 +286,34 @@ Image* convert_pixel_format(
 
         // RGB -> Indexed
         case IMAGE_INDEXED: {
-          LockImageBits<IndexedTraits> dstBits(new_image, Image::WriteLock);
+          LockImageBits<IndexedTraits> dstBits(new_image, Image::WriteLock, band);
           LockImageBits<IndexedTraits>::iterator dst_it = dstBits.begin();
 #ifdef _DEBUG
           LockImageBits<IndexedTraits>::iterator dst_end = dstBits.end();
 #endif
 
+          // Pixel-art has long runs of the same color, so the last
+          // mapped color is remembered (a transparent black maps to 0).
+          color_t lastColor = 0;
+          int lastIndex = 0;
+
           for (; src_it != src_end; ++src_it, ++dst_it) {
             ASSERT(dst_it != dst_end);
             c = *src_it;
 
-            r = rgba_getr(c);
-            g = rgba_getg(c);
-            b = rgba_getb(c);
+            if (c != lastColor) {
+              lastColor = c;
+              if (rgba_geta(c) == 0)
+                lastIndex = 0;
+              else {
+                r = rgba_getr(c);
+                g = rgba_getg(c);
+                b = rgba_getb(c);
+                lastIndex = rgbmap->mapColor(r, g, b);
+              }
+            }
 
-            if (rgba_geta(c) == 0)
-              *dst_it = 0;
-            else
-              *dst_it = rgbmap->mapColor(r, g, b);
+            *dst_it = lastIndex;
           }
           ASSERT(dst_it == dst_end);
           break;
@@ -174,14 +323,14 @@ Image* convert_pixel_format(
     }
 
     case IMAGE_GRAYSCALE: {
-      const LockImageBits<GrayscaleTraits> srcBits(image);
+      const LockImageBits<GrayscaleTraits> srcBits(image, band);
       LockImageBits<GrayscaleTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
 
       switch (new_image->pixelFormat()) {
 
         // Grayscale -> RGB
         case IMAGE_RGB: {
-          LockImageBits<RgbTraits> dstBits(new_image, Image::WriteLock);
+          LockImageBits<RgbTraits> dstBits(new_image, Image::WriteLock, band);
           LockImageBits<RgbTraits>::iterator dst_it = dstBits.begin();
 #ifdef _DEBUG
           LockImageBits<RgbTraits>::iterator dst_end = dstBits.end();
@@ -199,14 +348,9 @@ Image* convert_pixel_format(
           break;
         }
 
-        // Grayscale -> Grayscale
-        case IMAGE_GRAYSCALE:
-          new_image->copy(image, 0, 0);
-          break;
-
         // Grayscale -> Indexed
         case IMAGE_INDEXED: {
-          LockImageBits<IndexedTraits> dstBits(new_image, Image::WriteLock);
+          LockImageBits<IndexedTraits> dstBits(new_image, Image::WriteLock, band);
           LockImageBits<IndexedTraits>::iterator dst_it = dstBits.begin();
 #ifdef _DEBUG
           LockImageBits<IndexedTraits>::iterator dst_end = dstBits.end();
@@ -229,14 +373,14 @@ Image* convert_pixel_format(
     }
 
     case IMAGE_INDEXED: {
-      const LockImageBits<IndexedTraits> srcBits(image);
+      const LockImageBits<IndexedTraits> srcBits(image, band);
       LockImageBits<IndexedTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
 
       switch (new_image->pixelFormat()) {
 
         // Indexed -> RGB
         case IMAGE_RGB: {
-          LockImageBits<RgbTraits> dstBits(new_image, Image::WriteLock);
+          LockImageBits<RgbTraits> dstBits(new_image, Image::WriteLock, band);
           LockImageBits<RgbTraits>::iterator dst_it = dstBits.begin();
 #ifdef _DEBUG
           LockImageBits<RgbTraits>::iterator dst_end = dstBits.end();
@@ -259,7 +403,7 @@ Image* convert_pixel_format(
 
         // Indexed -> Grayscale
         case IMAGE_GRAYSCALE: {
-          LockImageBits<GrayscaleTraits> dstBits(new_image, Image::WriteLock);
+          LockImageBits<GrayscaleTraits> dstBits(new_image, Image::WriteLock, band);
           LockImageBits<GrayscaleTraits>::iterator dst_it = dstBits.begin();
 #ifdef _DEBUG
           LockImageBits<GrayscaleTraits>::iterator dst_end = dstBits.end();
@@ -286,7 +430,7 @@ Image* convert_pixel_format(
 
         // Indexed -> Indexed
         case IMAGE_INDEXED: {
-          LockImageBits<IndexedTraits> dstBits(new_image, Image::WriteLock);
+          LockImageBits<IndexedTraits> dstBits(new_image, Image::WriteLock, band);
           LockImageBits<IndexedTraits>::iterator dst_it = dstBits.begin();
 #ifdef _DEBUG
           LockImageBits<IndexedTraits>::iterator dst_end = dstBits.end();
@@ -315,8 +459,6 @@ Image* convert_pixel_format(
       break;
     }
   }
-
-  return new_image;
 }
 
 /* Based on Gary Oberbrunner: */
@@ -350,9 +492,10 @@ static int pattern[8][8] = {
                                  4 * ((g1)-(g2)) * ((g1)-(g2)) +        \
                                  2 * ((b1)-(b2)) * ((b1)-(b2)))
 
-static Image* ordered_dithering(
+static void ordered_dithering(
   const Image* src_image,
   Image* dst_image,
+  const gfx::Rect& band,
   int offsetx, int offsety,
   const RgbMap* rgbmap,
   const Palette* palette)
@@ -365,73 +508,91 @@ static Image* ordered_dithering(
   int x, y;
   color_t c;
 
-  const LockImageBits<RgbTraits> src_bits(src_image);
-  LockImageBits<IndexedTraits> dst_bits(dst_image);
+  // Everything but the pattern depends only on the source color, so
+  // the values for the last color are reused in runs of the same
+  // color.
+  color_t lastColor = 0;
+  int lastNearest = 0;          // A transparent black maps to 0
+  int lastOpposite = 0;
+  int lastDitherConst = 0;
+
+  const LockImageBits<RgbTraits> src_bits(src_image, band);
+  LockImageBits<IndexedTraits> dst_bits(dst_image, Image::WriteLock, band);
   LockImageBits<RgbTraits>::const_iterator src_it = src_bits.begin();
   LockImageBits<IndexedTraits>::iterator dst_it = dst_bits.begin();
 
-  for (y=0; y<src_image->height(); ++y) {
-    for (x=0; x<src_image->width(); ++x, ++src_it, ++dst_it) {
+  for (y=band.y; y<band.y2(); ++y) {
+    for (x=band.x; x<band.x2(); ++x, ++src_it, ++dst_it) {
       ASSERT(src_it != src_bits.end());
       ASSERT(dst_it != dst_bits.end());
 
       c = *src_it;
 
-      r = rgba_getr(c);
-      g = rgba_getg(c);
-      b = rgba_getb(c);
-      a = rgba_geta(c);
-
-      if (a != 0) {
-        nearestcm = rgbmap->mapColor(r, g, b);
-        /* rgb values for nearest color */
-        nr = rgba_getr(palette->getEntry(nearestcm));
-        ng = rgba_getg(palette->getEntry(nearestcm));
-        nb = rgba_getb(palette->getEntry(nearestcm));
-        /* Color as far from rgb as nrngnb but in the other direction */
-        oppr = MID(0, 2*r - nr, 255);
-        oppg = MID(0, 2*g - ng, 255);
-        oppb = MID(0, 2*b - nb, 255);
-        /* Nearest match for opposite color: */
-        oppnrcm = rgbmap->mapColor(oppr, oppg, oppb);
-        /* If they're not the same, dither between them. */
-        /* Dither constant is measured by where the true
-           color lies between the two nearest approximations.
-           Since the most nearly opposite color is not necessarily
-           on the line from the nearest through the true color,
-           some triangulation error can be introduced.  In the worst
-           case the r-nr distance can actually be less than the nr-oppr
-           distance. */
-        if (oppnrcm != nearestcm) {
-          oppr = rgba_getr(palette->getEntry(oppnrcm));
-          oppg = rgba_getg(palette->getEntry(oppnrcm));
-          oppb = rgba_getb(palette->getEntry(oppnrcm));
-
-          dither_const = DIST(nr, ng, nb, oppr, oppg, oppb);
-          if (dither_const != 0) {
-            dither_const = 64 * DIST(r, g, b, nr, ng, nb) / dither_const;
-            dither_const = MIN(63, dither_const);
-
-            if (pattern[(x+offsetx) & 7][(y+offsety) & 7] < dither_const)
-              nearestcm = oppnrcm;
+      if (c != lastColor) {
+        lastColor = c;
+
+        r = rgba_getr(c);
+        g = rgba_getg(c);
+        b = rgba_getb(c);
+        a = rgba_geta(c);
+
+        nearestcm = 0;
+        oppnrcm = 0;
+        dither_const = 0;
+
+        if (a != 0) {
+          nearestcm = rgbmap->mapColor(r, g, b);
+          /* rgb values for nearest color */
+          nr = rgba_getr(palette->getEntry(nearestcm));
+          ng = rgba_getg(palette->getEntry(nearestcm));
+          nb = rgba_getb(palette->getEntry(nearestcm));
+          /* Color as far from rgb as nrngnb but in the other direction */
+          oppr = MID(0, 2*r - nr, 255);
+          oppg = MID(0, 2*g - ng, 255);
+          oppb = MID(0, 2*b - nb, 255);
+          /* Nearest match for opposite color: */
+          oppnrcm = rgbmap->mapColor(oppr, oppg, oppb);
+          /* If they're not the same, dither between them. */
+          /* Dither constant is measured by where the true
+             color lies between the two nearest approximations.
+             Since the most nearly opposite color is not necessarily
+             on the line from the nearest through the true color,
+             some triangulation error can be introduced.  In the worst
+             case the r-nr distance can actually be less than the nr-oppr
+             distance. */
+          if (oppnrcm != nearestcm) {
+            oppr = rgba_getr(palette->getEntry(oppnrcm));
+            oppg = rgba_getg(palette->getEntry(oppnrcm));
+            oppb = rgba_getb(palette->getEntry(oppnrcm));
+
+            dither_const = DIST(nr, ng, nb, oppr, oppg, oppb);
+            if (dither_const != 0) {
+              dither_const = 64 * DIST(r, g, b, nr, ng, nb) / dither_const;
+              dither_const = MIN(63, dither_const);
+            }
           }
         }
+
+        lastNearest = nearestcm;
+        lastOpposite = oppnrcm;
+        lastDitherConst = dither_const;
       }
-      else
-        nearestcm = 0;
 
-      *dst_it = nearestcm;
+      // With a zero constant the pattern never chooses the opposite
+      // color.
+      if (pattern[(x+offsetx) & 7][(y+offsety) & 7] < lastDitherConst)
+        *dst_it = lastOpposite;
+      else
+        *dst_it = lastNearest;
     }
   }
-
-  return dst_image;
 }
 
 //////////////////////////////////////////////////////////////////////
 // Creation of optimized palette for RGB images
 // by David Capello
 
-void PaletteOptimizer::feedWithImage(Image* image)
+void PaletteOptimizer::feedWithImage(const Image* image)
 {
   uint32_t color;
 
@@ -489,11 +650,25 @@ void PaletteOptimizer::calculate(Palette* palette, bool has_background_layer)
   //palette->resize(first_usable_entry+used_colors);   // TODO
 }
 
+void PaletteOptimizer::merge(const PaletteOptimizer& other)
+{
+  m_histogram.merge(other.m_histogram);
+}
+
 void create_palette_from_images(const std::vector<Image*>& images, Palette* palette, bool has_background_layer)
 {
-  PaletteOptimizer optimizer;
-  for (int i=0; i<(int)images.size(); ++i)
-    optimizer.feedWithImage(images[i]);
+  // Each thread creates the histogram of a consecutive group of
+  // images, then they're merged in order (so the result is the same
+  // as feeding one optimizer with all images).
+  int groups = MIN((int)images.size(), base::thread_pool::shared().size());
+  std::vector<PaletteOptimizer> optimizers(MAX(1, groups));
+
+  base::thread_pool::shared().for_each_index(groups,
+    FeedOptimizers(images, optimizers));
+
+  PaletteOptimizer& optimizer = optimizers[0];
+  for (int i=1; i<groups; ++i)
+    optimizer.merge(optimizers[i]);
 
   optimizer.calculate(palette, has_background_layer);
 }
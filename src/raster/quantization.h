@@ -39,13 +39,20 @@ namespace raster {
 
     class PaletteOptimizer {
     public:
-      void feedWithImage(Image* image);
+      void feedWithImage(const Image* image);
+
+      // Adds the samples fed to "other" optimizer, as if its images
+      // were fed to this one after the current ones.
+      void merge(const PaletteOptimizer& other);
+
       void calculate(Palette* palette, bool has_background_layer);
 
     private:
       quantization::ColorHistogram<5, 6, 5> m_histogram;
     };
 
+    // Creates an optimized palette for all the given images. Images
+    // are processed in parallel.
     void create_palette_from_images(
       const std::vector<Image*>& images,
       Palette* palette,
@@ -68,6 +75,18 @@ namespace raster {
       const Palette* palette,
       bool is_background);
 
+    // Same as convert_pixel_format() for several images at the same
+    // time, their pixels are converted in parallel. "dst" can contain
+    // NULL items (or be empty) to create new images.
+    void convert_images_pixel_format(
+      const std::vector<const Image*>& src,
+      std::vector<Image*>& dst,
+      const std::vector<bool>& is_background,
+      PixelFormat pixelFormat,
+      DitheringMethod ditheringMethod,
+      const RgbMap* rgbmap,
+      const Palette* palette);
+
   } // namespace quantization
 } // namespace raster
 
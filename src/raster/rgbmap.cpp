@@ -22,6 +22,7 @@
 
 #include "raster/rgbmap.h"
 
+#include "base/thread_pool.h"
 #include "raster/color_scales.h"
 #include "raster/palette.h"
 
@@ -29,11 +30,97 @@ namespace raster {
 
 #define MAPSIZE 32*32*32
 
+// Maximum number of modified palette entries to update the map
+// incrementally. With more entries it's faster to fill the whole map
+// again.
+static const int max_incremental_changes = 16;
+
+namespace {
+
+  // Fills the cells of the map with the given red component.
+  class FillMapSlice {
+  public:
+    FillMapSlice(const PaletteIndex& index, uint8_t* map)
+      : m_index(index), m_map(map) { }
+
+    void operator()(int r) const {
+      uint8_t* dst = m_map + (r << 10);
+      for (int g=0; g<32; ++g) {
+        for (int b=0; b<32; ++b) {
+          *(dst++) =
+            m_index.findBestfit(
+              scale_5bits_to_8bits(r),
+              scale_5bits_to_8bits(g),
+              scale_5bits_to_8bits(b));
+        }
+      }
+    }
+
+  private:
+    const PaletteIndex& m_index;
+    uint8_t* m_map;
+  };
+
+  // Updates the cells of the map with the given red component after
+  // some palette entries were modified (the other ones keep their
+  // colors). A cell only changes if its entry was modified (then it
+  // is searched again), or if a modified entry is now nearer.
+  class UpdateMapSlice {
+  public:
+    UpdateMapSlice(const PaletteIndex& index,
+                   const std::vector<color_t>& colors,
+                   const std::vector<int>& changed,
+                   const std::vector<bool>& isChanged,
+                   uint8_t* map)
+      : m_index(index), m_colors(colors)
+      , m_changed(changed), m_isChanged(isChanged)
+      , m_map(map) { }
+
+    void operator()(int r) const {
+      uint8_t* dst = m_map + (r << 10);
+      int r8 = scale_5bits_to_8bits(r);
+
+      for (int g=0; g<32; ++g) {
+        int g8 = scale_5bits_to_8bits(g);
+
+        for (int b=0; b<32; ++b, ++dst) {
+          int b8 = scale_5bits_to_8bits(b);
+          int best = *dst;
+
+          if (m_isChanged[best]) {
+            *dst = m_index.findBestfit(r8, g8, b8);
+            continue;
+          }
+
+          int lowest = PaletteIndex::bestfitDistance(r8, g8, b8, m_colors[best]);
+          for (int i : m_changed) {
+            int diff = PaletteIndex::bestfitDistance(r8, g8, b8, m_colors[i]);
+            if (diff < lowest || (diff == lowest && i < best)) {
+              best = i;
+              lowest = diff;
+            }
+          }
+          *dst = best;
+        }
+      }
+    }
+
+  private:
+    const PaletteIndex& m_index;
+    const std::vector<color_t>& m_colors;
+    const std::vector<int>& m_changed;
+    const std::vector<bool>& m_isChanged;
+    uint8_t* m_map;
+  };
+
+} // anonymous namespace
+
 RgbMap::RgbMap()
   : Object(OBJECT_RGBMAP)
   , m_map(MAPSIZE)
   , m_palette(NULL)
   , m_modifications(0)
+  , m_maskIndex(0)
 {
 }
 
@@ -48,26 +135,50 @@ void RgbMap::regenerate(const Palette* palette, int mask_index)
   m_palette = palette;
   m_modifications = palette->getModifications();
 
-  int i = 0;
-  for (int r=0; r<32; ++r) {
-    for (int g=0; g<32; ++g) {
-      for (int b=0; b<32; ++b) {
-        m_map[i++] =
-          palette->findBestfit(
-            scale_5bits_to_8bits(r),
-            scale_5bits_to_8bits(g),
-            scale_5bits_to_8bits(b), mask_index);
+  // Compare the palette with the colors used to generate the current
+  // map to know which entries were modified. This is the common case
+  // when the user edits one color of the palette.
+  std::vector<int> changed;
+  bool incremental =
+    (!m_colors.empty() &&
+     m_maskIndex == mask_index &&
+     (int)m_colors.size() == palette->size());
+
+  if (incremental) {
+    for (int i=0; i<palette->size(); ++i) {
+      color_t color = palette->getEntry(i);
+      if (m_colors[i] != color) {
+        m_colors[i] = color;
+        if (i != mask_index)
+          changed.push_back(i);
       }
     }
+    if ((int)changed.size() > max_incremental_changes)
+      incremental = false;
+  }
+  else {
+    m_colors.resize(palette->size());
+    for (int i=0; i<palette->size(); ++i)
+      m_colors[i] = palette->getEntry(i);
+    m_maskIndex = mask_index;
   }
-}
 
-int RgbMap::mapColor(int r, int g, int b) const
-{
-  ASSERT(r >= 0 && r < 256);
-  ASSERT(g >= 0 && g < 256);
-  ASSERT(b >= 0 && b < 256);
-  return m_map[((r>>3) << 10) + ((g>>3) << 5) + (b>>3)];
+  if (incremental && changed.empty())
+    return;
+
+  // The index gives the same results as Palette::findBestfit().
+  m_index.build(palette, mask_index);
+
+  if (incremental) {
+    std::vector<bool> isChanged(Palette::MaxColors, false);
+    for (int i : changed)
+      isChanged[i] = true;
+
+    base::thread_pool::shared().for_each_index(32,
+      UpdateMapSlice(m_index, m_colors, changed, isChanged, &m_map[0]));
+  }
+  else
+    base::thread_pool::shared().for_each_index(32, FillMapSlice(m_index, &m_map[0]));
 }
 
 } // namespace raster
@@ -21,7 +21,9 @@
 #pragma once
 
 #include "base/disable_copying.h"
+#include "raster/color.h"
 #include "raster/object.h"
+#include "raster/palette_index.h"
 
 #include <vector>
 
@@ -34,15 +36,41 @@ namespace raster {
     RgbMap();
 
     bool match(const Palette* palette) const;
+
+    // Updates the map for the given palette. If only a few entries
+    // were modified since the last call (with the same palette size
+    // and mask index), only cells affected by those entries are
+    // searched again.
     void regenerate(const Palette* palette, int mask_index);
 
-    int mapColor(int r, int g, int b) const;
+    // Returns the nearest palette entry using only the 5 most
+    // significant bits of each component (a lookup in the
+    // precomputed table).
+    int mapColor(int r, int g, int b) const {
+      ASSERT(r >= 0 && r < 256);
+      ASSERT(g >= 0 && g < 256);
+      ASSERT(b >= 0 && b < 256);
+      return m_map[((r>>3) << 10) + ((g>>3) << 5) + (b>>3)];
+    }
+
+    // Returns the nearest palette entry comparing all the 8 bits of
+    // each component.
+    int mapColorExact(int r, int g, int b) const {
+      return m_index.findExactBestfit(r, g, b);
+    }
+
+    const PaletteIndex& index() const { return m_index; }
 
   private:
     std::vector<uint8_t> m_map;
+    PaletteIndex m_index;
     const Palette* m_palette;
     int m_modifications;
 
+    // Palette colors and mask index used to generate the map.
+    std::vector<color_t> m_colors;
+    int m_maskIndex;
+
     DISABLE_COPYING(RgbMap);
   };
 
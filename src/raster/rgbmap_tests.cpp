@@ -0,0 +1,109 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "raster/palette.h"
+#include "raster/rgbmap.h"
+
+#include <climits>
+#include <cstdlib>
+
+using namespace raster;
+
+static void fill_random_palette(Palette& pal)
+{
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, rgba(std::rand() % 256, std::rand() % 256, std::rand() % 256, 255));
+}
+
+static void expect_same_as_bestfit(const RgbMap& rgbmap, const Palette& pal, int mask_index)
+{
+  for (int r=0; r<32; ++r)
+    for (int g=0; g<32; ++g)
+      for (int b=0; b<32; ++b)
+        ASSERT_EQ(pal.findBestfit(r<<3, g<<3, b<<3, mask_index),
+                  rgbmap.mapColor(r<<3, g<<3, b<<3));
+}
+
+TEST(RgbMap, Regenerate)
+{
+  std::srand(3);
+
+  Palette pal(FrameNumber(0), 256);
+  fill_random_palette(pal);
+
+  RgbMap rgbmap;
+  rgbmap.regenerate(&pal, 0);
+  EXPECT_TRUE(rgbmap.match(&pal));
+  expect_same_as_bestfit(rgbmap, pal, 0);
+
+  pal.setEntry(5, rgba(1, 2, 3, 255));
+  EXPECT_FALSE(rgbmap.match(&pal));
+}
+
+TEST(RgbMap, IncrementalRegenerate)
+{
+  std::srand(4);
+
+  Palette pal(FrameNumber(0), 32);
+  fill_random_palette(pal);
+
+  RgbMap rgbmap;
+  rgbmap.regenerate(&pal, 0);
+
+  for (int i=0; i<50; ++i) {
+    // Move some entries (sometimes the mask one too).
+    int n = 1 + std::rand() % 3;
+    for (int j=0; j<n; ++j)
+      pal.setEntry(std::rand() % pal.size(),
+                   rgba(std::rand() % 256, std::rand() % 256, std::rand() % 256, 255));
+
+    ASSERT_FALSE(rgbmap.match(&pal));
+    rgbmap.regenerate(&pal, 0);
+    ASSERT_TRUE(rgbmap.match(&pal));
+    expect_same_as_bestfit(rgbmap, pal, 0);
+  }
+
+  // Duplicated entries, the lowest index must win.
+  pal.setEntry(7, pal.getEntry(20));
+  rgbmap.regenerate(&pal, 0);
+  expect_same_as_bestfit(rgbmap, pal, 0);
+
+  pal.setEntry(20, pal.getEntry(3));
+  rgbmap.regenerate(&pal, 0);
+  expect_same_as_bestfit(rgbmap, pal, 0);
+
+  // Other mask index or palette size regenerates the whole map.
+  rgbmap.regenerate(&pal, -1);
+  expect_same_as_bestfit(rgbmap, pal, -1);
+
+  pal.resize(40);
+  rgbmap.regenerate(&pal, -1);
+  expect_same_as_bestfit(rgbmap, pal, -1);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
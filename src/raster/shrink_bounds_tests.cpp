@@ -0,0 +1,144 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/unique_ptr.h"
+#include "gfx/point.h"
+#include "gfx/rect.h"
+#include "raster/algorithm/shrink_bounds.h"
+#include "raster/image.h"
+#include "raster/primitives.h"
+
+#include <cstdlib>
+
+using namespace raster;
+
+// Bounds of the pixels that aren't equal to "refpixel" (transparent
+// RGB/grayscale pixels are equal between them).
+static gfx::Rect slow_shrink_bounds(const Image* image, color_t refpixel)
+{
+  gfx::Rect bounds;
+  for (int y=0; y<image->height(); ++y) {
+    for (int x=0; x<image->width(); ++x) {
+      color_t c = get_pixel(image, x, y);
+      bool same;
+      switch (image->pixelFormat()) {
+        case IMAGE_RGB:
+          same = (c == refpixel || (rgba_geta(c) == 0 && rgba_geta(refpixel) == 0));
+          break;
+        case IMAGE_GRAYSCALE:
+          same = (c == refpixel || (graya_geta(c) == 0 && graya_geta(refpixel) == 0));
+          break;
+        default:
+          same = (c == refpixel);
+          break;
+      }
+      if (!same)
+        bounds = bounds.createUnion(gfx::Rect(x, y, 1, 1));
+    }
+  }
+  return bounds;
+}
+
+static color_t random_color(PixelFormat format)
+{
+  switch (format) {
+    case IMAGE_RGB:
+      return rgba(std::rand() % 2, 0, std::rand() % 2, (std::rand() % 2) * 255);
+    case IMAGE_GRAYSCALE:
+      return graya(std::rand() % 2, (std::rand() % 2) * 255);
+    case IMAGE_INDEXED:
+      return std::rand() % 2;
+    default:
+      return std::rand() % 2;
+  }
+}
+
+TEST(ShrinkBounds, SameAsSlowVersion)
+{
+  std::srand(1);
+
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP };
+  for (int f=0; f<int(sizeof(formats)/sizeof(formats[0])); ++f) {
+    for (int i=0; i<500; ++i) {
+      int w = 1 + std::rand() % 80;
+      int h = 1 + std::rand() % 20;
+      base::UniquePtr<Image> image(Image::create(formats[f], w, h));
+      color_t bg = random_color(formats[f]);
+      clear_image(image, bg);
+
+      // Some pixels with random colors
+      int n = std::rand() % 4;
+      for (int j=0; j<n; ++j)
+        put_pixel(image, std::rand() % w, std::rand() % h, random_color(formats[f]));
+
+      gfx::Rect expected = slow_shrink_bounds(image, bg);
+      gfx::Rect bounds;
+      bool result = algorithm::shrink_bounds(image, bounds, bg);
+
+      ASSERT_EQ(!expected.isEmpty(), result);
+      if (result) {
+        ASSERT_EQ(expected.x, bounds.x);
+        ASSERT_EQ(expected.y, bounds.y);
+        ASSERT_EQ(expected.w, bounds.w);
+        ASSERT_EQ(expected.h, bounds.h);
+      }
+    }
+  }
+}
+
+TEST(ShrinkBounds, EmptyImage)
+{
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 64, 32));
+  clear_image(image, rgba(255, 0, 0, 0));
+
+  gfx::Rect bounds;
+  EXPECT_FALSE(algorithm::shrink_bounds(image, bounds, rgba(0, 0, 0, 0)));
+  EXPECT_TRUE(algorithm::shrink_bounds(image, bounds, rgba(255, 0, 0, 255)));
+  EXPECT_EQ(gfx::Rect(0, 0, 64, 32), bounds);
+
+  // Indexed images cannot contain this color
+  base::UniquePtr<Image> indexed(Image::create(IMAGE_INDEXED, 8, 8));
+  clear_image(indexed, 0);
+  EXPECT_TRUE(algorithm::shrink_bounds(indexed, bounds, 256));
+  EXPECT_EQ(gfx::Rect(0, 0, 8, 8), bounds);
+}
+
+TEST(ShrinkBounds, BigSparseImage)
+{
+  // A 4K frame with a small sprite in the middle.
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 4096, 4096));
+  clear_image(image, 0);
+  fill_rect(image, 1000, 2000, 1099, 2049, rgba(255, 255, 255, 255));
+  put_pixel(image, 3000, 2020, rgba(0, 0, 0, 128));
+
+  gfx::Rect bounds;
+  EXPECT_TRUE(algorithm::shrink_bounds(image, bounds, 0));
+  EXPECT_EQ(gfx::Rect(1000, 2000, 2001, 50), bounds);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
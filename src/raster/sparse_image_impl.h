@@ -0,0 +1,168 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef RASTER_SPARSE_IMAGE_IMPL_H_INCLUDED
+#define RASTER_SPARSE_IMAGE_IMPL_H_INCLUDED
+#pragma once
+
+#include "raster/image_impl.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace raster {
+
+  // Image for big canvases. Pixels are stored in bands of rows that
+  // are allocated only when they are modified. Bands of wide images
+  // have less rows (see MaxBandBytes), so modifying a small area
+  // doesn't allocate a lot of memory. All bands that weren't
+  // modified share the same buffer (filled with the color of the last
+  // clear() call), and bands are shared with copies of the image until
+  // they are modified (copy-on-write).
+  //
+  // Each row is contiguous in memory (as all images), so the ImageImpl
+  // algorithms work without changes.
+  template<class Traits>
+  class SparseImageImpl : public ImageImpl<Traits> {
+    typedef typename Traits::address_t address_t;
+
+  public:
+    enum {
+      MaxBandRows = 64,
+      MaxBandBytes = 64*1024
+    };
+
+    SparseImageImpl(int width, int height)
+      : ImageImpl<Traits>(width, height, NULL)
+      , m_bandHeight(calculateBandHeight(width))
+      , m_rowsTable(height)
+      , m_bands((height + m_bandHeight - 1) / m_bandHeight)
+    {
+      this->m_rows = &m_rowsTable[0];
+      resetEmptyBand(0);
+    }
+
+    // Creates a copy of "src" sharing its bands.
+    explicit SparseImageImpl(const SparseImageImpl& src)
+      : ImageImpl<Traits>(src.width(), src.height(), NULL)
+      , m_bandHeight(src.m_bandHeight)
+      , m_rowsTable(src.m_rowsTable)
+      , m_bands(src.m_bands)
+      , m_emptyBand(src.m_emptyBand)
+    {
+      this->m_rows = &m_rowsTable[0];
+      this->setMaskColor(src.maskColor());
+    }
+
+    int bandHeight() const { return m_bandHeight; }
+
+    int getMemSize() const override {
+      int size = sizeof(*this) + m_rowsTable.size()*sizeof(address_t);
+      size += m_emptyBand->size();
+      for (size_t i=0; i<m_bands.size(); ++i)
+        if (m_bands[i])
+          size += m_bands[i]->size();
+      return size;
+    }
+
+    void onUnshare(const gfx::Rect& bounds) override {
+      int y1 = MAX(0, bounds.y);
+      int y2 = MIN(this->height(), bounds.y+bounds.h) - 1;
+      if (y1 > y2 || bounds.w <= 0)
+        return;
+
+      for (int band=y1/m_bandHeight; band<=y2/m_bandHeight; ++band)
+        unshareBand(band);
+    }
+
+    // Releases all bands, so the image uses just one band of memory.
+    void clear(color_t color) override {
+      this->incrementVersion();
+      std::fill(m_bands.begin(), m_bands.end(), ImageBufferPtr());
+      resetEmptyBand(color);
+    }
+
+    Image* createSharedCopy() const override {
+      return new SparseImageImpl(*this);
+    }
+
+  private:
+    static int calculateBandHeight(int width) {
+      int rows = MaxBandBytes / Traits::getRowStrideBytes(width);
+      return MAX(1, MIN(MaxBandRows, rows));
+    }
+
+    int getBandRows(int band) const {
+      return MIN(m_bandHeight, this->height() - band*m_bandHeight);
+    }
+
+    void setupBandRows(int band, uint8_t* bits) {
+      int rowstride_bytes = Traits::getRowStrideBytes(this->width());
+      int y = band*m_bandHeight;
+      for (int v=0; v<getBandRows(band); ++v, ++y) {
+        m_rowsTable[y] = (address_t)bits;
+        bits += rowstride_bytes;
+      }
+    }
+
+    // Creates a new buffer for the bands that weren't modified (the
+    // old one can be shared with other images), and points all
+    // unmodified bands to it.
+    void resetEmptyBand(color_t color) {
+      m_emptyBand.reset(new ImageBuffer(1));
+
+      ImageImpl<Traits> tmp(this->width(), m_bandHeight, m_emptyBand);
+      tmp.clear(color);
+
+      uint8_t* bits = static_cast<const Image&>(tmp).getPixelAddress(0, 0);
+      for (int band=0; band<(int)m_bands.size(); ++band)
+        if (!m_bands[band])
+          setupBandRows(band, bits);
+    }
+
+    void unshareBand(int band) {
+      ImageBufferPtr& buffer = m_bands[band];
+      if (buffer && buffer.unique())
+        return;
+
+      int rowstride_bytes = Traits::getRowStrideBytes(this->width());
+      int y = band*m_bandHeight;
+      ImageBufferPtr newBuffer(new ImageBuffer(rowstride_bytes * getBandRows(band)));
+      uint8_t* bits = newBuffer->buffer();
+
+      for (int v=0; v<getBandRows(band); ++v, ++y)
+        memcpy(bits + v*rowstride_bytes, m_rowsTable[y], rowstride_bytes);
+
+      buffer = newBuffer;
+      setupBandRows(band, bits);
+    }
+
+    int m_bandHeight;
+    std::vector<address_t> m_rowsTable;
+
+    // Modified bands (NULL if it points to m_emptyBand).
+    std::vector<ImageBufferPtr> m_bands;
+
+    // Buffer of a ImageImpl with m_bandHeight rows filled with the
+    // color of the last clear() call.
+    ImageBufferPtr m_emptyBand;
+  };
+
+} // namespace raster
+
+#endif
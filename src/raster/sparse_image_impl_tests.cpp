@@ -0,0 +1,174 @@
+/* Aseprite
+ * Copyright (C) 2001-2015  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/unique_ptr.h"
+#include "raster/image.h"
+#include "raster/image_bits.h"
+#include "raster/primitives.h"
+#include "raster/primitives_fast.h"
+#include "raster/sparse_image_impl.h"
+
+#include <cstdlib>
+
+using namespace base;
+using namespace raster;
+
+template<typename T>
+class SparseImageAllTypes : public testing::Test {
+protected:
+  SparseImageAllTypes() { }
+};
+
+typedef testing::Types<RgbTraits, GrayscaleTraits, IndexedTraits, BitmapTraits> SparseImageAllTraits;
+TYPED_TEST_CASE(SparseImageAllTypes, SparseImageAllTraits);
+
+// Draws the same random stuff in a sparse and a normal image and
+// compares both.
+TYPED_TEST(SparseImageAllTypes, SameResultsThanImageImpl)
+{
+  typedef TypeParam ImageTraits;
+
+  int w = 77, h = 300;
+  UniquePtr<Image> a(new SparseImageImpl<ImageTraits>(w, h));
+  UniquePtr<Image> b(Image::create(ImageTraits::pixel_format, w, h));
+  UniquePtr<Image> src(Image::create(ImageTraits::pixel_format, 40, 100));
+  clear_image(a, 0);
+  clear_image(b, 0);
+
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x)
+      put_pixel(src, x, y, std::rand() % ImageTraits::max_value);
+
+  for (int c=0; c<50; ++c) {
+    int x = std::rand() % w;
+    int y = std::rand() % h;
+    int color = std::rand() % ImageTraits::max_value;
+
+    switch (c % 4) {
+      case 0:
+        put_pixel(a, x, y, color);
+        put_pixel(b, x, y, color);
+        break;
+      case 1:
+        a->drawHLine(0, y, x, color);
+        b->drawHLine(0, y, x, color);
+        break;
+      case 2:
+        copy_image(a, src, x-20, y-50);
+        copy_image(b, src, x-20, y-50);
+        break;
+      case 3:
+        composite_image(a, src, x-20, y-50, 255, BLEND_MODE_NORMAL);
+        composite_image(b, src, x-20, y-50, 255, BLEND_MODE_NORMAL);
+        break;
+    }
+  }
+
+  EXPECT_EQ(0, count_diff_between_images(a, b));
+
+  // Iterators cross bands
+  {
+    const LockImageBits<ImageTraits> bitsA((const Image*)a.get());
+    const LockImageBits<ImageTraits> bitsB((const Image*)b.get());
+    typename LockImageBits<ImageTraits>::const_iterator
+      itA = bitsA.begin(), endA = bitsA.end(),
+      itB = bitsB.begin();
+
+    for (; itA != endA; ++itA, ++itB)
+      ASSERT_EQ(*itB, *itA);
+  }
+}
+
+TYPED_TEST(SparseImageAllTypes, CopyOnWriteBands)
+{
+  typedef TypeParam ImageTraits;
+
+  UniquePtr<Image> a(new SparseImageImpl<ImageTraits>(32, 200));
+  clear_image(a, 1);
+  put_pixel(a, 3, 150, 0);
+
+  UniquePtr<Image> b(Image::createCopy(a));
+  put_pixel(b, 3, 10, 0);
+  put_pixel(b, 3, 150, 1);
+
+  EXPECT_EQ(1, get_pixel(a, 3, 10));
+  EXPECT_EQ(0, get_pixel(a, 3, 150));
+  EXPECT_EQ(0, get_pixel(b, 3, 10));
+  EXPECT_EQ(1, get_pixel(b, 3, 150));
+  EXPECT_EQ(1, get_pixel(b, 31, 199));
+
+  // The unmodified bands are still shared
+  EXPECT_EQ(((const Image*)a.get())->getPixelAddress(0, 70),
+            ((const Image*)b.get())->getPixelAddress(0, 70));
+
+  clear_image(b, 0);
+  EXPECT_EQ(0, get_pixel(b, 3, 150));
+  EXPECT_EQ(1, get_pixel(a, 3, 10));
+}
+
+// Rows that weren't modified point to the same empty band, writing
+// a pixel must not change other rows.
+TYPED_TEST(SparseImageAllTypes, PutPixelFastUnsharesBands)
+{
+  typedef TypeParam ImageTraits;
+
+  UniquePtr<Image> image(Image::create(ImageTraits::pixel_format, 4096, 4096));
+  clear_image(image, 0);
+  put_pixel_fast<ImageTraits>(image, 10, 0, 1);
+
+  EXPECT_EQ(1, get_pixel_fast<ImageTraits>(image, 10, 0));
+  EXPECT_EQ(0, get_pixel_fast<ImageTraits>(image, 10, 100));
+  EXPECT_EQ(0, get_pixel_fast<ImageTraits>(image, 10, 4000));
+  EXPECT_EQ(0, get_pixel(image, 10, 4095));
+}
+
+TEST(SparseImage, BigImagesUseLittleMemory)
+{
+  UniquePtr<Image> image(Image::create(IMAGE_RGB, 16384, 16384));
+  clear_image(image, 0);
+  put_pixel(image, 100, 100, rgba(255, 0, 0, 255));
+  fill_rect(image, 0, 8000, 31, 8010, rgba(0, 255, 0, 255));
+
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(image, 100, 100));
+  EXPECT_EQ(rgba(0, 255, 0, 255), get_pixel(image, 31, 8010));
+  EXPECT_EQ(0, get_pixel(image, 16383, 16383));
+
+  // 12 bands of one row (16384 pixels) + the rows table
+  EXPECT_LT(image->getMemSize(), 2*1024*1024);
+}
+
+TEST(SparseImage, BandsOfWideImagesHaveLessRows)
+{
+  EXPECT_EQ(64, SparseImageImpl<RgbTraits>(32, 1000).bandHeight());
+  EXPECT_EQ(16, SparseImageImpl<RgbTraits>(1024, 1000).bandHeight());
+  EXPECT_EQ(64, SparseImageImpl<IndexedTraits>(1024, 1000).bandHeight());
+  EXPECT_EQ(1, SparseImageImpl<RgbTraits>(16384, 1000).bandHeight());
+  EXPECT_EQ(1, SparseImageImpl<RgbTraits>(32768, 10).bandHeight());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -214,9 +214,17 @@ void UndoHistory::postUndoerAddedEvent(Undoer* undoer)
 // Discards undoers in in case the UndoHistory is bigger than the given limit.
 void UndoHistory::checkSizeLimit()
 {
-  // Is undo history too big?
-  size_t groups = m_undoers->countUndoGroups();
   size_t undoLimit = m_delegate->getUndoSizeLimit();
+  if (m_undoers->getMemSize() <= undoLimit)
+    return;
+
+  // First we try to move the oldest undoers out of memory, so the
+  // limit is for the memory used by the history and not for the
+  // number of steps.
+  m_undoers->spillTail(undoLimit);
+
+  // Is undo history still too big?
+  size_t groups = m_undoers->countUndoGroups();
   while (groups > 1 && m_undoers->getMemSize() > undoLimit) {
     discardTail();
     groups--;
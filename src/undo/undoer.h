@@ -29,9 +29,16 @@ namespace undo {
     virtual void dispose() = 0;
 
     // Returns the amount of memory (in bytes) which this instance is
-    // using to revert the action.
+    // using to revert the action. It can change while the undoer is
+    // in the history (e.g. if it shares data with other undoers).
     virtual size_t getMemSize() const = 0;
 
+    // Moves the data used to revert the action out of memory (e.g. to
+    // a file), so getMemSize() returns a smaller value. It's called
+    // for the oldest undoers when the history is bigger than its
+    // limit. Returns false if the undoer cannot release memory.
+    virtual bool spill() = 0;
+
     // Returns the kind of modification that this item does with the
     // document.
     virtual Modification getModification() const = 0;
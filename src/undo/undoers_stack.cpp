@@ -18,7 +18,6 @@ namespace undo {
 UndoersStack::UndoersStack(UndoHistory* undoHistory)
 {
   m_undoHistory = undoHistory;
-  m_size = 0;
 }
 
 UndoersStack::~UndoersStack()
@@ -31,13 +30,35 @@ void UndoersStack::clear()
   for (iterator it = begin(), end = this->end(); it != end; ++it)
     (*it)->dispose();           // Delete the Undoer.
 
-  m_size = 0;
   m_items.clear();              // Clear the list of items.
 }
 
 size_t UndoersStack::getMemSize() const
 {
-  return m_size;
+  // The size is not cached because the size of an undoer can change
+  // while it is in the stack (e.g. when it shares data with other
+  // undoers that were deleted).
+  size_t size = 0;
+  for (const_iterator it = begin(), end = this->end(); it != end; ++it)
+    size += (*it)->getMemSize();
+
+  return size;
+}
+
+void UndoersStack::spillTail(size_t limit)
+{
+  size_t size = getMemSize();
+
+  for (Items::reverse_iterator it = m_items.rbegin(), end = m_items.rend();
+       it != end && size > limit; ++it) {
+    Undoer* undoer = *it;
+    size_t oldSize = undoer->getMemSize();
+
+    if (undoer->spill()) {
+      ASSERT(undoer->getMemSize() <= oldSize);
+      size -= oldSize - undoer->getMemSize();
+    }
+  }
 }
 
 ObjectsContainer* UndoersStack::getObjects() const
@@ -56,8 +77,6 @@ void UndoersStack::pushUndoer(Undoer* undoer)
     undoer->dispose();
     throw;
   }
-
-  m_size += undoer->getMemSize();
 }
 
 Undoer* UndoersStack::popUndoer(PopFrom popFrom)
@@ -73,7 +92,6 @@ Undoer* UndoersStack::popUndoer(PopFrom popFrom)
 
     undoer = (*it);                 // Set the undoer to return.
     m_items.erase(it);              // Erase the item from the stack.
-    m_size -= undoer->getMemSize(); // Reduce the stack size.
   }
   else
     undoer = NULL;
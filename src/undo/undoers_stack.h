@@ -51,6 +51,10 @@ namespace undo {
 
     size_t getMemSize() const;
 
+    // Moves the data of the oldest undoers out of memory (see
+    // Undoer::spill()) until the stack uses "limit" bytes or less.
+    void spillTail(size_t limit);
+
     // UndoersCollector implementation
     void pushUndoer(Undoer* undoer);
 
@@ -63,9 +67,6 @@ namespace undo {
   private:
     UndoHistory* m_undoHistory;
     Items m_items;
-
-    // Bytes occupied by all undoers in the stack.
-    size_t m_size;
   };
 
 } // namespace undo